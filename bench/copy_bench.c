@@ -0,0 +1,166 @@
+// Where streaming pushes start to pay off: for a sweep of batch sizes, pushes
+// batches into a large `char` ringbuffer once with plain `memcpy` and once with
+// the non-temporal kernel of SRB_NT_COPY (and pops them with `memcpy` and with
+// prefetching). Between pushes, the producer works through its own working set,
+// as many bytes of it as it pushed. Prints one CSV row per batch size and
+// kernel, with the nanoseconds per batch spent on the push, on the working set,
+// and on the pop:
+//
+//   copy_bench [working set bytes] [bytes per run]
+//
+// A plain push pulls the ringbuffer into the cache and evicts the working set,
+// so working on it slows down. A streaming push may cost more by itself, and
+// the crossover is the smallest batch for which push plus work comes out
+// clearly cheaper streamed; set SRB_NT_THRESHOLD to about that. The pop here
+// runs on the producer's thread, so it finds plain-pushed data in the cache,
+// which a consumer on another core wouldn't.
+#define SRB_NT_COPY
+#define SRB_COPY_PUSH(dst, src, bytes) copy_push(dst, src, bytes)
+#define SRB_COPY_POP(dst, src, bytes) copy_pop(dst, src, bytes)
+#include <stddef.h>
+static void (*copy_push)(void *dst, const void *src, size_t bytes);
+static void (*copy_pop)(void *dst, const void *src, size_t bytes);
+#include "srb.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+SRB_DECL_SLICE(char);
+SRB_DECL_SPSC(static, ring, char);
+SRB_DEF_SPSC(static, ring, char);
+
+// Far bigger than the producer's own caches, so every push lands on lines that
+// aren't in them
+#define RING_BYTES (64 << 20)
+// Each measurement is the best of this many runs
+#define REPEATS 3
+// Streaming has to win by more than this fraction to count, not just by noise
+#define MARGIN 0.05
+#define LEN(a) (sizeof(a) / sizeof(*(a)))
+
+static const size_t batch_sizes[] = {256,   1024,   4096,   16384,
+                                     65536, 262144, 1048576};
+
+static void plain_copy(void *dst, const void *src, size_t bytes) {
+  memcpy(dst, src, bytes);
+}
+
+static double now(void) {
+  struct timespec t;
+  timespec_get(&t, TIME_UTC);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+/**
+ * @brief Reads and writes the next `bytes` bytes of the working set `ws`, a
+ * cache line at a time, as a producer doing its own work between pushes would,
+ * going back to the start when it gets to the end.
+ */
+static void touch(volatile char *ws, size_t ws_bytes, size_t *at,
+                  size_t bytes) {
+  for (size_t i = 0; i < bytes; i += 64) {
+    ws[*at]++;
+    *at = (*at + 64) % ws_bytes;
+  }
+}
+
+typedef struct {
+  double push_ns, touch_ns, pop_ns;
+} timing;
+
+static timing run_once(ring *q, char *batch, char *ws, size_t ws_bytes,
+                       size_t batch_bytes, size_t total) {
+  size_t iterations = total / batch_bytes;
+  if (iterations < 16) {
+    iterations = 16;
+  }
+  srb_char_slice v = {batch, batch_bytes};
+  timing t = {0, 0, 0};
+  size_t at = 0;
+  for (size_t i = 0; i < iterations; i++) {
+    double t0 = now();
+    ring_push(q, v);
+    double t1 = now();
+    touch(ws, ws_bytes, &at, batch_bytes);
+    double t2 = now();
+    ring_pop(q, v);
+    double t3 = now();
+    t.push_ns += t1 - t0;
+    t.touch_ns += t2 - t1;
+    t.pop_ns += t3 - t2;
+  }
+  t.push_ns /= (double)iterations;
+  t.touch_ns /= (double)iterations;
+  t.pop_ns /= (double)iterations;
+  return t;
+}
+
+static timing run(ring *q, char *batch, char *ws, size_t ws_bytes,
+                  size_t batch_bytes, size_t total) {
+  timing best = run_once(q, batch, ws, ws_bytes, batch_bytes, total);
+  for (int i = 1; i < REPEATS; i++) {
+    timing t = run_once(q, batch, ws, ws_bytes, batch_bytes, total);
+    if (t.push_ns + t.touch_ns < best.push_ns + best.touch_ns) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+long parse_arg(int n, int argc, char **argv, long default_arg) {
+  if (n < 1 || n >= argc) {
+    return default_arg;
+  } else {
+    char *end;
+    return strtol(argv[n], &end, 10);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t ws_bytes = parse_arg(1, argc, argv, 512 << 10);
+  size_t total = parse_arg(2, argc, argv, 256 << 20);
+
+  ring q;
+  SRB_INIT_SPSC(q, RING_BYTES);
+  char *batch = malloc(batch_sizes[LEN(batch_sizes) - 1]);
+  char *ws = malloc(ws_bytes);
+  assert(batch != NULL && ws != NULL);
+  memset(batch, 1, batch_sizes[LEN(batch_sizes) - 1]);
+  memset(ws, 0, ws_bytes);
+  // Fault the whole ringbuffer in first
+  memset(q.buffer.data, 0, q.buffer.size);
+
+  printf("batch,kernel,push_ns,working_set_ns,pop_ns,producer_ns\n");
+  size_t crossover = 0;
+  for (size_t b = 0; b < LEN(batch_sizes); b++) {
+    size_t bytes = batch_sizes[b];
+    copy_push = plain_copy;
+    copy_pop = plain_copy;
+    timing plain = run(&q, batch, ws, ws_bytes, bytes, total);
+    copy_push = srb_stream_copy;
+    copy_pop = srb_prefetch_copy;
+    timing streamed = run(&q, batch, ws, ws_bytes, bytes, total);
+    printf("%zu,memcpy,%.0f,%.0f,%.0f,%.0f\n", bytes, plain.push_ns,
+           plain.touch_ns, plain.pop_ns, plain.push_ns + plain.touch_ns);
+    printf("%zu,stream,%.0f,%.0f,%.0f,%.0f\n", bytes, streamed.push_ns,
+           streamed.touch_ns, streamed.pop_ns,
+           streamed.push_ns + streamed.touch_ns);
+    if (crossover == 0 && streamed.push_ns + streamed.touch_ns <
+                              (1 - MARGIN) * (plain.push_ns + plain.touch_ns)) {
+      crossover = bytes;
+    }
+    fflush(stdout);
+  }
+  if (crossover != 0) {
+    printf("# streaming pays off for the producer from %zu bytes\n",
+           crossover);
+  } else {
+    printf("# streaming never paid off for the producer\n");
+  }
+
+  SRB_FREE(q);
+  free(batch);
+  free(ws);
+  return 0;
+}
@@ -0,0 +1,95 @@
+// Measures push/pop throughput of a shared ringbuffer at a few thread counts.
+// Built twice by CMake, once as-is and once with SRB_CACHELINE defined, so the
+// two outputs can be compared to see what the cache-line-isolated layout buys.
+#include "srb.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+
+SRB_DECL(static, srb, size_t);
+SRB_DEF(static, srb, size_t);
+
+#ifdef SRB_CACHELINE
+#define LAYOUT "cacheline"
+#else // SRB_CACHELINE
+#define LAYOUT "packed"
+#endif // SRB_CACHELINE
+
+static srb q;
+static size_t per_thread;
+
+int reader(void *arg) {
+  (void)arg;
+  size_t i;
+  for (size_t n = 0; n < per_thread; n++) {
+    while (srb_try_pop_one(&q, &i)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+int writer(void *arg) {
+  (void)arg;
+  for (size_t n = 0; n < per_thread; n++) {
+    while (srb_try_push_one(&q, n)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+long parse_arg(int n, int argc, char **argv, long default_arg) {
+  if (n < 1 || n >= argc) {
+    return default_arg;
+  } else {
+    char *end;
+    return strtol(argv[n], &end, 10);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t total = parse_arg(1, argc, argv, 2000000);
+  size_t buffer_size = parse_arg(2, argc, argv, 1024);
+  static const size_t thread_counts[] = {2, 8, 32};
+
+  printf("layout,threads,ops,seconds,ops_per_sec\n");
+  for (size_t t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); t++) {
+    // Half the threads push, the other half pop
+    size_t pairs = thread_counts[t] / 2;
+    per_thread = total / pairs;
+    thrd_t *threads = malloc(sizeof(thrd_t) * pairs * 2);
+    assert(threads != NULL);
+    SRB_INIT(q, buffer_size);
+
+    double start = now();
+    for (size_t i = 0; i < pairs; i++) {
+      // Not in an assert, which a release build compiles out
+      if (thrd_create(&threads[2 * i], reader, NULL) != thrd_success ||
+          thrd_create(&threads[2 * i + 1], writer, NULL) != thrd_success) {
+        fprintf(stderr, "failed to start threads\n");
+        return 1;
+      }
+    }
+    for (size_t i = 0; i < pairs * 2; i++) {
+      thrd_join(threads[i], NULL);
+    }
+    double seconds = now() - start;
+
+    size_t ops = per_thread * pairs * 2;
+    printf("%s,%zu,%zu,%f,%f\n", LAYOUT, thread_counts[t], ops, seconds,
+           (double)ops / seconds);
+    SRB_FREE(q);
+    free(threads);
+  }
+
+  return 0;
+}
@@ -0,0 +1,572 @@
+// Throughput and latency of every ringbuffer flavour, next to a plain
+// mutex-protected array queue, over a sweep of producers x consumers x batch
+// size x element size x capacity. Prints one CSV row or JSON object per run:
+//
+//   ring_bench [csv|json] [elements per run] [latency samples]
+//
+// "throughput" rows move that many elements from the producers to the
+// consumers with *_try_push_some/*_try_pop_some, `batch` at a time.
+// "latency" rows bounce one element back and forth between two threads
+// through a pair of queues, and report percentiles of the round trip.
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif // __linux__
+#include "srb.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+typedef struct {
+  uint64_t v[1];
+} elem8;
+typedef struct {
+  uint64_t v[8];
+} elem64;
+typedef struct {
+  uint64_t v[32];
+} elem256;
+
+#define DECL_RINGS(ELEM)                                                       \
+  SRB_DECL(static, ring_##ELEM, ELEM);                                         \
+  SRB_DEF(static, ring_##ELEM, ELEM);                                          \
+  SRB_DECL_MPSC(static, mpsc_##ELEM, ELEM);                                    \
+  SRB_DEF_MPSC(static, mpsc_##ELEM, ELEM);                                     \
+  SRB_DECL_SPSC(static, spsc_##ELEM, ELEM);                                    \
+  SRB_DEF_SPSC(static, spsc_##ELEM, ELEM);                                     \
+  SRB_DECL_SLOTS(static, slots_##ELEM, ELEM);                                  \
+  SRB_DEF_SLOTS(static, slots_##ELEM, ELEM);                                   \
+  SRB_DECL_SHARDED(static, sharded_##ELEM, mpsc_##ELEM, ELEM);                 \
+  SRB_DEF_SHARDED(static, sharded_##ELEM, mpsc_##ELEM, ELEM);
+
+DECL_RINGS(elem8)
+DECL_RINGS(elem64)
+DECL_RINGS(elem256)
+
+/**
+ * @brief Exits if `ok` is 0. For calls that have to happen, which `assert`
+ * would compile out of a release build.
+ */
+static void check(int ok, const char *what) {
+  if (!ok) {
+    fprintf(stderr, "%s failed\n", what);
+    exit(1);
+  }
+}
+
+/**
+ * @brief A queue under test. `push_some` and `pop_some` move up to `n`
+ * elements and return how many they moved.
+ */
+typedef struct {
+  const char *name;
+  size_t elem_size;
+  /** @brief 1 if only one thread may push/pop at a time, 0 if any number. */
+  int single_producer, single_consumer;
+  void *(*create)(size_t capacity, size_t elem_size);
+  void (*destroy)(void *q);
+  size_t (*push_some)(void *q, const void *elems, size_t n);
+  size_t (*pop_some)(void *q, void *elems, size_t n);
+} impl;
+
+#define RING_ADAPTER(NAME, TYPE, ELEM, INIT)                                   \
+  static void *NAME##_create(size_t capacity, size_t elem_size) {              \
+    (void)elem_size;                                                           \
+    TYPE *q = malloc(sizeof(TYPE));                                            \
+    assert(q != NULL);                                                         \
+    INIT((*q), capacity);                                                      \
+    return q;                                                                  \
+  }                                                                            \
+                                                                               \
+  static void NAME##_destroy(void *q) {                                        \
+    SRB_FREE(*(TYPE *)q);                                                      \
+    free(q);                                                                   \
+  }                                                                            \
+                                                                               \
+  static size_t NAME##_push_some(void *q, const void *elems, size_t n) {       \
+    srb_##ELEM##_slice v = {(ELEM *)elems, n};                                 \
+    size_t done;                                                               \
+    return TYPE##_try_push_some(q, v, &done) ? 0 : done;                       \
+  }                                                                            \
+                                                                               \
+  static size_t NAME##_pop_some(void *q, void *elems, size_t n) {              \
+    srb_##ELEM##_slice v = {elems, n};                                         \
+    size_t done;                                                               \
+    return TYPE##_try_pop_some(q, v, &done) ? 0 : done;                        \
+  }
+
+#define RING_ADAPTERS(ELEM)                                                    \
+  RING_ADAPTER(srb_##ELEM, ring_##ELEM, ELEM, SRB_INIT)                        \
+  RING_ADAPTER(mpsc_##ELEM, mpsc_##ELEM, ELEM, SRB_INIT_MPSC)                  \
+  RING_ADAPTER(spsc_##ELEM, spsc_##ELEM, ELEM, SRB_INIT_SPSC)
+
+RING_ADAPTERS(elem8)
+RING_ADAPTERS(elem64)
+RING_ADAPTERS(elem256)
+
+// SRB_DECL_SLOTS only moves one element at a time, so a batch is a loop
+#define SLOTS_ADAPTER(ELEM)                                                    \
+  static void *slots_##ELEM##_create(size_t capacity, size_t elem_size) {      \
+    (void)elem_size;                                                           \
+    slots_##ELEM *q = malloc(sizeof(slots_##ELEM));                            \
+    assert(q != NULL);                                                         \
+    SRB_INIT_SLOTS((*q), capacity);                                            \
+    return q;                                                                  \
+  }                                                                            \
+                                                                               \
+  static void slots_##ELEM##_destroy(void *q) {                                \
+    SRB_FREE_SLOTS(*(slots_##ELEM *)q);                                        \
+    free(q);                                                                   \
+  }                                                                            \
+                                                                               \
+  static size_t slots_##ELEM##_push_some(void *q, const void *elems,           \
+                                         size_t n) {                           \
+    size_t done = 0;                                                           \
+    while (done < n &&                                                         \
+           slots_##ELEM##_try_push_one(q, ((const ELEM *)elems)[done]) == 0) { \
+      done++;                                                                  \
+    }                                                                          \
+    return done;                                                               \
+  }                                                                            \
+                                                                               \
+  static size_t slots_##ELEM##_pop_some(void *q, void *elems, size_t n) {      \
+    size_t done = 0;                                                           \
+    while (done < n &&                                                         \
+           slots_##ELEM##_try_pop_one(q, &((ELEM *)elems)[done]) == 0) {       \
+      done++;                                                                  \
+    }                                                                          \
+    return done;                                                               \
+  }
+
+SLOTS_ADAPTER(elem8)
+SLOTS_ADAPTER(elem64)
+SLOTS_ADAPTER(elem256)
+
+// SRB_DECL_SHARDED over SHARDED_LANES MPSC lanes, splitting the capacity
+#define SHARDED_LANES 4
+#define SHARDED_ADAPTER(ELEM)                                                  \
+  static void *sharded_##ELEM##_create(size_t capacity, size_t elem_size) {    \
+    (void)elem_size;                                                           \
+    sharded_##ELEM *q = malloc(sizeof(sharded_##ELEM));                        \
+    assert(q != NULL);                                                         \
+    size_t lane = capacity / SHARDED_LANES;                                    \
+    SRB_INIT_SHARDED((*q), SHARDED_LANES, lane > 0 ? lane : 1, SRB_INIT_MPSC); \
+    return q;                                                                  \
+  }                                                                            \
+                                                                               \
+  static void sharded_##ELEM##_destroy(void *q) {                              \
+    SRB_FREE_SHARDED(*(sharded_##ELEM *)q);                                    \
+    free(q);                                                                   \
+  }                                                                            \
+                                                                               \
+  static size_t sharded_##ELEM##_push_some(void *q, const void *elems,         \
+                                           size_t n) {                         \
+    srb_##ELEM##_slice v = {(ELEM *)elems, n};                                 \
+    size_t done;                                                               \
+    return sharded_##ELEM##_try_push_some(q, v, &done) ? 0 : done;             \
+  }                                                                            \
+                                                                               \
+  static size_t sharded_##ELEM##_pop_some(void *q, void *elems, size_t n) {    \
+    srb_##ELEM##_slice v = {elems, n};                                         \
+    size_t done;                                                               \
+    return sharded_##ELEM##_try_pop_some(q, v, &done) ? 0 : done;              \
+  }
+
+SHARDED_ADAPTER(elem8)
+SHARDED_ADAPTER(elem64)
+SHARDED_ADAPTER(elem256)
+
+/**
+ * @brief The baseline: an array used as a ringbuffer, with one lock around
+ * everything.
+ */
+typedef struct {
+  mtx_t lock;
+  unsigned char *data;
+  size_t elem_size;
+  size_t capacity;
+  size_t head;
+  size_t len;
+} mutex_queue;
+
+static void *mutex_create(size_t capacity, size_t elem_size) {
+  mutex_queue *q = malloc(sizeof(mutex_queue));
+  assert(q != NULL);
+  check(mtx_init(&q->lock, mtx_plain) == thrd_success, "mtx_init");
+  q->data = malloc(capacity * elem_size);
+  assert(q->data != NULL);
+  q->elem_size = elem_size;
+  q->capacity = capacity;
+  q->head = 0;
+  q->len = 0;
+  return q;
+}
+
+static void mutex_destroy(void *p) {
+  mutex_queue *q = p;
+  mtx_destroy(&q->lock);
+  free(q->data);
+  free(q);
+}
+
+static size_t mutex_push_some(void *p, const void *elems, size_t n) {
+  mutex_queue *q = p;
+  mtx_lock(&q->lock);
+  if (n > q->capacity - q->len) {
+    n = q->capacity - q->len;
+  }
+  size_t tail = (q->head + q->len) % q->capacity;
+  size_t first = n < q->capacity - tail ? n : q->capacity - tail;
+  memcpy(&q->data[tail * q->elem_size], elems, first * q->elem_size);
+  memcpy(q->data, (const unsigned char *)elems + first * q->elem_size,
+         (n - first) * q->elem_size);
+  q->len += n;
+  mtx_unlock(&q->lock);
+  return n;
+}
+
+static size_t mutex_pop_some(void *p, void *elems, size_t n) {
+  mutex_queue *q = p;
+  mtx_lock(&q->lock);
+  if (n > q->len) {
+    n = q->len;
+  }
+  size_t first = n < q->capacity - q->head ? n : q->capacity - q->head;
+  memcpy(elems, &q->data[q->head * q->elem_size], first * q->elem_size);
+  memcpy((unsigned char *)elems + first * q->elem_size, q->data,
+         (n - first) * q->elem_size);
+  q->head = (q->head + n) % q->capacity;
+  q->len -= n;
+  mtx_unlock(&q->lock);
+  return n;
+}
+
+#define RING_IMPL(NAME, ELEM, SINGLE_PRODUCER, SINGLE_CONSUMER, PREFIX)        \
+  {NAME,                                                                       \
+   sizeof(ELEM),                                                               \
+   SINGLE_PRODUCER,                                                            \
+   SINGLE_CONSUMER,                                                            \
+   PREFIX##_create,                                                            \
+   PREFIX##_destroy,                                                           \
+   PREFIX##_push_some,                                                         \
+   PREFIX##_pop_some}
+
+#define RING_IMPLS(ELEM)                                                       \
+  RING_IMPL("srb", ELEM, 0, 0, srb_##ELEM),                                    \
+      RING_IMPL("srb_mpsc", ELEM, 0, 1, mpsc_##ELEM),                          \
+      RING_IMPL("srb_spsc", ELEM, 1, 1, spsc_##ELEM),                          \
+      RING_IMPL("srb_slots", ELEM, 0, 0, slots_##ELEM),                        \
+      RING_IMPL("srb_sharded", ELEM, 0, 1, sharded_##ELEM),                    \
+      RING_IMPL("mutex", ELEM, 0, 0, mutex)
+
+static const impl impls[] = {
+    RING_IMPLS(elem8),
+    RING_IMPLS(elem64),
+    RING_IMPLS(elem256),
+};
+
+static const size_t producer_counts[] = {1, 2, 4};
+static const size_t consumer_counts[] = {1, 2, 4};
+static const size_t batch_sizes[] = {1, 16, 64};
+static const size_t capacities[] = {64, 1024, 16384};
+
+#define LEN(array) (sizeof(array) / sizeof(*(array)))
+#define MAX_BATCH 64
+#define MAX_ELEM_SIZE sizeof(elem256)
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else  // CLOCK_MONOTONIC
+  timespec_get(&ts, TIME_UTC);
+#endif // CLOCK_MONOTONIC
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Pins the calling thread to a CPU, so that the scheduler moving
+ * threads around doesn't end up in the numbers.
+ */
+static void pin(size_t cpu) {
+#ifdef __linux__
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % (size_t)(cpus > 0 ? cpus : 1), &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else  // __linux__
+  (void)cpu;
+#endif // __linux__
+}
+
+typedef struct {
+  const impl *impl;
+  void *q;
+  size_t batch;
+  size_t to_push;
+  size_t cpu;
+  atomic_size_t *popped;
+  size_t total;
+  atomic_int *go;
+} worker;
+
+static int producer(void *arg) {
+  worker *w = arg;
+  unsigned char elems[MAX_BATCH * MAX_ELEM_SIZE] = {0};
+  pin(w->cpu);
+  while (!atomic_load(w->go)) {
+    thrd_yield();
+  }
+  unsigned spins = 0;
+  for (size_t pushed = 0; pushed < w->to_push;) {
+    size_t n = w->batch < w->to_push - pushed ? w->batch : w->to_push - pushed;
+    size_t done = w->impl->push_some(w->q, elems, n);
+    if (done == 0) {
+      srb_backoff(&spins);
+      continue;
+    }
+    spins = 0;
+    pushed += done;
+  }
+  return 0;
+}
+
+static int consumer(void *arg) {
+  worker *w = arg;
+  unsigned char elems[MAX_BATCH * MAX_ELEM_SIZE];
+  pin(w->cpu);
+  while (!atomic_load(w->go)) {
+    thrd_yield();
+  }
+  unsigned spins = 0;
+  while (atomic_load_explicit(w->popped, memory_order_relaxed) < w->total) {
+    size_t done = w->impl->pop_some(w->q, elems, w->batch);
+    if (done == 0) {
+      srb_backoff(&spins);
+      continue;
+    }
+    spins = 0;
+    atomic_fetch_add_explicit(w->popped, done, memory_order_relaxed);
+  }
+  return 0;
+}
+
+typedef struct {
+  const char *kind;
+  const char *impl;
+  size_t producers, consumers, batch, elem_size, capacity;
+  size_t ops;
+  double seconds;
+  double p50_ns, p99_ns, p999_ns;
+} result;
+
+static double throughput(const impl *im, size_t producers, size_t consumers,
+                         size_t batch, size_t capacity, size_t total) {
+  void *q = im->create(capacity, im->elem_size);
+  atomic_size_t popped;
+  atomic_int go;
+  atomic_init(&popped, 0);
+  atomic_init(&go, 0);
+  size_t threads = producers + consumers;
+  worker *workers = malloc(sizeof(worker) * threads);
+  thrd_t *ids = malloc(sizeof(thrd_t) * threads);
+  assert(workers != NULL && ids != NULL);
+
+  for (size_t i = 0; i < threads; i++) {
+    workers[i] = (worker){im, q, batch, 0, i, &popped, total, &go};
+    if (i < producers) {
+      // Spread any remainder over the first few producers
+      workers[i].to_push = total / producers + (i < total % producers);
+    }
+    thrd_start_t f = i < producers ? producer : consumer;
+    check(thrd_create(&ids[i], f, &workers[i]) == thrd_success, "thrd_create");
+  }
+  uint64_t start = now_ns();
+  atomic_store(&go, 1);
+  for (size_t i = 0; i < threads; i++) {
+    thrd_join(ids[i], NULL);
+  }
+  double seconds = (double)(now_ns() - start) * 1e-9;
+
+  free(ids);
+  free(workers);
+  im->destroy(q);
+  return seconds;
+}
+
+typedef struct {
+  const impl *impl;
+  void *there, *back;
+  size_t samples;
+  uint64_t *rtt;
+} pingpong;
+
+static void send_one(const impl *im, void *q, const void *elem) {
+  unsigned spins = 0;
+  while (im->push_some(q, elem, 1) == 0) {
+    srb_backoff(&spins);
+  }
+}
+
+static void receive_one(const impl *im, void *q, void *elem) {
+  unsigned spins = 0;
+  while (im->pop_some(q, elem, 1) == 0) {
+    srb_backoff(&spins);
+  }
+}
+
+static int pong(void *arg) {
+  pingpong *p = arg;
+  unsigned char elem[MAX_ELEM_SIZE];
+  pin(1);
+  for (size_t i = 0; i < p->samples; i++) {
+    receive_one(p->impl, p->there, elem);
+    send_one(p->impl, p->back, elem);
+  }
+  return 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(const uint64_t *sorted, size_t n, double p) {
+  return (double)sorted[(size_t)(p * (double)(n - 1))];
+}
+
+static result latency(const impl *im, size_t capacity, size_t samples) {
+  pingpong p = {im, im->create(capacity, im->elem_size),
+                im->create(capacity, im->elem_size), samples,
+                malloc(sizeof(uint64_t) * samples)};
+  assert(p.rtt != NULL);
+  unsigned char elem[MAX_ELEM_SIZE] = {0};
+  thrd_t t;
+  pin(0);
+  check(thrd_create(&t, pong, &p) == thrd_success, "thrd_create");
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < samples; i++) {
+    uint64_t sent = now_ns();
+    send_one(im, p.there, elem);
+    receive_one(im, p.back, elem);
+    p.rtt[i] = now_ns() - sent;
+  }
+  double seconds = (double)(now_ns() - start) * 1e-9;
+  thrd_join(t, NULL);
+
+  qsort(p.rtt, samples, sizeof(uint64_t), compare_u64);
+  result r = {.kind = "latency",
+              .impl = im->name,
+              .producers = 1,
+              .consumers = 1,
+              .batch = 1,
+              .elem_size = im->elem_size,
+              .capacity = capacity,
+              .ops = samples,
+              .seconds = seconds,
+              .p50_ns = percentile(p.rtt, samples, 0.5),
+              .p99_ns = percentile(p.rtt, samples, 0.99),
+              .p999_ns = percentile(p.rtt, samples, 0.999)};
+  free(p.rtt);
+  im->destroy(p.there);
+  im->destroy(p.back);
+  return r;
+}
+
+static int json;
+static int first_row = 1;
+
+static void print_result(result r) {
+  double ops_per_sec = (double)r.ops / r.seconds;
+  double bytes_per_sec = ops_per_sec * (double)r.elem_size;
+  if (json) {
+    printf("%s\n  {\"kind\": \"%s\", \"impl\": \"%s\", \"producers\": %zu, "
+           "\"consumers\": %zu, \"batch\": %zu, \"elem_size\": %zu, "
+           "\"capacity\": %zu, \"ops\": %zu, \"seconds\": %f, "
+           "\"ops_per_sec\": %f, \"bytes_per_sec\": %f",
+           first_row ? "[" : ",", r.kind, r.impl, r.producers, r.consumers,
+           r.batch, r.elem_size, r.capacity, r.ops, r.seconds, ops_per_sec,
+           bytes_per_sec);
+    if (r.p50_ns > 0) {
+      printf(", \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f",
+             r.p50_ns, r.p99_ns, r.p999_ns);
+    }
+    printf("}");
+  } else {
+    if (first_row) {
+      printf("kind,impl,producers,consumers,batch,elem_size,capacity,ops,"
+             "seconds,ops_per_sec,bytes_per_sec,p50_ns,p99_ns,p999_ns\n");
+    }
+    printf("%s,%s,%zu,%zu,%zu,%zu,%zu,%zu,%f,%f,%f,", r.kind, r.impl,
+           r.producers, r.consumers, r.batch, r.elem_size, r.capacity, r.ops,
+           r.seconds, ops_per_sec, bytes_per_sec);
+    if (r.p50_ns > 0) {
+      printf("%.0f,%.0f,%.0f\n", r.p50_ns, r.p99_ns, r.p999_ns);
+    } else {
+      printf(",,\n");
+    }
+  }
+  first_row = 0;
+  fflush(stdout);
+}
+
+long parse_arg(int n, int argc, char **argv, long default_arg) {
+  if (n < 1 || n >= argc) {
+    return default_arg;
+  } else {
+    char *end;
+    return strtol(argv[n], &end, 10);
+  }
+}
+
+int main(int argc, char **argv) {
+  json = argc > 1 && strcmp(argv[1], "json") == 0;
+  size_t total = parse_arg(2, argc, argv, 1000000);
+  size_t samples = parse_arg(3, argc, argv, 100000);
+
+  for (size_t i = 0; i < LEN(impls); i++) {
+    const impl *im = &impls[i];
+    print_result(latency(im, 64, samples));
+
+    for (size_t p = 0; p < LEN(producer_counts); p++) {
+      size_t producers = producer_counts[p];
+      if (im->single_producer && producers > 1) {
+        continue;
+      }
+      for (size_t c = 0; c < LEN(consumer_counts); c++) {
+        size_t consumers = consumer_counts[c];
+        if (im->single_consumer && consumers > 1) {
+          continue;
+        }
+        for (size_t b = 0; b < LEN(batch_sizes); b++) {
+          for (size_t k = 0; k < LEN(capacities); k++) {
+            double seconds = throughput(im, producers, consumers,
+                                        batch_sizes[b], capacities[k], total);
+            // No percentiles: print_result leaves them out when they're 0
+            result r = {.kind = "throughput",
+                        .impl = im->name,
+                        .producers = producers,
+                        .consumers = consumers,
+                        .batch = batch_sizes[b],
+                        .elem_size = im->elem_size,
+                        .capacity = capacities[k],
+                        .ops = total,
+                        .seconds = seconds};
+            print_result(r);
+          }
+        }
+      }
+    }
+  }
+  if (json) {
+    printf("%s]\n", first_row ? "[" : "\n");
+  }
+
+  return 0;
+}
@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -23,6 +24,92 @@
 #endif // __has_attribute(__element_count__)
 #endif // __has_attribute(counted_by)
 
+/* Declarations get this, so a `static` ringbuffer type doesn't warn about
+ * every function that goes unused */
+#if __has_attribute(unused)
+#define srb_maybe_unused __attribute__((unused))
+#else // __has_attribute(unused)
+#define srb_maybe_unused
+#endif // __has_attribute(unused)
+
+/**
+ * @brief Keeps the producer side, the consumer side and the read-only parts of
+ * a ringbuffer on separate cache lines.
+ *
+ * Define `SRB_CACHELINE` to the cache line size (e.g. 64) before including this
+ * header to turn it on. Without it, all the counters share one or two cache
+ * lines, so every push invalidates the line that pops are spinning on, and vice
+ * versa. With it, ringbuffers get bigger and need `SRB_CACHELINE` alignment,
+ * so allocate them with `aligned_alloc` if they live on the heap.
+ */
+#ifdef SRB_CACHELINE
+#define srb_cacheline_aligned _Alignas(SRB_CACHELINE)
+#else // SRB_CACHELINE
+#define srb_cacheline_aligned
+#endif // SRB_CACHELINE
+
+/**
+ * @brief Tells the CPU we're in a spin loop, so it can back off a little and
+ * give the core to a sibling hyperthread.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define srb_pause() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define srb_pause() __asm__ __volatile__("yield")
+#else
+#define srb_pause()
+#endif
+
+/**
+ * @internal
+ * @brief Gives the CPU to another thread.
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#define srb_yield() sched_yield()
+#else
+#include <threads.h>
+#define srb_yield() thrd_yield()
+#endif
+
+/**
+ * @brief How many times a thread waiting for another one to publish pauses
+ * before it starts yielding its CPU instead.
+ */
+#ifndef SRB_BACKOFF
+#define SRB_BACKOFF 64
+#endif // SRB_BACKOFF
+
+/**
+ * @internal
+ * @brief Waits a little, in a loop waiting for another thread to publish.
+ * `*spins` counts the trips around the loop, starting at 0. Pausing is enough
+ * while the other thread is running, but it may have been preempted halfway,
+ * and then only yielding lets it finish, if it shares our CPU.
+ */
+static inline void srb_backoff(unsigned *spins) {
+  if (*spins < SRB_BACKOFF) {
+    (*spins)++;
+    srb_pause();
+  } else {
+    srb_yield();
+  }
+}
+
+/**
+ * @internal
+ * @returns a small number for the calling thread, handed out in the order
+ * threads first ask for one, starting at 1
+ */
+static inline unsigned srb_thread_id(void) {
+  static atomic_uint next;
+  static _Thread_local unsigned id;
+  if (id == 0) {
+    id = atomic_fetch_add_explicit(&next, 1, memory_order_relaxed) + 1;
+  }
+  return id;
+}
+
 /**
  * @internal
  * @see SRB_DECL
@@ -40,18 +127,35 @@
  * @internal
  * @see SRB_DECL
  */
-#define SRB_DECL_type(LINKAGE, TYPE, ELEM_TYPE)                                \
+#define SRB_DECL_type(LINKAGE, TYPE, ELEM_TYPE, STORAGE)                       \
   /**                                                                          \
    * @brief A lock-free ringbuffer                                             \
    */                                                                          \
   typedef struct {                                                             \
     /** @brief Stores all the elements. Also contains the size. */             \
     srb_##ELEM_TYPE##_slice buffer;                                            \
+    srb_mirror_fields                                                          \
+    srb_shm_fields                                                             \
+    srb_mmap_fields                                                            \
+    srb_eventfd_fields                                                         \
+    /* Consumer side */                                                        \
+    srb_cacheline_aligned                                                      \
     /** @brief Index of the next element that can be popped. */                \
     atomic_size_t head_valid;                                                  \
     /** @brief Index of the next element that doesn't have any pending pops.   \
      */                                                                        \
     atomic_size_t head_commit;                                                 \
+    /**                                                                        \
+     * @brief The number of slots without an item or have a reservation for a  \
+     * read.                                                                   \
+     *                                                                         \
+     * If a pop would cause this value to be greater than size, the pop will   \
+     * fail. May be larger than what's indicated by head_commit and            \
+     * tail_valid. Needed to prevent ABA.                                      \
+     */                                                                        \
+    atomic_size_t committed_empty;                                             \
+    /* Producer side */                                                        \
+    srb_cacheline_aligned                                                      \
     /** @brief Index of the next available slot to place an element. */        \
     atomic_size_t tail_valid;                                                  \
     /**                                                                        \
@@ -68,15 +172,9 @@
      * head_valid. Needed to prevent ABA.                                      \
      */                                                                        \
     atomic_size_t committed_filled;                                            \
-    /**                                                                        \
-     * @brief The number of slots without an item or have a reservation for a  \
-     * read.                                                                   \
-     *                                                                         \
-     * If a pop would cause this value to be greater than size, the pop will   \
-     * fail. May be larger than what's indicated by head_commit and            \
-     * tail_valid. Needed to prevent ABA.                                      \
-     */                                                                        \
-    atomic_size_t committed_empty;                                             \
+    srb_waitq_fields                                                           \
+    srb_stats_fields                                                           \
+    STORAGE                                                                    \
   } TYPE
 
 /**
@@ -100,6 +198,16 @@
  * (C): in the process of being written
  * (D): stable empty elements
  *
+ * The claim and finish stages are also exposed directly, for callers that want
+ * to read or write elements in place instead of copying them through a slice:
+ * `TYPE##_try_reserve_push` claims `n` slots and hands back the one or two
+ * contiguous regions of the buffer they cover, and `TYPE##_commit_push`
+ * publishes them once written. `TYPE##_try_reserve_pop` and
+ * `TYPE##_release_pop` do the same for reads. Every successful reservation
+ * must be finished exactly once, with the regions it returned. Reservations
+ * finish in the order they were made, so holding one stalls everyone who
+ * reserved after you.
+ *
  * @param TYPE the type name you wish the newly-generated structure to
 have.
  * @param ELEM_TYPE the type of elements to be stored in the ringbuffer
@@ -107,9 +215,28 @@ have.
  **/
 #define SRB_DECL(LINKAGE, TYPE, ELEM_TYPE)                                     \
   SRB_DECL_slice(LINKAGE, TYPE, ELEM_TYPE);                                    \
-  SRB_DECL_type(LINKAGE, TYPE, ELEM_TYPE);                                     \
+  SRB_DECL_type(LINKAGE, TYPE, ELEM_TYPE, );                                   \
+  SRB_DECL_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @see SRB_DECL
+ */
+#define SRB_DECL_methods(LINKAGE, TYPE, ELEM_TYPE)                             \
   SRB_DECL_push(LINKAGE, TYPE, ELEM_TYPE);                                     \
-  SRB_DECL_pop(LINKAGE, TYPE, ELEM_TYPE);
+  SRB_DECL_pop(LINKAGE, TYPE, ELEM_TYPE);                                      \
+  SRB_DECL_len(LINKAGE, TYPE);                                                 \
+  SRB_DECL_stats(LINKAGE, TYPE)                                                \
+  SRB_DECL_wait(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Declares the slice type `srb_##ELEM_TYPE##_slice`.
+ *
+ * `SRB_DECL` does this for you, the other ringbuffer flavours don't, so that
+ * several of them can share an element type. Use this once per element type
+ * before declaring them.
+ */
+#define SRB_DECL_SLICE(ELEM_TYPE) SRB_DECL_slice(, , ELEM_TYPE)
 
 /**
  * @brief Defines all the methods needed to operate on the ringbuffer `TYPE`, as
@@ -121,8 +248,19 @@ have.
  * @param LINKAGE the linkage specifier for the functions to declare
  */
 #define SRB_DEF(LINKAGE, TYPE, ELEM_TYPE)                                      \
+  SRB_DEF_size(TYPE, s->buffer.size)                                           \
+  SRB_DEF_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @see SRB_DEF
+ */
+#define SRB_DEF_methods(LINKAGE, TYPE, ELEM_TYPE)                              \
   SRB_DEF_push(LINKAGE, TYPE, ELEM_TYPE);                                      \
-  SRB_DEF_pop(LINKAGE, TYPE, ELEM_TYPE);
+  SRB_DEF_pop(LINKAGE, TYPE, ELEM_TYPE);                                       \
+  SRB_DEF_len(LINKAGE, TYPE)                                                   \
+  SRB_DEF_stats(LINKAGE, TYPE)                                                 \
+  SRB_DEF_wait(LINKAGE, TYPE, ELEM_TYPE)
 
 /**
  * @brief Early-returns if a statement is nonzero
@@ -145,263 +283,4248 @@ have.
   do {                                                                         \
     int srb_internal_err = (statement);                                        \
     assert(srb_internal_err == 0);                                             \
+    (void)srb_internal_err;                                                    \
   } while (0)
 
 /**
- * @brief Initializes a `VAR` to be a ringbuffer of `TYPE`, with `N` spaces
+ * @brief Adds `TYPE##_push_wait`, `TYPE##_pop_wait` and friends to every
+ * ringbuffer, which block until they can go through instead of failing.
  *
- * @param TYPE the type of the ringbuffer
- * @param VAR the variable to initialize
- * @param N the amount of spaces to reserve
+ * Define `SRB_BLOCKING` before including this header to turn it on. Waiters
+ * first retry `SRB_SPIN` times, then go to sleep: on a futex on Linux, or on a
+ * C11 condition variable elsewhere or with `SRB_NO_FUTEX`. Every push and pop
+ * then checks whether anyone is asleep on the other side, and only makes a
+ * system call if there is, so it costs a fence and a load when nobody waits.
+ * Ringbuffers need `SRB_FREE` to release the condition variables.
  */
-#define SRB_INIT(VAR, N)                                                       \
-  (VAR).buffer.data = malloc(sizeof(*((VAR).buffer.data)) * N);                \
-  assert((VAR).buffer.data != NULL);                                           \
-  (VAR).buffer.size = N;                                                       \
-  atomic_init(&(VAR).head_valid, 0);                                           \
-  atomic_init(&(VAR).head_commit, 0);                                          \
-  atomic_init(&(VAR).tail_valid, 0);                                           \
-  atomic_init(&(VAR).tail_commit, 0);                                          \
-  atomic_init(&(VAR).committed_filled, 0);                                     \
-  atomic_init(&(VAR).committed_empty, N);
+#ifdef SRB_BLOCKING
+#include <time.h>
+#if defined(__linux__) && !defined(SRB_NO_FUTEX)
+#if defined(__GLIBC__) && !defined(_DEFAULT_SOURCE)
+#error "SRB_BLOCKING needs _DEFAULT_SOURCE for syscall, or SRB_NO_FUTEX"
+#endif // __GLIBC__ && !_DEFAULT_SOURCE
+#define SRB_FUTEX
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+/* Private futexes are cheaper, but only work within one process */
+#ifdef SRB_SHM
+#define srb_futex_private 0
+#else // SRB_SHM
+#define srb_futex_private FUTEX_PRIVATE_FLAG
+#endif // SRB_SHM
+#else // __linux__ && !SRB_NO_FUTEX
+#ifdef SRB_SHM
+#error "SRB_BLOCKING with SRB_SHM needs futexes, which are Linux-only"
+#endif // SRB_SHM
+#include <threads.h>
+#endif // __linux__ && !SRB_NO_FUTEX
+
+#ifndef SRB_SPIN
+#define SRB_SPIN 100
+#endif // SRB_SPIN
 
 /**
- * @brief Frees the internal data for the ringbuffer `VAR`
- *
- * @param VAR the ringbuffer to free
- *
- * TODO: put in more sentinel values to mark it as freed
+ * @brief Somewhere for threads to sleep until the other side of a ringbuffer
+ * makes progress.
  */
-#define SRB_FREE(VAR)                                                          \
-  do {                                                                         \
-    free((VAR).buffer.data);                                                   \
-    (VAR).buffer.data = NULL;                                                  \
-  } while (1 == 0)
+typedef struct {
+  /** @brief Threads between srb_waitq_prepare and srb_waitq_finish. */
+  atomic_uint waiters;
+  /**
+   * @brief Bumped by every wakeup, so that a waiter that missed it doesn't go
+   * to sleep. This is the futex word: the counters themselves are too wide.
+   */
+  atomic_uint seq;
+#ifndef SRB_FUTEX
+  mtx_t lock;
+  cnd_t cond;
+#endif // SRB_FUTEX
+} srb_waitq;
+
+static inline void srb_waitq_init(srb_waitq *q) {
+  atomic_init(&q->waiters, 0);
+  atomic_init(&q->seq, 0);
+#ifndef SRB_FUTEX
+  SRB_UNWRAP(mtx_init(&q->lock, mtx_plain) != thrd_success);
+  SRB_UNWRAP(cnd_init(&q->cond) != thrd_success);
+#endif // SRB_FUTEX
+}
+
+static inline void srb_waitq_destroy(srb_waitq *q) {
+#ifdef SRB_FUTEX
+  (void)q;
+#else  // SRB_FUTEX
+  cnd_destroy(&q->cond);
+  mtx_destroy(&q->lock);
+#endif // SRB_FUTEX
+}
 
 /**
- * @brief returns the number of available slots left to place elements in.
+ * @brief Registers the calling thread as a waiter. Check the ringbuffer after
+ * this, and before srb_waitq_wait, or a wakeup may be lost.
  *
- * size_t srb_remaining(size_t head, size_t tail, size_t size);
+ * @returns the token to pass to srb_waitq_wait
  */
-#define srb_remaining(head, tail, size)                                        \
-  ((((head) > (tail)) ? /* Gap is in the middle of the array.                  \
-                         * 11111100011                                         \
-                         *       t  h                                          \
-                         */                                                    \
-        (head) - (tail)                                                        \
-                      : /* Gaps are at either side of the array.               \
-                         * 00111100000                                         \
-                         *   h   t                                             \
-                         */                                                    \
-        (head) + ((size) - (tail))) -                                          \
-   1)
+static inline unsigned srb_waitq_prepare(srb_waitq *q) {
+  atomic_fetch_add(&q->waiters, 1);
+  /* Pairs with the fence in srb_waitq_notify: either the notifier sees us, or
+   * we see whatever it published before notifying. */
+  atomic_thread_fence(memory_order_seq_cst);
+  return atomic_load(&q->seq);
+}
 
 /**
- * @brief Effectively does `*out = tail + n`, wrapping around on size, and
- * returning an error if it cannot.
+ * @brief Sleeps until there's been a wakeup since `*token` was taken, or until
+ * `deadline` (on the `TIME_UTC` clock, never if NULL) passes. May also return
+ * for no reason, so check the ringbuffer again after.
  *
- * int srb_wrapping_push(size_t *out, size_t head, size_t tail, size_t size,
- * size_t n);
+ * @returns nonzero if the deadline passed
  */
-#define srb_wrapping_push(out, head, tail, size, n)                            \
-  (srb_remaining(head, tail, size) < (n)                                       \
-       ? 1                                                                     \
-       : (/* TODO: wrapping_add */                                             \
-          ((tail) + (n) >= (size) ? (*(out) = (tail) + (n) - (size))           \
-                                  : (*(out) = (tail) + (n))),                  \
-          0))
+static inline int srb_waitq_wait(srb_waitq *q, unsigned *token,
+                                 const struct timespec *deadline) {
+  int timed_out = 0;
+#ifdef SRB_FUTEX
+  /* FUTEX_WAIT takes a relative timeout; the bitset variant with
+   * FUTEX_CLOCK_REALTIME takes an absolute one on TIME_UTC's clock. */
+  int op = FUTEX_WAIT_BITSET | srb_futex_private | FUTEX_CLOCK_REALTIME;
+  long err = syscall(SYS_futex, &q->seq, op, *token, deadline, NULL,
+                     FUTEX_BITSET_MATCH_ANY);
+  timed_out = err != 0 && errno == ETIMEDOUT;
+#else  // SRB_FUTEX
+  /* Never hold the lock while touching the ringbuffer: a push can notify
+   * not_empty while someone holding not_empty's lock notifies not_full. */
+  SRB_UNWRAP(mtx_lock(&q->lock) != thrd_success);
+  while (!timed_out && atomic_load(&q->seq) == *token) {
+    int err = deadline == NULL ? cnd_wait(&q->cond, &q->lock)
+                               : cnd_timedwait(&q->cond, &q->lock, deadline);
+    timed_out = err == thrd_timedout;
+  }
+  mtx_unlock(&q->lock);
+#endif // SRB_FUTEX
+  /* Acquire, so if this sees the next wakeup, the recheck sees what it was
+   * for. */
+  *token = atomic_load(&q->seq);
+  return timed_out;
+}
+
+/**
+ * @brief Unregisters the calling thread as a waiter.
+ */
+static inline void srb_waitq_finish(srb_waitq *q) {
+  atomic_fetch_sub(&q->waiters, 1);
+}
+
+/**
+ * @brief Wakes up everyone waiting on `q`, if there is anyone. Call after
+ * publishing whatever they're waiting for.
+ */
+static inline void srb_waitq_notify(srb_waitq *q) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&q->waiters, memory_order_relaxed) == 0) {
+    return;
+  }
+#ifdef SRB_FUTEX
+  atomic_fetch_add(&q->seq, 1);
+  syscall(SYS_futex, &q->seq, FUTEX_WAKE | srb_futex_private, INT_MAX, NULL,
+          NULL, 0);
+#else  // SRB_FUTEX
+  /* Under the lock, so it can't land between a waiter's check of seq and its
+   * cnd_wait. */
+  mtx_lock(&q->lock);
+  atomic_fetch_add(&q->seq, 1);
+  cnd_broadcast(&q->cond);
+  mtx_unlock(&q->lock);
+#endif // SRB_FUTEX
+}
 
 /**
  * @internal
- * @see SRB_DECL
+ * @brief The fields every ringbuffer gets with `SRB_BLOCKING`.
  */
-#define SRB_DECL_push(LINKAGE, TYPE, ELEM_TYPE)                                \
-  LINKAGE int TYPE##_try_push(TYPE *s, srb_##ELEM_TYPE##_slice v);             \
-  LINKAGE void TYPE##_push(TYPE *s, srb_##ELEM_TYPE##_slice v);                \
-  LINKAGE int TYPE##_try_push_one(TYPE *s, ELEM_TYPE i);                       \
-  LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i);
+#define srb_waitq_fields                                                       \
+  /* Blocking */                                                               \
+  srb_cacheline_aligned                                                        \
+  /** @brief Where pops wait for elements. */                                  \
+  srb_waitq not_empty;                                                         \
+  /** @brief Where pushes wait for space. */                                   \
+  srb_waitq not_full;
+
+#define SRB_INIT_wait(VAR)                                                     \
+  srb_waitq_init(&(VAR).not_empty);                                            \
+  srb_waitq_init(&(VAR).not_full);
+
+#define SRB_FREE_wait(VAR)                                                     \
+  srb_waitq_destroy(&(VAR).not_empty);                                         \
+  srb_waitq_destroy(&(VAR).not_full);
+
+#define srb_notify(q) srb_waitq_notify(q)
 
 /**
  * @internal
- * @see SRB_DEF
+ * @brief Initializes the waits in `SRB_STATIC_INIT`. Futex waits start out as
+ * zeroes, but C11 has no constant initializer for condition variables.
  */
-#define SRB_DEF_push(LINKAGE, TYPE, ELEM_TYPE)                                 \
-  LINKAGE int TYPE##_try_push(TYPE *s, srb_##ELEM_TYPE##_slice v) {            \
-    /* First, reserve space in the single counter. This prevents ABA with the  \
-     * two counters below */                                                   \
-    size_t next_filled;                                                        \
-    size_t filled;                                                             \
-    do {                                                                       \
-      filled = atomic_load(&s->committed_filled);                              \
-      /* TODO: checked add */                                                  \
-      next_filled = filled + v.size;                                           \
-      if (next_filled > s->buffer.size - 1) {                                  \
-        return 1;                                                              \
-      }                                                                        \
-    } while (!atomic_compare_exchange_strong(&s->committed_filled, &filled,    \
-                                             next_filled));                    \
-    size_t next_tail;                                                          \
-    size_t tail;                                                               \
-    do {                                                                       \
-      tail = atomic_load(&s->tail_commit);                                     \
-      size_t head = atomic_load(&s->head_valid);                               \
-      /* This try _should_ be unecessary, since we reserved space above, but   \
-       * always better safe than sorry. */                                     \
-      SRB_TRY(                                                                 \
-          srb_wrapping_push(&next_tail, head, tail, s->buffer.size, v.size));  \
-      /* And even though we reserved space for the push previously, we still   \
-       * have to do compare exchange again, because we could be running        \
-       * concurrently with other pushes */                                     \
-    } while (                                                                  \
-        !atomic_compare_exchange_strong(&s->tail_commit, &tail, next_tail));   \
-                                                                               \
-    SRB_PRINTF("push: v.size %zu s->buffer.size %zu tail %zu next_tail %zu\n", \
-               v.size, s->buffer.size, tail, next_tail);                       \
-                                                                               \
-    /* TODO: checked mul */                                                    \
-    if (tail + v.size <= s->buffer.size) {                                     \
-      memcpy(&s->buffer.data[tail], v.data, v.size * sizeof(ELEM_TYPE));       \
-    } else {                                                                   \
-      size_t before_end = s->buffer.size - tail;                               \
-      memcpy(&s->buffer.data[tail], v.data, before_end * sizeof(ELEM_TYPE));   \
-      memcpy(s->buffer.data, &v.data[before_end],                              \
-             (v.size - before_end) * sizeof(ELEM_TYPE));                       \
-    }                                                                          \
-                                                                               \
-    /* NOTE: This isn't an atomic_add, because of the following scenario:      \
-     * 1. push size 1000 queued (tail_commit = 1000)                           \
-     * 2. push size 1 queued (tail_commit = 1001)                              \
-     * 3. push size 1 completes                                                \
-     * We cannot update tail_valid until the first push also completes, hence  \
-     * why this is a compare_exchange. A bit sad it has to be this way,        \
-     * spinning is not efficient at all, but this is the only way to do things \
-     * without another concurrency control structure.                          \
-     */                                                                        \
-    while (!atomic_compare_exchange_weak(&s->tail_valid, &tail, next_tail))    \
-      ;                                                                        \
-                                                                               \
-    /* Finally, now that the data is written and we've updated tail_valid, we  \
-     * can update the number of empty slots */                                 \
-    atomic_fetch_sub(&s->committed_empty, v.size);                             \
-    return 0;                                                                  \
-  }                                                                            \
-                                                                               \
-  LINKAGE void TYPE##_push(TYPE *s, srb_##ELEM_TYPE##_slice v) {               \
-    SRB_UNWRAP(TYPE##_try_push(s, v));                                         \
-  }                                                                            \
-                                                                               \
-  LINKAGE int TYPE##_try_push_one(TYPE *s, ELEM_TYPE i) {                      \
-    srb_##ELEM_TYPE##_slice out = {&i, 1};                                     \
-    return TYPE##_try_push(s, out);                                            \
-  }                                                                            \
-                                                                               \
-  LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i) {                         \
-    SRB_UNWRAP(TYPE##_try_push_one(s, i));                                     \
-  }
+#ifdef SRB_FUTEX
+#define srb_wait_static_init
+#else // SRB_FUTEX
+#define srb_wait_static_init .not_empty = srb_static_init_needs_futexes,
+#endif // SRB_FUTEX
+#else // SRB_BLOCKING
+#define srb_waitq_fields
+#define srb_wait_static_init
+#define SRB_INIT_wait(VAR)
+#define SRB_FREE_wait(VAR)
+#define srb_notify(q) ((void)0)
+#endif // SRB_BLOCKING
 
 /**
- * @returns the number of elements present in `s`
+ * @brief Counts what every ringbuffer gets up to, for `TYPE##_stats_snapshot`.
  *
- * size_t srb_len(size_t head, size_t tail, size_t size);
+ * Define `SRB_STATS` before including this header to turn it on. The counters
+ * are split into `SRB_STATS_SHARDS` shards, each thread always adding to the
+ * same one, so that threads on different shards don't fight over the counters.
+ * Without it, the counting compiles to nothing.
  */
-#define srb_len(head, tail, size)                                              \
-  (((head) <= (tail)) ? /* Gaps are at either side of the array.               \
-                         * 00111100000                                         \
-                         *   h   t                                             \
-                         */                                                    \
-       ((tail) - (head))                                                       \
-                      : /* Gap is in the middle of the array.                  \
-                         * 11111100011                                         \
-                         *       t  h                                          \
-                         */                                                    \
-       ((tail) + ((size) - (head))))
+#ifdef SRB_STATS
+#ifndef SRB_STATS_SHARDS
+#define SRB_STATS_SHARDS 16
+#endif // SRB_STATS_SHARDS
 
 /**
- * @brief Effectively does `*out = head + n;`, wrapping around on size, and
- * returning an error if it would overflow
+ * @internal
+ * @brief Calls `X` with the name of every counter.
+ */
+#define srb_stats_counters(X)                                                  \
+  X(pushes)                                                                    \
+  X(pops)                                                                      \
+  X(pushed)                                                                    \
+  X(popped)                                                                    \
+  X(push_full)                                                                 \
+  X(pop_empty)                                                                 \
+  X(push_claim_retries)                                                        \
+  X(push_commit_retries)                                                       \
+  X(push_publish_spins)                                                        \
+  X(pop_claim_retries)                                                         \
+  X(pop_commit_retries)                                                        \
+  X(pop_publish_spins)                                                         \
+  X(dropped)
+
+/**
+ * @brief The counters of one ringbuffer, added up over all the shards.
  *
- * int srb_wrapping_pop(size_t *out, size_t head, size_t tail, size_t size,
- * size_t n);
+ * - `pushes`/`pops`: finished reservations, and `pushed`/`popped` the number
+ *   of elements in them
+ * - `push_full`/`pop_empty`: reservations that failed for lack of space or
+ *   elements
+ * - `*_claim_retries`: failed compare-exchanges claiming space, on
+ *   `committed_filled`/`committed_empty`, or `tail_commit` for `SRB_DECL_MPSC`,
+ *   or `head`/`tail` for `SRB_DECL_SLOTS`
+ * - `*_commit_retries`: failed compare-exchanges on `tail_commit`/`head_commit`
+ * - `*_publish_spins`: trips around the loops waiting for earlier reservations
+ *   to publish `tail_valid`/`head_valid`
+ * - `dropped`: elements of a `SRB_DECL_LOSSY` ringbuffer that were overwritten
+ *   before anyone popped them
+ * - `high_water`: the most elements, including reserved ones, ever seen in the
+ *   ringbuffer
  */
-#define srb_wrapping_pop(out, head, tail, size, n)                             \
-  (srb_len(head, tail, size) < (n)                                             \
-       ? 1 /* TODO: wrapping_add */                                            \
-       : (((head) + (n) >= (size) ? (*(out) = (head) + (n) - (size))           \
-                                  : (*(out) = (head) + (n))),                  \
-          0))
+typedef struct {
+#define srb_stats_field(name) uint64_t name;
+  srb_stats_counters(srb_stats_field)
+#undef srb_stats_field
+  uint64_t high_water;
+} srb_stats;
+
+enum {
+#define srb_stats_id(name) srb_stat_##name,
+  srb_stats_counters(srb_stats_id)
+#undef srb_stats_id
+  srb_stat_count
+};
+
+typedef struct {
+  srb_cacheline_aligned _Atomic(uint64_t) counters[srb_stat_count];
+  _Atomic(uint64_t) high_water;
+} srb_stats_shard;
+
+static inline void srb_stats_init(srb_stats_shard *shards) {
+  for (size_t i = 0; i < SRB_STATS_SHARDS; i++) {
+    for (size_t j = 0; j < srb_stat_count; j++) {
+      atomic_init(&shards[i].counters[j], 0);
+    }
+    atomic_init(&shards[i].high_water, 0);
+  }
+}
+
+/**
+ * @returns the shard the calling thread counts in
+ */
+static inline srb_stats_shard *srb_stats_mine(srb_stats_shard *shards) {
+  return &shards[srb_thread_id() % SRB_STATS_SHARDS];
+}
+
+static inline void srb_stats_add(srb_stats_shard *shards, size_t counter,
+                                 uint64_t n) {
+  atomic_fetch_add_explicit(&srb_stats_mine(shards)->counters[counter], n,
+                            memory_order_relaxed);
+}
+
+static inline void srb_stats_max(srb_stats_shard *shards, uint64_t n) {
+  _Atomic(uint64_t) *high_water = &srb_stats_mine(shards)->high_water;
+  uint64_t seen = atomic_load_explicit(high_water, memory_order_relaxed);
+  while (n > seen && !atomic_compare_exchange_weak_explicit(
+                         high_water, &seen, n, memory_order_relaxed,
+                         memory_order_relaxed)) {
+  }
+}
+
+/**
+ * @returns how many of `size` slots are used between the free-running counters
+ * `head` and `tail`, when `head` may be stale, or newer than `tail`
+ */
+static inline uint64_t srb_stats_used(uint64_t head, uint64_t tail,
+                                      size_t size) {
+  uint64_t used = tail - head;
+  return used > size ? (head > tail ? 0 : size) : used;
+}
+
+static inline srb_stats srb_stats_sum(srb_stats_shard *shards) {
+  uint64_t counters[srb_stat_count] = {0};
+  srb_stats out = {0};
+  for (size_t i = 0; i < SRB_STATS_SHARDS; i++) {
+    for (size_t j = 0; j < srb_stat_count; j++) {
+      counters[j] += atomic_load_explicit(&shards[i].counters[j],
+                                          memory_order_relaxed);
+    }
+    uint64_t high_water =
+        atomic_load_explicit(&shards[i].high_water, memory_order_relaxed);
+    out.high_water = high_water > out.high_water ? high_water : out.high_water;
+  }
+#define srb_stats_copy(name) out.name = counters[srb_stat_##name];
+  srb_stats_counters(srb_stats_copy)
+#undef srb_stats_copy
+  return out;
+}
 
 /**
  * @internal
- * @see SRB_DECL
+ * @brief The fields every ringbuffer gets with `SRB_STATS`.
  */
-#define SRB_DECL_pop(LINKAGE, TYPE, ELEM_TYPE)                                 \
-  LINKAGE int TYPE##_try_pop(TYPE *s, srb_##ELEM_TYPE##_slice v);              \
-  LINKAGE void TYPE##_pop(TYPE *s, srb_##ELEM_TYPE##_slice v);                 \
-  LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i);                       \
-  LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s);
+#define srb_stats_fields                                                       \
+  /* Statistics */                                                             \
+  srb_stats_shard stats[SRB_STATS_SHARDS];
+
+#define SRB_INIT_stats(VAR) srb_stats_init((VAR).stats);
 
 /**
  * @internal
- * @see SRB_DEF
+ * @brief Adds `n` to the counter `name` of the ringbuffer `s`.
  */
-#define SRB_DEF_pop(LINKAGE, TYPE, ELEM_TYPE)                                  \
-  LINKAGE int TYPE##_try_pop(TYPE *s, srb_##ELEM_TYPE##_slice v) {             \
-    /* This function heavily mirrors TYPE##_try_pop, see that for explanation  \
-     * of all the atomic operations occurring in here. */                      \
-    size_t next_empty;                                                         \
-    size_t empty;                                                              \
-    do {                                                                       \
-      empty = atomic_load(&s->committed_empty);                                \
-      /* TODO: checked add */                                                  \
-      next_empty = empty + v.size;                                             \
-      if (next_empty > s->buffer.size) {                                       \
-        return 1;                                                              \
-      }                                                                        \
-    } while (!atomic_compare_exchange_strong(&s->committed_empty, &empty,      \
-                                             next_empty));                     \
-    size_t next_head;                                                          \
-    size_t head;                                                               \
-    do {                                                                       \
-      head = atomic_load(&s->head_commit);                                     \
-      size_t tail = atomic_load(&s->tail_valid);                               \
-      SRB_TRY(                                                                 \
-          srb_wrapping_pop(&next_head, head, tail, s->buffer.size, v.size));   \
-    } while (                                                                  \
-        !atomic_compare_exchange_strong(&s->head_commit, &head, next_head));   \
-                                                                               \
-    SRB_PRINTF("pop: v.size %zu s->buffer.size %zu head %zu next_head %zu\n",  \
-               v.size, s->buffer.size, head, next_head);                       \
-                                                                               \
-    /* TODO: checked mul */                                                    \
-    if (head + v.size <= s->buffer.size) {                                     \
-      memcpy(v.data, &s->buffer.data[head], v.size * sizeof(ELEM_TYPE));       \
-    } else {                                                                   \
-      size_t before_end = s->buffer.size - head;                               \
-      memcpy(v.data, &s->buffer.data[head], before_end * sizeof(ELEM_TYPE));   \
-      memcpy(&v.data[before_end], s->buffer.data,                              \
-             (v.size - before_end) * sizeof(ELEM_TYPE));                       \
-    }                                                                          \
-                                                                               \
-    while (!atomic_compare_exchange_weak(&s->head_valid, &head, next_head))    \
-      ;                                                                        \
-                                                                               \
-    atomic_fetch_sub(&s->committed_filled, v.size);                            \
-    return 0;                                                                  \
-  }                                                                            \
-                                                                               \
-  LINKAGE void TYPE##_pop(TYPE *s, srb_##ELEM_TYPE##_slice v) {                \
-    SRB_UNWRAP(TYPE##_try_pop(s, v));                                          \
-  }                                                                            \
-                                                                               \
-  LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i) {                      \
-    srb_##ELEM_TYPE##_slice out = {i, 1};                                      \
-    return TYPE##_try_pop(s, out);                                             \
-  }                                                                            \
-                                                                               \
-  LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s) {                                  \
-    ELEM_TYPE out;                                                             \
-    SRB_UNWRAP(TYPE##_try_pop_one(s, &out));                                   \
-    return out;                                                                \
+#define srb_stat(s, name, n) srb_stats_add((s)->stats, srb_stat_##name, (n))
+
+/**
+ * @internal
+ * @brief Records that the ringbuffer `s` held `n` elements.
+ */
+#define srb_stat_occupancy(s, n) srb_stats_max((s)->stats, (n))
+
+/**
+ * @internal
+ * @brief Declares `TYPE##_stats_snapshot`, shared by all the ringbuffer
+ * flavours.
+ *
+ * The counters are read one at a time while other threads keep going, so they
+ * don't necessarily add up with each other.
+ */
+#define SRB_DECL_stats(LINKAGE, TYPE)                                          \
+  srb_maybe_unused LINKAGE srb_stats TYPE##_stats_snapshot(TYPE *s);
+
+/**
+ * @internal
+ * @see SRB_DECL_stats
+ */
+#define SRB_DEF_stats(LINKAGE, TYPE)                                           \
+  LINKAGE srb_stats TYPE##_stats_snapshot(TYPE *s) {                           \
+    return srb_stats_sum(s->stats);                                            \
+  }
+#else // SRB_STATS
+#define srb_stats_fields
+#define SRB_INIT_stats(VAR)
+#define srb_stat(s, name, n) ((void)0)
+#define srb_stat_occupancy(s, n) ((void)0)
+#define SRB_DECL_stats(LINKAGE, TYPE)
+#define SRB_DEF_stats(LINKAGE, TYPE)
+#endif // SRB_STATS
+
+/**
+ * @brief Lets ringbuffers use their whole capacity, and index it with a mask
+ * instead of wrapping around by hand.
+ *
+ * Define `SRB_POW2` before including this header to turn it on. All the
+ * `SRB_INIT` macros then round the number of spaces up to a power of two, and
+ * the head/tail counters become free-running, so an index is `counter & mask`
+ * and the number of elements is `tail - head`. Since `SIZE_MAX + 1` is a
+ * multiple of the size, that stays right when the counters wrap around.
+ * Without it, the head/tail counters are kept within `[0, size)`, which costs a
+ * branch per update and one slot to tell full from empty.
+ */
+#ifdef SRB_POW2
+/**
+ * @brief returns the number of elements a buffer of `size` slots can hold.
+ *
+ * size_t srb_usable(size_t size);
+ */
+#define srb_usable(size) (size)
+/**
+ * @brief returns the index into the buffer for the head/tail counter `i`.
+ *
+ * size_t srb_index(size_t i, size_t size);
+ */
+#define srb_index(i, size) ((size_t)(i) & ((size) - 1))
+/**
+ * @brief returns the head/tail counter `n` elements past `i`.
+ *
+ * size_t srb_advance(size_t i, size_t n, size_t size);
+ */
+#define srb_advance(i, n, size) ((i) + (n))
+/**
+ * @brief returns the head/tail counter for buffer index `index`, given that it
+ * is less than a lap ahead of the counter `valid`.
+ *
+ * size_t srb_unindex(size_t index, size_t valid, size_t size);
+ */
+#define srb_unindex(index, valid, size)                                        \
+  ((valid) + (((index) - (valid)) & ((size) - 1)))
+/**
+ * @brief returns the index into the buffer for sequence number `seq`.
+ *
+ * size_t srb_slot(srb_seq seq, size_t size);
+ */
+#define srb_slot(seq, size) srb_index(seq, size)
+/**
+ * @brief returns the index into the buffer for sequence number `seq`, given
+ * `lap`, a multiple of `size` that is at most one lap after `seq` and less
+ * than two before it. Without `SRB_POW2`, that saves a division, and with it,
+ * `lap` isn't even evaluated.
+ *
+ * size_t srb_slot_near(srb_seq seq, srb_seq lap, size_t size);
+ */
+#define srb_slot_near(seq, lap, size) ((void)sizeof(lap), srb_index(seq, size))
+/**
+ * @brief whether `srb_slot_near` needs its `lap`, so that it's worth keeping
+ * one up to date.
+ */
+#define srb_tracks_laps 0
+/**
+ * @brief returns the number of slots to allocate for a ringbuffer that was
+ * asked for `n` spaces.
+ *
+ * size_t srb_round_capacity(size_t n);
+ */
+#define srb_round_capacity(n) srb_next_pow2(n)
+/**
+ * @brief returns whether a ringbuffer can have exactly `n` slots, as a constant
+ * expression if `n` is one.
+ *
+ * int srb_valid_capacity(size_t n);
+ */
+#define srb_valid_capacity(n) ((n) > 0 && ((n) & ((n) - 1)) == 0)
+#else // SRB_POW2
+#define srb_usable(size) ((size) - 1)
+#define srb_index(i, size) (i)
+#define srb_advance(i, n, size)                                                \
+  ((i) + (n) >= (size) ? (i) + (n) - (size) : (i) + (n))
+#define srb_unindex(index, valid, size) (index)
+#define srb_slot(seq, size) ((size_t)((seq) % (size)))
+#define srb_slot_near(seq, lap, size)                                          \
+  ((seq) < (lap)              ? (size_t)((seq) + (size) - (lap))               \
+   : (seq) - (lap) >= (size) ? (size_t)((seq) - (lap) - (size))                \
+                             : (size_t)((seq) - (lap)))
+#define srb_tracks_laps 1
+#define srb_round_capacity(n) (n)
+#define srb_valid_capacity(n) ((n) > 0)
+#endif // SRB_POW2
+
+/**
+ * @returns the smallest power of two that is at least `n`
+ */
+static inline size_t srb_next_pow2(size_t n) {
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+/**
+ * @internal
+ * @brief returns the index into a buffer of `size` slots for sequence number
+ * `seq`, where `size` is a power of two with or without `SRB_POW2`.
+ *
+ * size_t srb_mask_slot(srb_seq seq, size_t size);
+ */
+#define srb_mask_slot(seq, size) ((size_t)(seq) & ((size) - 1))
+
+/**
+ * @brief Lets ringbuffers map their storage twice, back to back, so that any
+ * run of up to `size` elements is contiguous in memory, wherever it starts.
+ *
+ * Define `SRB_MIRROR` before including this header to turn it on, then
+ * initialize with `SRB_INIT_MIRROR` (or `SRB_INIT_SPSC_MIRROR`,
+ * `SRB_INIT_MPSC_MIRROR`) instead of `SRB_INIT`. Reservations on those never
+ * wrap around: `second` always comes back empty, and copies are one memcpy.
+ * The storage is a `memfd_create` file mapped twice, so it's Linux-only, and
+ * the size is rounded up to a whole number of pages.
+ */
+#ifdef SRB_MIRROR
+#ifndef __linux__
+#error "SRB_MIRROR needs memfd_create, which is Linux-only"
+#endif // __linux__
+#if defined(__GLIBC__) && !defined(_DEFAULT_SOURCE)
+#error "SRB_MIRROR needs _DEFAULT_SOURCE for MAP_ANONYMOUS and syscall"
+#endif // __GLIBC__ && !_DEFAULT_SOURCE
+#include <linux/memfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @returns the number of slots to allocate for a mirrored ringbuffer that was
+ * asked for `n` spaces of `elem_size` bytes: at least `n`, and a whole number
+ * of pages.
+ */
+static inline size_t srb_mirror_capacity(size_t n, size_t elem_size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t a = page, b = elem_size;
+  while (b != 0) {
+    size_t r = a % b;
+    a = b;
+    b = r;
+  }
+  /* The fewest elements that fill whole pages. A power of two, since page is,
+   * so the rounding below keeps SRB_POW2's sizes powers of two. */
+  size_t unit = page / a;
+  n = srb_round_capacity(n);
+  return n < unit ? unit : (n + unit - 1) / unit * unit;
+}
+
+/**
+ * @brief Maps `bytes` of fresh memory twice in a row.
+ *
+ * @returns the start of the first mapping, or NULL on failure
+ */
+static inline void *srb_mirror_alloc(size_t bytes) {
+  int fd = (int)syscall(SYS_memfd_create, "srb", MFD_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  unsigned char *base = MAP_FAILED;
+  if (ftruncate(fd, (off_t)bytes) == 0) {
+    /* Reserve room for both halves first, so nothing else can land in
+     * between, then put the file over each half. */
+    base = mmap(NULL, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if (base != MAP_FAILED &&
+      (mmap(base, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+            0) == MAP_FAILED ||
+       mmap(base + bytes, bytes, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+    munmap(base, 2 * bytes);
+    base = MAP_FAILED;
+  }
+  /* The mappings keep the memory alive */
+  close(fd);
+  return base == MAP_FAILED ? NULL : base;
+}
+
+/**
+ * @internal
+ * @brief The fields every ringbuffer gets with `SRB_MIRROR`.
+ */
+#define srb_mirror_fields                                                      \
+  /** @brief How many elements past buffer.data can be addressed: twice        \
+   * buffer.size if the storage is mirrored, buffer.size otherwise. */         \
+  size_t span;
+
+/**
+ * @internal
+ * @returns how many elements past `s->buffer.data` can be addressed
+ */
+#define srb_span(s) ((s)->span)
+
+#define SRB_INIT_span(VAR) (VAR).span = (VAR).buffer.size;
+#define srb_mirror_static_init(N) .span = (N),
+
+/**
+ * @internal
+ * @brief Gives `VAR` mirrored storage for `N` spaces.
+ */
+#define SRB_INIT_mirror_buffer(VAR, N)                                         \
+  (VAR).buffer.size =                                                          \
+      srb_mirror_capacity(N, sizeof(*((VAR).buffer.data)));                    \
+  (VAR).buffer.data =                                                          \
+      srb_mirror_alloc(sizeof(*((VAR).buffer.data)) * (VAR).buffer.size);      \
+  assert((VAR).buffer.data != NULL);                                           \
+  (VAR).span = 2 * (VAR).buffer.size;                                          \
+  SRB_INIT_offset(VAR)                                                         \
+  SRB_INIT_mapped(VAR)
+
+#define SRB_FREE_buffer(VAR)                                                   \
+  if ((VAR).span != (VAR).buffer.size) {                                       \
+    munmap((VAR).buffer.data,                                                  \
+           2 * sizeof(*((VAR).buffer.data)) * (VAR).buffer.size);              \
+  } else {                                                                     \
+    free((VAR).buffer.data);                                                   \
+  }
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL`, with
+ * at least `N` spaces in mirrored storage.
+ */
+#define SRB_INIT_MIRROR(VAR, N)                                                \
+  SRB_INIT_mirror_buffer(VAR, N)                                               \
+  SRB_INIT_state(VAR)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_SPSC`,
+ * with at least `N` spaces in mirrored storage.
+ */
+#define SRB_INIT_SPSC_MIRROR(VAR, N)                                           \
+  SRB_INIT_mirror_buffer(VAR, N)                                               \
+  SRB_INIT_SPSC_state(VAR)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_MPSC`,
+ * with at least `N` spaces in mirrored storage.
+ */
+#define SRB_INIT_MPSC_MIRROR(VAR, N)                                           \
+  SRB_INIT_mirror_buffer(VAR, N)                                               \
+  SRB_INIT_MPSC_state(VAR)
+#else // SRB_MIRROR
+#define srb_mirror_fields
+#define srb_span(s) ((s)->buffer.size)
+#define SRB_INIT_span(VAR)
+#define srb_mirror_static_init(N)
+#define SRB_FREE_buffer(VAR) free((VAR).buffer.data);
+#endif // SRB_MIRROR
+
+/**
+ * @brief Lets ringbuffers live in a named shared memory segment, so that
+ * several processes can push and pop on them.
+ *
+ * Define `SRB_SHM` before including this header to turn it on. One process
+ * creates the segment with `SRB_INIT_SHM` (or `SRB_INIT_SPSC_SHM`,
+ * `SRB_INIT_MPSC_SHM`), others open it with `SRB_ATTACH_SHM` (or
+ * `SRB_ATTACH_SPSC_SHM`, `SRB_ATTACH_MPSC_SHM`), and they all call the same
+ * functions on it. The segment starts with an `srb_shm_header`, which
+ * attaching checks against its own idea of the ringbuffer, followed by the
+ * ringbuffer and then its storage.
+ *
+ * Since every process maps the segment somewhere else, ringbuffers find their
+ * storage at an offset from themselves rather than through `buffer.data`, which
+ * is only meaningful in the process that set it. That goes for every
+ * ringbuffer with `SRB_SHM`, so none of them can be moved once initialized.
+ * With `SRB_BLOCKING`, waiters sleep on shared rather than private futexes.
+ */
+#ifdef SRB_SHM
+#if defined(__GLIBC__) && !defined(_XOPEN_SOURCE) &&                           \
+    (!defined(_POSIX_C_SOURCE) || _POSIX_C_SOURCE < 200809L)
+#error "SRB_SHM needs _POSIX_C_SOURCE >= 200809L or _DEFAULT_SOURCE"
+#endif // __GLIBC__ && _POSIX_C_SOURCE < 200809L
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Another process can't use a lock that lives in our address space */
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_POINTER_LOCK_FREE == 2,
+               "SRB_SHM needs lock-free 64-bit atomics");
+
+#define SRB_SHM_MAGIC UINT64_C(0x316d68735f627273) /* "srb_shm1" */
+#define SRB_SHM_VERSION 3
+
+/**
+ * @brief Which kind of ringbuffer a shared memory segment holds, so that one
+ * kind isn't attached as another that happens to be the same size.
+ */
+enum {
+  SRB_SHM_RING = 1,
+  SRB_SHM_SPSC,
+  SRB_SHM_MPSC,
+};
+
+/**
+ * @brief The start of every shared memory segment.
+ */
+typedef struct {
+  /** @brief Always `SRB_SHM_MAGIC`, once the ringbuffer is ready to use. */
+  _Atomic(uint64_t) magic;
+  /** @brief `SRB_SHM_VERSION` of whoever created the segment. */
+  uint32_t version;
+  /** @brief `sizeof` the ringbuffer, and of its elements. */
+  uint32_t ring_size;
+  uint64_t elem_size;
+  /** @brief The number of slots. */
+  uint64_t size;
+  /** @brief The size of the whole segment. */
+  uint64_t length;
+  /** @brief `SRB_SHM_RING`, `SRB_SHM_SPSC` or `SRB_SHM_MPSC`. */
+  uint32_t flavour;
+} srb_shm_header;
+
+/**
+ * @internal
+ * @brief Where the ringbuffer goes in the segment. Its storage follows it, at
+ * `srb_shm_data_offset`.
+ */
+#define SRB_SHM_RING_OFFSET 64
+_Static_assert(sizeof(srb_shm_header) <= SRB_SHM_RING_OFFSET,
+               "srb_shm_header doesn't fit");
+
+static inline size_t srb_shm_data_offset(size_t ring_size) {
+  return (SRB_SHM_RING_OFFSET + ring_size + 63) / 64 * 64;
+}
+
+/**
+ * @internal
+ * @brief Creates and maps the segment `name`, with room for a ringbuffer of
+ * kind `flavour`, `ring_size` bytes and `size` elements of `elem_size` bytes.
+ *
+ * @returns where the ringbuffer goes, or NULL if the segment couldn't be
+ * created, including if it exists already
+ */
+static inline void *srb_shm_create(const char *name, uint32_t flavour,
+                                   size_t ring_size, size_t elem_size,
+                                   size_t size) {
+  size_t length = srb_shm_data_offset(ring_size) + elem_size * size;
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return NULL;
+  }
+  unsigned char *base = MAP_FAILED;
+  if (ftruncate(fd, (off_t)length) == 0) {
+    base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name);
+    return NULL;
+  }
+  /* The magic stays zero until srb_shm_ready, so nobody attaches to a
+   * half-built ringbuffer. */
+  srb_shm_header *header = (srb_shm_header *)base;
+  header->version = SRB_SHM_VERSION;
+  header->ring_size = (uint32_t)ring_size;
+  header->elem_size = elem_size;
+  header->size = size;
+  header->length = length;
+  header->flavour = flavour;
+  return base + SRB_SHM_RING_OFFSET;
+}
+
+/**
+ * @internal
+ * @brief Publishes the ringbuffer `ring`, made by srb_shm_create, to attachers.
+ */
+static inline void srb_shm_ready(void *ring) {
+  srb_shm_header *header =
+      (srb_shm_header *)((unsigned char *)ring - SRB_SHM_RING_OFFSET);
+  /* Pairs with the acquire in srb_shm_attach */
+  atomic_store_explicit(&header->magic, SRB_SHM_MAGIC, memory_order_release);
+}
+
+/**
+ * @internal
+ * @brief Maps the segment `name`, if it holds a ready ringbuffer of kind
+ * `flavour` and `ring_size` bytes, with elements of `elem_size` bytes.
+ *
+ * @returns the ringbuffer, or NULL
+ */
+static inline void *srb_shm_attach(const char *name, uint32_t flavour,
+                                   size_t ring_size, size_t elem_size) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  unsigned char *base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(srb_shm_header)) {
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+  srb_shm_header *header = (srb_shm_header *)base;
+  if (atomic_load_explicit(&header->magic, memory_order_acquire) !=
+          SRB_SHM_MAGIC ||
+      header->version != SRB_SHM_VERSION || header->flavour != flavour ||
+      header->ring_size != ring_size ||
+      header->elem_size != elem_size || header->length != (size_t)st.st_size ||
+      header->length <
+          srb_shm_data_offset(ring_size) + elem_size * header->size) {
+    munmap(base, (size_t)st.st_size);
+    return NULL;
+  }
+  return base + SRB_SHM_RING_OFFSET;
+}
+
+/**
+ * @brief Unmaps the shared memory segment holding the ringbuffer `ring`. The
+ * segment itself stays around until `shm_unlink`ed.
+ */
+static inline void srb_shm_detach(void *ring) {
+  srb_shm_header *header =
+      (srb_shm_header *)((unsigned char *)ring - SRB_SHM_RING_OFFSET);
+  munmap(header, header->length);
+}
+
+/**
+ * @internal
+ * @brief The fields every ringbuffer gets with `SRB_SHM`.
+ */
+#define srb_shm_fields                                                         \
+  /** @brief Where the storage is, in bytes from the start of the ringbuffer.  \
+   */                                                                          \
+  ptrdiff_t data_offset;
+
+/**
+ * @internal
+ * @returns the storage of the ringbuffer `s`
+ */
+#define srb_data(s, ELEM_TYPE)                                                 \
+  ((ELEM_TYPE *)((unsigned char *)(s) + (s)->data_offset))
+
+#define SRB_INIT_offset(VAR)                                                   \
+  (VAR).data_offset =                                                          \
+      (ptrdiff_t)((uintptr_t)(VAR).buffer.data - (uintptr_t)(void *)&(VAR));
+
+#define srb_shm_static_init(TYPE) .data_offset = offsetof(TYPE, storage),
+
+/**
+ * @internal
+ * @brief Creates the segment `NAME` with a ringbuffer of kind `FLAVOUR` and at
+ * least `N` spaces, sets `PTR` to it and initializes it with `STATE`, or sets
+ * `PTR` to NULL.
+ */
+#define SRB_INIT_shm(PTR, NAME, N, STATE, FLAVOUR)                             \
+  (PTR) = srb_shm_create(NAME, FLAVOUR, sizeof(*(PTR)),                        \
+                         sizeof(*(PTR)->buffer.data), srb_round_capacity(N));  \
+  if ((PTR) != NULL) {                                                         \
+    (PTR)->buffer.size = srb_round_capacity(N);                                \
+    (PTR)->buffer.data = NULL;                                                 \
+    (PTR)->data_offset =                                                       \
+        (ptrdiff_t)(srb_shm_data_offset(sizeof(*(PTR))) -                      \
+                    SRB_SHM_RING_OFFSET);                                      \
+    SRB_INIT_span(*(PTR))                                                      \
+    STATE(*(PTR))                                                              \
+    srb_shm_ready(PTR);                                                        \
+  }
+
+/**
+ * @brief Creates the shared memory segment `NAME` (see `shm_open`) with a
+ * ringbuffer declared by `SRB_DECL` in it, with `N` spaces, and points `PTR`
+ * at it. `PTR` is NULL if that didn't work, e.g. because `NAME` exists.
+ *
+ * @param PTR a pointer to the ringbuffer type
+ */
+#define SRB_INIT_SHM(PTR, NAME, N)                                             \
+  SRB_INIT_shm(PTR, NAME, N, SRB_INIT_state, SRB_SHM_RING)
+
+/**
+ * @brief Like `SRB_INIT_SHM`, for a ringbuffer declared by `SRB_DECL_SPSC`.
+ */
+#define SRB_INIT_SPSC_SHM(PTR, NAME, N)                                        \
+  SRB_INIT_shm(PTR, NAME, N, SRB_INIT_SPSC_state, SRB_SHM_SPSC)
+
+/**
+ * @brief Like `SRB_INIT_SHM`, for a ringbuffer declared by `SRB_DECL_MPSC`.
+ */
+#define SRB_INIT_MPSC_SHM(PTR, NAME, N)                                        \
+  SRB_INIT_shm(PTR, NAME, N, SRB_INIT_MPSC_state, SRB_SHM_MPSC)
+
+/**
+ * @internal
+ * @brief Points `PTR` at the ringbuffer of kind `FLAVOUR` in the segment
+ * `NAME`, or sets it to NULL.
+ */
+#define SRB_ATTACH_shm(PTR, NAME, FLAVOUR)                                     \
+  (PTR) = srb_shm_attach(NAME, FLAVOUR, sizeof(*(PTR)),                        \
+                         sizeof(*(PTR)->buffer.data))
+
+/**
+ * @brief Points `PTR` at the ringbuffer in the shared memory segment `NAME`,
+ * made by another process with `SRB_INIT_SHM`. `PTR` is NULL if there's no such
+ * segment, or it doesn't hold a ringbuffer of `PTR`'s type.
+ *
+ * Unmap it with `SRB_DETACH_SHM` when done, instead of `SRB_FREE`.
+ */
+#define SRB_ATTACH_SHM(PTR, NAME) SRB_ATTACH_shm(PTR, NAME, SRB_SHM_RING)
+
+/**
+ * @brief Like `SRB_ATTACH_SHM`, for a ringbuffer made by `SRB_INIT_SPSC_SHM`.
+ */
+#define SRB_ATTACH_SPSC_SHM(PTR, NAME) SRB_ATTACH_shm(PTR, NAME, SRB_SHM_SPSC)
+
+/**
+ * @brief Like `SRB_ATTACH_SHM`, for a ringbuffer made by `SRB_INIT_MPSC_SHM`.
+ */
+#define SRB_ATTACH_MPSC_SHM(PTR, NAME) SRB_ATTACH_shm(PTR, NAME, SRB_SHM_MPSC)
+
+/**
+ * @brief Unmaps the ringbuffer `PTR`, from `SRB_INIT_SHM`, `SRB_ATTACH_SHM` or
+ * friends.
+ */
+#define SRB_DETACH_SHM(PTR) srb_shm_detach(PTR)
+#else // SRB_SHM
+#define srb_shm_fields
+#define srb_data(s, ELEM_TYPE) ((s)->buffer.data)
+#define SRB_INIT_offset(VAR)
+#define srb_shm_static_init(TYPE)
+#endif // SRB_SHM
+
+/**
+ * @brief Adds `SRB_INIT_EX`, which can put the storage of a ringbuffer on huge
+ * pages, bind it to a NUMA node, and fault it in up front.
+ *
+ * Define `SRB_MMAP` before including this header to turn it on (Linux only).
+ * Storage from `SRB_INIT_EX` is `mmap`ed, so it's always page-aligned, and
+ * `SRB_FREE` unmaps it. NUMA binding goes straight to the `mbind` system call,
+ * so there's no need for libnuma.
+ */
+#ifdef SRB_MMAP
+#ifndef __linux__
+#error "SRB_MMAP needs mbind and madvise, which are Linux-only"
+#endif // __linux__
+#if defined(__GLIBC__) && !defined(_DEFAULT_SOURCE)
+#error "SRB_MMAP needs _DEFAULT_SOURCE for MAP_HUGETLB, madvise and syscall"
+#endif // __GLIBC__ && !_DEFAULT_SOURCE
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief The huge page size that `SRB_ALLOC_HUGETLB` and `SRB_ALLOC_THP` round
+ * and align the storage to.
+ */
+#ifndef SRB_HUGEPAGE_SIZE
+#define SRB_HUGEPAGE_SIZE ((size_t)2 << 20)
+#endif // SRB_HUGEPAGE_SIZE
+
+/** @brief `MPOL_BIND` from `<numaif.h>`. */
+#define SRB_MPOL_BIND 2
+
+/**
+ * @brief What `SRB_INIT_EX` should do with the storage.
+ */
+enum {
+  /**
+   * @brief Use pages from the hugetlbfs pool (`MAP_HUGETLB`). If there aren't
+   * enough reserved, falls back to `SRB_ALLOC_THP` if that's set too, then to
+   * ordinary pages.
+   */
+  SRB_ALLOC_HUGETLB = 1,
+  /** @brief Align to a huge page and ask for transparent huge pages. */
+  SRB_ALLOC_THP = 2,
+  /** @brief Only take memory from NUMA node `srb_alloc_opts.node`. */
+  SRB_ALLOC_NODE = 4,
+  /** @brief Touch every page now, rather than on the first push. */
+  SRB_ALLOC_PREFAULT = 8,
+};
+
+/**
+ * @brief Options for `SRB_INIT_EX`.
+ */
+typedef struct {
+  /** @brief Any of the `SRB_ALLOC_*` flags. */
+  unsigned flags;
+  /** @brief The node to bind to with `SRB_ALLOC_NODE`. */
+  int node;
+} srb_alloc_opts;
+
+/**
+ * @internal
+ * @brief Maps `length` bytes, aligned to `align` bytes, a multiple of the page
+ * size.
+ */
+static inline void *srb_mmap_aligned(size_t length, size_t align) {
+  unsigned char *raw = mmap(NULL, length + align, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  /* Trim off whatever sticks out on either side */
+  size_t lead = (align - (uintptr_t)raw % align) % align;
+  if (lead > 0) {
+    munmap(raw, lead);
+  }
+  munmap(raw + lead + length, align - lead);
+  return raw + lead;
+}
+
+/**
+ * @brief Maps at least `bytes` bytes as `opts` says.
+ *
+ * @param[out] mapped how many bytes were mapped, for `munmap`
+ * @returns the start of the mapping, or NULL on failure, including if it
+ * couldn't be bound to the node
+ */
+static inline void *srb_alloc_ex(size_t bytes, srb_alloc_opts opts,
+                                 size_t *mapped) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t huge = (bytes + SRB_HUGEPAGE_SIZE - 1) / SRB_HUGEPAGE_SIZE *
+                SRB_HUGEPAGE_SIZE;
+  size_t length = huge;
+  void *p = MAP_FAILED;
+  if (opts.flags & SRB_ALLOC_HUGETLB) {
+    p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+  if (p == MAP_FAILED && (opts.flags & SRB_ALLOC_THP)) {
+    p = srb_mmap_aligned(length, SRB_HUGEPAGE_SIZE);
+    /* Only advice: THP may well be turned off */
+    if (p != MAP_FAILED) {
+      madvise(p, length, MADV_HUGEPAGE);
+    }
+  }
+  if (p == MAP_FAILED) {
+    length = (bytes + page - 1) / page * page;
+    p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  if (opts.flags & SRB_ALLOC_NODE) {
+    /* Nothing's been faulted in yet, so there's nothing to move */
+    unsigned long mask[16] = {0};
+    size_t bits = sizeof(unsigned long) * CHAR_BIT;
+    size_t node = (size_t)opts.node;
+    int bound = 0;
+    if (opts.node >= 0 && node < sizeof(mask) * CHAR_BIT) {
+      mask[node / bits] = 1UL << (node % bits);
+      bound = syscall(SYS_mbind, p, length, SRB_MPOL_BIND, mask,
+                      sizeof(mask) * CHAR_BIT + 1, 0) == 0;
+    }
+    if (!bound) {
+      munmap(p, length);
+      return NULL;
+    }
+  }
+  if (opts.flags & SRB_ALLOC_PREFAULT) {
+    for (size_t i = 0; i < length; i += page) {
+      ((volatile unsigned char *)p)[i] = 0;
+    }
+  }
+  *mapped = length;
+  return p;
+}
+
+/**
+ * @internal
+ * @brief The fields every ringbuffer gets with `SRB_MMAP`.
+ */
+#define srb_mmap_fields                                                        \
+  /** @brief How many bytes of storage `SRB_INIT_EX` mapped, or 0 if it came   \
+   * from elsewhere. */                                                        \
+  size_t mapped;
+
+#define SRB_INIT_mapped(VAR) (VAR).mapped = 0;
+
+/**
+ * @internal
+ * @brief Unmaps the storage of `VAR` if it came from `SRB_INIT_EX`, otherwise
+ * goes on to the statement after it.
+ */
+#define SRB_FREE_mapped(VAR)                                                   \
+  if ((VAR).mapped != 0) {                                                     \
+    munmap((VAR).buffer.data, (VAR).mapped);                                   \
+  } else
+
+/**
+ * @internal
+ * @brief Gives `VAR` storage for `N` spaces as `OPTS` says.
+ */
+#define SRB_INIT_ex_buffer(VAR, N, OPTS)                                       \
+  (VAR).buffer.size = srb_round_capacity(N);                                   \
+  (VAR).buffer.data =                                                          \
+      srb_alloc_ex(sizeof(*((VAR).buffer.data)) * (VAR).buffer.size, OPTS,     \
+                   &(VAR).mapped);                                             \
+  assert((VAR).buffer.data != NULL);                                           \
+  SRB_INIT_span(VAR)                                                           \
+  SRB_INIT_offset(VAR)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL`, with
+ * `N` spaces, allocated as the `srb_alloc_opts` `OPTS` say.
+ */
+#define SRB_INIT_EX(VAR, N, OPTS)                                              \
+  SRB_INIT_ex_buffer(VAR, N, OPTS)                                             \
+  SRB_INIT_state(VAR)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_SPSC`,
+ * with `N` spaces, allocated as the `srb_alloc_opts` `OPTS` say.
+ */
+#define SRB_INIT_SPSC_EX(VAR, N, OPTS)                                         \
+  SRB_INIT_ex_buffer(VAR, N, OPTS)                                             \
+  SRB_INIT_SPSC_state(VAR)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_MPSC`,
+ * with `N` spaces, allocated as the `srb_alloc_opts` `OPTS` say.
+ */
+#define SRB_INIT_MPSC_EX(VAR, N, OPTS)                                         \
+  SRB_INIT_ex_buffer(VAR, N, OPTS)                                             \
+  SRB_INIT_MPSC_state(VAR)
+#else // SRB_MMAP
+#define srb_mmap_fields
+#define SRB_INIT_mapped(VAR)
+#define SRB_FREE_mapped(VAR)
+#endif // SRB_MMAP
+
+/**
+ * @brief Lets every ringbuffer signal an eventfd when it stops being empty,
+ * and another when it stops being full, for event loops to wait on with epoll
+ * alongside everything else.
+ *
+ * Define `SRB_EVENTFD` before including this header to turn it on. Rings start
+ * without eventfds, `readable_fd` and `writable_fd` being -1; give a ring its
+ * pair with `SRB_INIT_EVENTFD`. Only the push that makes an empty ring
+ * non-empty writes to `readable_fd`, and only the pop that makes a full ring
+ * non-full writes to `writable_fd`, so a busy ring makes no syscalls at all.
+ *
+ * That means a consumer has to empty the ring every time it wakes up:
+ * `srb_eventfd_clear` the fd first, then pop until a pop fails, and only then
+ * go back to waiting. The same goes for producers and `writable_fd`, which
+ * only says there's room for one element: a producer waiting for room for a
+ * whole batch should push what fits with `TYPE##_try_push_some`.
+ *
+ * The core ringbuffer sees these transitions in the counts of
+ * `committed_empty` and `committed_filled` that it updates anyway. The
+ * SPSC/MPSC ones have no such counts, so each side puts a fence between
+ * publishing its index and checking the other's, which is what makes sure
+ * one of the two sides sees the other.
+ */
+#ifdef SRB_EVENTFD
+#ifndef __linux__
+#error "SRB_EVENTFD is Linux-only"
+#endif
+#ifdef SRB_SHM
+#error "SRB_EVENTFD can't be used with SRB_SHM: fds belong to one process"
+#endif
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/**
+ * @brief Resets the counter of `fd`, one of a ringbuffer's eventfds, so that
+ * it only becomes readable again on the next transition.
+ */
+static inline void srb_eventfd_clear(int fd) {
+  uint64_t count;
+  ssize_t ret = read(fd, &count, sizeof(count));
+  (void)ret; /* EAGAIN just means there was nothing to clear */
+}
+
+/**
+ * @internal
+ * @brief Wakes up whoever's polling `fd`, if it's been attached.
+ */
+static inline void srb_eventfd_signal(int fd) {
+  if (fd < 0) {
+    return;
+  }
+  uint64_t one = 1;
+  ssize_t ret = write(fd, &one, sizeof(one));
+  (void)ret; /* Only fails once it's been signalled 2^64 - 2 times */
+}
+
+/**
+ * @internal
+ * @brief The fields every ringbuffer gets with `SRB_EVENTFD`.
+ */
+#define srb_eventfd_fields                                                     \
+  /** @brief Readable once the ringbuffer stops being empty, or -1. */         \
+  int readable_fd;                                                             \
+  /** @brief Readable once the ringbuffer stops being full, or -1. */          \
+  int writable_fd;
+
+#define SRB_INIT_eventfd(VAR)                                                  \
+  (VAR).readable_fd = -1;                                                      \
+  (VAR).writable_fd = -1;
+
+#define SRB_FREE_eventfd(VAR)                                                  \
+  if ((VAR).readable_fd >= 0) {                                                \
+    close((VAR).readable_fd);                                                  \
+    (VAR).readable_fd = -1;                                                    \
+  }                                                                            \
+  if ((VAR).writable_fd >= 0) {                                                \
+    close((VAR).writable_fd);                                                  \
+    (VAR).writable_fd = -1;                                                    \
+  }
+
+#define srb_eventfd_static_init .readable_fd = -1, .writable_fd = -1,
+
+/**
+ * @internal
+ * @brief Signals `FD` if the counter update `COND` says we made the
+ * transition.
+ */
+#define srb_eventfd_edge(COND, FD)                                             \
+  if (COND) {                                                                  \
+    srb_eventfd_signal(FD);                                                    \
+  }
+
+/**
+ * @internal
+ * @brief Signals `FD` if the other side's index, `OTHER`, is still at `WAS`
+ * after we published ours, i.e. they may have seen us empty (or full) and gone
+ * to sleep.
+ */
+#define srb_eventfd_after_publish(OTHER, WAS, FD)                              \
+  do {                                                                         \
+    if ((FD) >= 0) {                                                           \
+      atomic_thread_fence(memory_order_seq_cst);                               \
+      if (atomic_load_explicit(OTHER, memory_order_relaxed) == (WAS)) {        \
+        srb_eventfd_signal(FD);                                                \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+/**
+ * @internal
+ * @brief The other half of `srb_eventfd_after_publish`, before looking at the
+ * other side's index, if it's going to signal `FD`.
+ */
+#define srb_eventfd_fence(FD)                                                  \
+  if ((FD) >= 0) {                                                             \
+    atomic_thread_fence(memory_order_seq_cst);                                 \
+  }
+
+/**
+ * @brief Gives the ringbuffer `VAR` its eventfds, `VAR.readable_fd` and
+ * `VAR.writable_fd`, which `SRB_FREE` closes. Both start out readable, so the
+ * first wait just goes to check.
+ *
+ * @returns 0 on success, nonzero with errno set if an eventfd couldn't be
+ * created
+ */
+#define SRB_INIT_EVENTFD(VAR)                                                  \
+  srb_eventfd_open(&(VAR).readable_fd, &(VAR).writable_fd)
+
+/**
+ * @internal
+ * @see SRB_INIT_EVENTFD
+ */
+static inline int srb_eventfd_open(int *readable, int *writable) {
+  *readable = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (*readable < 0) {
+    return 1;
+  }
+  *writable = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (*writable < 0) {
+    close(*readable);
+    *readable = -1;
+    return 1;
+  }
+  return 0;
+}
+#else // SRB_EVENTFD
+#define srb_eventfd_fields
+#define SRB_INIT_eventfd(VAR)
+#define SRB_FREE_eventfd(VAR)
+#define srb_eventfd_static_init
+#define srb_eventfd_edge(COND, FD) (void)(COND);
+#define srb_eventfd_after_publish(OTHER, WAS, FD) ((void)0)
+#define srb_eventfd_fence(FD)
+#endif // SRB_EVENTFD
+
+/**
+ * @brief Copies elements into the buffer for `TYPE##_try_push` and friends,
+ * and out of it for `TYPE##_try_pop` and friends, as
+ * `void SRB_COPY_PUSH(void *dst, const void *src, size_t bytes)` and the same
+ * for `SRB_COPY_POP`.
+ *
+ * Define either before including this header to copy your own way. A push
+ * copy's stores must be visible to the release that publishes them, so one
+ * that uses non-temporal stores has to fence them itself. By default both are
+ * `memcpy`, or with `SRB_NT_COPY`, `srb_nt_copy_push`/`srb_nt_copy_pop`.
+ */
+#ifndef SRB_COPY_PUSH
+#ifdef SRB_NT_COPY
+#define SRB_COPY_PUSH(dst, src, bytes) srb_nt_copy_push(dst, src, bytes)
+#else // SRB_NT_COPY
+#define SRB_COPY_PUSH(dst, src, bytes) memcpy(dst, src, bytes)
+#endif // SRB_NT_COPY
+#endif // SRB_COPY_PUSH
+#ifndef SRB_COPY_POP
+#ifdef SRB_NT_COPY
+#define SRB_COPY_POP(dst, src, bytes) srb_nt_copy_pop(dst, src, bytes)
+#else // SRB_NT_COPY
+#define SRB_COPY_POP(dst, src, bytes) memcpy(dst, src, bytes)
+#endif // SRB_NT_COPY
+#endif // SRB_COPY_POP
+
+/**
+ * @brief Copy kernels for large pushes and pops, which keep the producer's
+ * cache for its own data.
+ *
+ * A plain copy into the buffer pulls every line of it into the producer's
+ * cache, though only the consumer will ever read it, and evicts the
+ * producer's working set to make room. Define `SRB_NT_COPY` before including
+ * this header, and pushes of at least `SRB_NT_THRESHOLD` bytes write around
+ * the cache with non-temporal stores instead, while pops that big prefetch
+ * ahead of their copy.
+ *
+ * The streaming kernel is picked on first use: AVX2 or SSE2 on x86 if the CPU
+ * has them, `memcpy` elsewhere. `bench/copy_bench` shows where streaming
+ * starts to pay off on a given machine.
+ */
+#ifdef SRB_NT_COPY
+#ifndef SRB_NT_THRESHOLD
+#define SRB_NT_THRESHOLD 65536
+#endif // SRB_NT_THRESHOLD
+#ifndef SRB_PREFETCH_DISTANCE
+/** @brief How far ahead of its copy a large pop prefetches, in bytes. */
+#define SRB_PREFETCH_DISTANCE 512
+#endif // SRB_PREFETCH_DISTANCE
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SRB_NT_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @internal
+ * @brief A copy kernel. `dst` and `src` don't overlap.
+ */
+typedef void (*srb_copy_kernel)(char *dst, const char *src, size_t bytes);
+
+/**
+ * @internal
+ * @brief The fallback, for CPUs without streaming stores we know of.
+ */
+static void srb_copy_scalar(char *dst, const char *src, size_t bytes) {
+  memcpy(dst, src, bytes);
+}
+
+#ifdef SRB_NT_X86
+/**
+ * @internal
+ * @brief Streams whole 16-byte vectors with SSE2. The unaligned ends are
+ * copied normally.
+ */
+__attribute__((target("sse2"))) static void
+srb_copy_sse2(char *dst, const char *src, size_t bytes) {
+  size_t head = (size_t)(-(uintptr_t)dst & 15);
+  if (head > bytes) {
+    head = bytes;
+  }
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  bytes -= head;
+  for (; bytes >= 64; bytes -= 64, dst += 64, src += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i *)src);
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+    __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+    _mm_stream_si128((__m128i *)dst, a);
+    _mm_stream_si128((__m128i *)(dst + 16), b);
+    _mm_stream_si128((__m128i *)(dst + 32), c);
+    _mm_stream_si128((__m128i *)(dst + 48), d);
+  }
+  for (; bytes >= 16; bytes -= 16, dst += 16, src += 16) {
+    _mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+  }
+  memcpy(dst, src, bytes);
+  /* Streaming stores aren't ordered with the others, so the release that
+   * publishes them wouldn't be either */
+  _mm_sfence();
+}
+
+/**
+ * @internal
+ * @brief Streams whole 32-byte vectors with AVX2. The unaligned ends are
+ * copied normally.
+ */
+__attribute__((target("avx2"))) static void
+srb_copy_avx2(char *dst, const char *src, size_t bytes) {
+  size_t head = (size_t)(-(uintptr_t)dst & 31);
+  if (head > bytes) {
+    head = bytes;
+  }
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  bytes -= head;
+  for (; bytes >= 128; bytes -= 128, dst += 128, src += 128) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)src);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+    __m256i d = _mm256_loadu_si256((const __m256i *)(src + 96));
+    _mm256_stream_si256((__m256i *)dst, a);
+    _mm256_stream_si256((__m256i *)(dst + 32), b);
+    _mm256_stream_si256((__m256i *)(dst + 64), c);
+    _mm256_stream_si256((__m256i *)(dst + 96), d);
+  }
+  for (; bytes >= 32; bytes -= 32, dst += 32, src += 32) {
+    _mm256_stream_si256((__m256i *)dst,
+                        _mm256_loadu_si256((const __m256i *)src));
+  }
+  memcpy(dst, src, bytes);
+  _mm_sfence();
+}
+#endif // SRB_NT_X86
+
+/**
+ * @internal
+ * @returns the best streaming kernel this CPU has
+ */
+static inline srb_copy_kernel srb_copy_select(void) {
+#ifdef SRB_NT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return srb_copy_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return srb_copy_sse2;
+  }
+#endif // SRB_NT_X86
+  return srb_copy_scalar;
+}
+
+/**
+ * @brief Copies `bytes` bytes from `src` to `dst` with non-temporal stores,
+ * whatever the size, and fences them. What `srb_nt_copy_push` does for large
+ * copies.
+ */
+static inline void srb_stream_copy(void *dst, const void *src, size_t bytes) {
+  /* Racing threads all pick the same one, so no harm if they both do */
+  static _Atomic(srb_copy_kernel) kernel;
+  srb_copy_kernel k = atomic_load_explicit(&kernel, memory_order_relaxed);
+  if (k == NULL) {
+    k = srb_copy_select();
+    atomic_store_explicit(&kernel, k, memory_order_relaxed);
+  }
+  k((char *)dst, (const char *)src, bytes);
+}
+
+/**
+ * @brief Copies `bytes` bytes from `src` to `dst`, prefetching
+ * `SRB_PREFETCH_DISTANCE` bytes ahead of the copy, whatever the size. What
+ * `srb_nt_copy_pop` does for large copies.
+ */
+static inline void srb_prefetch_copy(void *dst, const void *src,
+                                     size_t bytes) {
+  char *d = dst;
+  const char *s = src;
+  size_t chunk = SRB_PREFETCH_DISTANCE / 2;
+  while (bytes > chunk) {
+#ifdef __GNUC__
+    __builtin_prefetch(s + SRB_PREFETCH_DISTANCE);
+#endif // __GNUC__
+    memcpy(d, s, chunk);
+    d += chunk;
+    s += chunk;
+    bytes -= chunk;
+  }
+  memcpy(d, s, bytes);
+}
+
+/**
+ * @brief The `SRB_COPY_PUSH` of `SRB_NT_COPY`: streams copies of at least
+ * `SRB_NT_THRESHOLD` bytes, and `memcpy`s smaller ones.
+ */
+static inline void srb_nt_copy_push(void *dst, const void *src, size_t bytes) {
+  if (bytes < SRB_NT_THRESHOLD) {
+    memcpy(dst, src, bytes);
+  } else {
+    srb_stream_copy(dst, src, bytes);
+  }
+}
+
+/**
+ * @brief The `SRB_COPY_POP` of `SRB_NT_COPY`: prefetches ahead of copies of at
+ * least `SRB_NT_THRESHOLD` bytes, and `memcpy`s smaller ones.
+ */
+static inline void srb_nt_copy_pop(void *dst, const void *src, size_t bytes) {
+  if (bytes < SRB_NT_THRESHOLD) {
+    memcpy(dst, src, bytes);
+  } else {
+    srb_prefetch_copy(dst, src, bytes);
+  }
+}
+#endif // SRB_NT_COPY
+
+/**
+ * @internal
+ * @brief Gives `VAR` `malloc`ed storage for `N` spaces.
+ */
+#define SRB_INIT_buffer(VAR, N)                                                \
+  (VAR).buffer.size = srb_round_capacity(N);                                   \
+  (VAR).buffer.data =                                                          \
+      malloc(sizeof(*((VAR).buffer.data)) * (VAR).buffer.size);                \
+  assert((VAR).buffer.data != NULL);                                           \
+  SRB_INIT_span(VAR)                                                           \
+  SRB_INIT_offset(VAR)                                                         \
+  SRB_INIT_mapped(VAR)
+
+/**
+ * @internal
+ * @brief Initializes everything in `VAR` but its storage, which must be set up
+ * already.
+ */
+#define SRB_INIT_state(VAR)                                                    \
+  atomic_init(&(VAR).head_valid, 0);                                           \
+  atomic_init(&(VAR).head_commit, 0);                                          \
+  atomic_init(&(VAR).tail_valid, 0);                                           \
+  atomic_init(&(VAR).tail_commit, 0);                                          \
+  atomic_init(&(VAR).committed_filled, 0);                                     \
+  atomic_init(&(VAR).committed_empty, (VAR).buffer.size);                      \
+  SRB_INIT_wait(VAR)                                                           \
+  SRB_INIT_eventfd(VAR)                                                        \
+  SRB_INIT_stats(VAR)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer of `TYPE`, with `N` spaces
+ *
+ * @param TYPE the type of the ringbuffer
+ * @param VAR the variable to initialize
+ * @param N the amount of spaces to reserve
+ */
+#define SRB_INIT(VAR, N)                                                       \
+  SRB_INIT_buffer(VAR, N)                                                      \
+  SRB_INIT_state(VAR)
+
+/**
+ * @brief Frees the internal data for the ringbuffer `VAR`
+ *
+ * @param VAR the ringbuffer to free
+ *
+ * TODO: put in more sentinel values to mark it as freed
+ */
+#define SRB_FREE(VAR)                                                          \
+  do {                                                                         \
+    SRB_FREE_mapped(VAR) { SRB_FREE_buffer(VAR) }                              \
+    (VAR).buffer.data = NULL;                                                  \
+    SRB_FREE_wait(VAR)                                                         \
+    SRB_FREE_eventfd(VAR)                                                      \
+  } while (1 == 0)
+
+#ifdef SRB_POW2
+#define srb_remaining(head, tail, size) ((size) - ((tail) - (head)))
+#define srb_wrapping_push(out, head, tail, size, n)                            \
+  (srb_remaining(head, tail, size) < (n) ? 1 : (*(out) = (tail) + (n), 0))
+#else // SRB_POW2
+/**
+ * @brief returns the number of available slots left to place elements in.
+ *
+ * size_t srb_remaining(size_t head, size_t tail, size_t size);
+ */
+#define srb_remaining(head, tail, size)                                        \
+  ((((head) > (tail)) ? /* Gap is in the middle of the array.                  \
+                         * 11111100011                                         \
+                         *       t  h                                          \
+                         */                                                    \
+        (head) - (tail)                                                        \
+                      : /* Gaps are at either side of the array.               \
+                         * 00111100000                                         \
+                         *   h   t                                             \
+                         */                                                    \
+        (head) + ((size) - (tail))) -                                          \
+   1)
+
+/**
+ * @brief Effectively does `*out = tail + n`, wrapping around on size, and
+ * returning an error if it cannot.
+ *
+ * int srb_wrapping_push(size_t *out, size_t head, size_t tail, size_t size,
+ * size_t n);
+ */
+#define srb_wrapping_push(out, head, tail, size, n)                            \
+  (srb_remaining(head, tail, size) < (n)                                       \
+       ? 1                                                                     \
+       : (/* TODO: wrapping_add */                                             \
+          ((tail) + (n) >= (size) ? (*(out) = (tail) + (n) - (size))           \
+                                  : (*(out) = (tail) + (n))),                  \
+          0))
+#endif // SRB_POW2
+
+/**
+ * @brief Splits the `n` elements starting at `index` into the part before the
+ * end of `base` and the part that wraps around to its start.
+ *
+ * `length` is how far past `base` can be addressed, see `srb_span`. Mirrored
+ * storage can address twice its size, so it never needs a second part.
+ *
+ * void srb_split(slice *first, slice *second, ELEM_TYPE *base, size_t index,
+ * size_t length, size_t n);
+ */
+#define srb_split(first, second, base, index, length, n)                       \
+  do {                                                                         \
+    (first)->data = &(base)[index];                                            \
+    (first)->size = (index) + (n) <= (length) ? (n) : (length) - (index);      \
+    (second)->data = (base);                                                   \
+    (second)->size = (n) - (first)->size;                                      \
+  } while (0)
+
+/**
+ * @internal
+ * @brief Defines `TYPE##_try_reserve_##OP` and `TYPE##_try_reserve_##OP##_some`
+ * on top of `TYPE##_reserve_##OP##_range`, which every flavour defines as:
+ *
+ * static int TYPE##_reserve_##OP##_range(TYPE *s, size_t min, size_t max,
+ *     srb_##ELEM_TYPE##_slice *first, srb_##ELEM_TYPE##_slice *second);
+ *
+ * reserving as many elements as it can, up to `max`, and failing if that's
+ * fewer than `min`.
+ */
+#define SRB_DEF_reserve_some(LINKAGE, TYPE, ELEM_TYPE, OP)                     \
+  LINKAGE int TYPE##_try_reserve_##OP(TYPE *s, size_t n,                       \
+                                      srb_##ELEM_TYPE##_slice *first,          \
+                                      srb_##ELEM_TYPE##_slice *second) {       \
+    return TYPE##_reserve_##OP##_range(s, n, n, first, second);                \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_reserve_##OP##_some(                                  \
+      TYPE *s, size_t n, srb_##ELEM_TYPE##_slice *first,                       \
+      srb_##ELEM_TYPE##_slice *second) {                                       \
+    return TYPE##_reserve_##OP##_range(s, n > 0 ? 1 : 0, n, first, second);    \
+  }
+
+/**
+ * @internal
+ * @see SRB_DECL
+ */
+#define SRB_DECL_push(LINKAGE, TYPE, ELEM_TYPE)                                \
+  srb_maybe_unused LINKAGE int TYPE##_try_reserve_push(                        \
+      TYPE *s, size_t n, srb_##ELEM_TYPE##_slice *first,                       \
+      srb_##ELEM_TYPE##_slice *second);                                        \
+  srb_maybe_unused LINKAGE int TYPE##_try_reserve_push_some(                   \
+      TYPE *s, size_t n, srb_##ELEM_TYPE##_slice *first,                       \
+      srb_##ELEM_TYPE##_slice *second);                                        \
+  srb_maybe_unused LINKAGE void TYPE##_commit_push(                            \
+      TYPE *s, srb_##ELEM_TYPE##_slice first, srb_##ELEM_TYPE##_slice second); \
+  srb_maybe_unused LINKAGE int TYPE##_try_push(TYPE *s,                        \
+                                               srb_##ELEM_TYPE##_slice v);     \
+  srb_maybe_unused LINKAGE int TYPE##_try_push_some(TYPE *s,                   \
+                                                    srb_##ELEM_TYPE##_slice v, \
+                                                    size_t *n);                \
+  srb_maybe_unused LINKAGE void TYPE##_push(TYPE *s,                           \
+                                            srb_##ELEM_TYPE##_slice v);        \
+  srb_maybe_unused LINKAGE int TYPE##_try_push_one(TYPE *s, ELEM_TYPE i);      \
+  srb_maybe_unused LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i);
+
+/**
+ * @internal
+ * @see SRB_DEF
+ */
+#define SRB_DEF_push(LINKAGE, TYPE, ELEM_TYPE)                                 \
+  static int TYPE##_reserve_push_range(TYPE *s, size_t min, size_t max,        \
+                                       srb_##ELEM_TYPE##_slice *first,         \
+                                       srb_##ELEM_TYPE##_slice *second) {      \
+    /* First, reserve space in the single counter. This prevents ABA with the  \
+     * two counters below */                                                   \
+    size_t n;                                                                  \
+    size_t filled =                                                            \
+        atomic_load_explicit(&s->committed_filled, memory_order_relaxed);      \
+    for (;;) {                                                                 \
+      /* Claims are bounded by this, so filled can't be past it. */            \
+      size_t room = srb_usable(TYPE##_size(s)) - filled;                       \
+      n = max < room ? max : room;                                             \
+      if (n < min) {                                                           \
+        srb_stat(s, push_full, 1);                                             \
+        return 1;                                                              \
+      }                                                                        \
+      /* Acquire pairs with the release in TYPE##_release_pop, so the          \
+       * head_valid that made this room is visible below. */                   \
+      if (atomic_compare_exchange_weak_explicit(                               \
+              &s->committed_filled, &filled, filled + n, memory_order_acquire, \
+              memory_order_relaxed)) {                                         \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, push_claim_retries, 1);                                      \
+    }                                                                          \
+    srb_stat_occupancy(s, filled + n);                                         \
+    size_t next_tail;                                                          \
+    size_t tail;                                                               \
+    size_t head;                                                               \
+    for (;;) {                                                                 \
+      /* tail_commit only hands out slots, it doesn't carry any data */        \
+      tail = atomic_load_explicit(&s->tail_commit, memory_order_relaxed);      \
+      /* Pairs with the release in TYPE##_release_pop, so that the consumers   \
+       * are done reading the slots before we write over them. */              \
+      head = atomic_load_explicit(&s->head_valid, memory_order_acquire);       \
+      /* Since we reserved space above, this check can only fail if head moved \
+       * past the (now stale) tail we loaded, in which case we just try again. \
+       * And even though we reserved space for the push previously, we still   \
+       * have to do compare exchange again, because we could be running        \
+       * concurrently with other pushes. That's in a loop anyway, so a         \
+       * spurious failure of the weak one costs nothing. */                    \
+      if (!srb_wrapping_push(&next_tail, head, tail, TYPE##_size(s), n) &&     \
+          atomic_compare_exchange_weak_explicit(                               \
+              &s->tail_commit, &tail, next_tail, memory_order_relaxed,         \
+              memory_order_relaxed)) {                                         \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, push_commit_retries, 1);                                     \
+    }                                                                          \
+                                                                               \
+    SRB_PRINTF("push: n %zu size %zu tail %zu next_tail %zu\n", n,             \
+               TYPE##_size(s), tail, next_tail);                               \
+                                                                               \
+    srb_split(first, second, srb_data(s, ELEM_TYPE),                           \
+              srb_index(tail, TYPE##_size(s)), srb_span(s), n);                \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_reserve_some(LINKAGE, TYPE, ELEM_TYPE, push)                         \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Finds the free space a push could reserve, without reserving it.   \
+   * Only meaningful if nobody else is pushing.                                \
+   */                                                                          \
+  static inline void TYPE##_peek_push(TYPE *s, srb_##ELEM_TYPE##_slice *first, \
+                                      srb_##ELEM_TYPE##_slice *second) {       \
+    /* committed_filled only goes down once pops are done with their slots, so \
+     * this never takes in space that's still being read. Acquire pairs with   \
+     * the release in TYPE##_release_pop. */                                   \
+    size_t filled =                                                            \
+        atomic_load_explicit(&s->committed_filled, memory_order_acquire);      \
+    size_t tail = atomic_load_explicit(&s->tail_commit, memory_order_relaxed); \
+    size_t n = srb_usable(TYPE##_size(s)) - filled;                            \
+    srb_split(first, second, srb_data(s, ELEM_TYPE),                           \
+              srb_index(tail, TYPE##_size(s)), srb_span(s), n);                \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_commit_push(TYPE *s, srb_##ELEM_TYPE##_slice first,      \
+                                  srb_##ELEM_TYPE##_slice second) {            \
+    size_t n = first.size + second.size;                                       \
+    if (n == 0) {                                                              \
+      /* Empty reservations move nothing, so there's nothing to publish and    \
+       * nobody to wake. */                                                    \
+      return;                                                                  \
+    }                                                                          \
+    size_t index = (size_t)(first.data - srb_data(s, ELEM_TYPE));              \
+    size_t tail;                                                               \
+                                                                               \
+    /* NOTE: This isn't an atomic_add, because of the following scenario:      \
+     * 1. push size 1000 queued (tail_commit = 1000)                           \
+     * 2. push size 1 queued (tail_commit = 1001)                              \
+     * 3. push size 1 completes                                                \
+     * We cannot update tail_valid until the first push also completes, hence  \
+     * why this is a compare_exchange. A bit sad it has to be this way,        \
+     * spinning is not efficient at all, but this is the only way to do things \
+     * without another concurrency control structure.                          \
+     *                                                                         \
+     * A failed compare_exchange overwrites `expected` with the current value  \
+     * of tail_valid, so it has to be reset every time around the loop. With   \
+     * SRB_POW2 the counter isn't wrapped, so which lap our slot is on is      \
+     * worked out from tail_valid, which is less than a lap behind us.         \
+     *                                                                         \
+     * Success releases our writes to the slots, to the acquire in             \
+     * TYPE##_reserve_pop_range. Being a read-modify-write, it also passes on  \
+     * the earlier pushes' releases, so nothing stronger is needed. Until then \
+     * we're only waiting for our turn, which takes no ordering. If that takes \
+     * a while, the push before ours may not be running at all, so back off    \
+     * and let it finish.                                                      \
+     */                                                                        \
+    size_t expected;                                                           \
+    unsigned spins = 0;                                                        \
+    for (;;) {                                                                 \
+      tail = srb_unindex(                                                      \
+          index, atomic_load_explicit(&s->tail_valid, memory_order_relaxed),   \
+          TYPE##_size(s));                                                     \
+      expected = tail;                                                         \
+      size_t next = srb_advance(tail, n, TYPE##_size(s));                      \
+      if (atomic_compare_exchange_weak_explicit(&s->tail_valid, &expected,     \
+                                                next, memory_order_release,    \
+                                                memory_order_relaxed)) {       \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, push_publish_spins, 1);                                      \
+      srb_backoff(&spins);                                                     \
+    }                                                                          \
+    srb_stat(s, pushes, 1);                                                    \
+    srb_stat(s, pushed, n);                                                    \
+                                                                               \
+    /* Finally, now that the data is written and we've updated tail_valid, we  \
+     * can update the number of empty slots. Release, so a pop that claims     \
+     * these elements sees the tail_valid that publishes them. */              \
+    srb_eventfd_edge(atomic_fetch_sub_explicit(&s->committed_empty, n,         \
+                                               memory_order_release) ==        \
+                         TYPE##_size(s),                                       \
+                     s->readable_fd)                                           \
+    srb_notify(&s->not_empty);                                                 \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_push_copy(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @brief Defines the copying wrappers around `TYPE##_try_reserve_push`.
+ *
+ * Shared by every ringbuffer flavour, since they all provide the same
+ * reservation functions.
+ */
+#define SRB_DEF_push_copy(LINKAGE, TYPE, ELEM_TYPE)                            \
+  LINKAGE int TYPE##_try_push(TYPE *s, srb_##ELEM_TYPE##_slice v) {            \
+    srb_##ELEM_TYPE##_slice first, second;                                     \
+    SRB_TRY(TYPE##_try_reserve_push(s, v.size, &first, &second));              \
+    /* TODO: checked mul */                                                    \
+    SRB_COPY_PUSH(first.data, v.data, first.size * sizeof(ELEM_TYPE));         \
+    if (second.size > 0) {                                                     \
+      SRB_COPY_PUSH(second.data, &v.data[first.size],                          \
+                    second.size * sizeof(ELEM_TYPE));                          \
+    }                                                                          \
+    TYPE##_commit_push(s, first, second);                                      \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_push_some(TYPE *s, srb_##ELEM_TYPE##_slice v,         \
+                                   size_t *n) {                                \
+    srb_##ELEM_TYPE##_slice first, second;                                     \
+    *n = 0;                                                                    \
+    SRB_TRY(TYPE##_try_reserve_push_some(s, v.size, &first, &second));         \
+    SRB_COPY_PUSH(first.data, v.data, first.size * sizeof(ELEM_TYPE));         \
+    if (second.size > 0) {                                                     \
+      SRB_COPY_PUSH(second.data, &v.data[first.size],                          \
+                    second.size * sizeof(ELEM_TYPE));                          \
+    }                                                                          \
+    TYPE##_commit_push(s, first, second);                                      \
+    *n = first.size + second.size;                                             \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_push(TYPE *s, srb_##ELEM_TYPE##_slice v) {               \
+    SRB_UNWRAP(TYPE##_try_push(s, v));                                         \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_push_one(TYPE *s, ELEM_TYPE i) {                      \
+    srb_##ELEM_TYPE##_slice out = {&i, 1};                                     \
+    return TYPE##_try_push(s, out);                                            \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i) {                         \
+    SRB_UNWRAP(TYPE##_try_push_one(s, i));                                     \
+  }
+
+#ifdef SRB_POW2
+#define srb_used(head, tail, size) ((tail) - (head))
+#define srb_wrapping_pop(out, head, tail, size, n)                             \
+  (srb_used(head, tail, size) < (n) ? 1 : (*(out) = (head) + (n), 0))
+#else // SRB_POW2
+/**
+ * @returns the number of elements present in `s`
+ *
+ * size_t srb_used(size_t head, size_t tail, size_t size);
+ */
+#define srb_used(head, tail, size)                                             \
+  (((head) <= (tail)) ? /* Gaps are at either side of the array.               \
+                         * 00111100000                                         \
+                         *   h   t                                             \
+                         */                                                    \
+       ((tail) - (head))                                                       \
+                      : /* Gap is in the middle of the array.                  \
+                         * 11111100011                                         \
+                         *       t  h                                          \
+                         */                                                    \
+       ((tail) + ((size) - (head))))
+
+/**
+ * @brief Effectively does `*out = head + n;`, wrapping around on size, and
+ * returning an error if it would overflow
+ *
+ * int srb_wrapping_pop(size_t *out, size_t head, size_t tail, size_t size,
+ * size_t n);
+ */
+#define srb_wrapping_pop(out, head, tail, size, n)                             \
+  (srb_used(head, tail, size) < (n)                                            \
+       ? 1 /* TODO: wrapping_add */                                            \
+       : (((head) + (n) >= (size) ? (*(out) = (head) + (n) - (size))           \
+                                  : (*(out) = (head) + (n))),                  \
+          0))
+#endif // SRB_POW2
+
+/**
+ * @internal
+ * @see SRB_DECL
+ */
+#define SRB_DECL_pop(LINKAGE, TYPE, ELEM_TYPE)                                 \
+  srb_maybe_unused LINKAGE int TYPE##_try_reserve_pop(                         \
+      TYPE *s, size_t n, srb_##ELEM_TYPE##_slice *first,                       \
+      srb_##ELEM_TYPE##_slice *second);                                        \
+  srb_maybe_unused LINKAGE int TYPE##_try_reserve_pop_some(                    \
+      TYPE *s, size_t n, srb_##ELEM_TYPE##_slice *first,                       \
+      srb_##ELEM_TYPE##_slice *second);                                        \
+  srb_maybe_unused LINKAGE void TYPE##_release_pop(                            \
+      TYPE *s, srb_##ELEM_TYPE##_slice first, srb_##ELEM_TYPE##_slice second); \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop(TYPE *s,                         \
+                                              srb_##ELEM_TYPE##_slice v);      \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_some(TYPE *s,                    \
+                                                   srb_##ELEM_TYPE##_slice v,  \
+                                                   size_t *n);                 \
+  srb_maybe_unused LINKAGE void TYPE##_pop(TYPE *s,                            \
+                                           srb_##ELEM_TYPE##_slice v);         \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i);      \
+  srb_maybe_unused LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s);
+
+/**
+ * @internal
+ * @see SRB_DEF
+ */
+#define SRB_DEF_pop(LINKAGE, TYPE, ELEM_TYPE)                                  \
+  static int TYPE##_reserve_pop_range(TYPE *s, size_t min, size_t max,         \
+                                      srb_##ELEM_TYPE##_slice *first,          \
+                                      srb_##ELEM_TYPE##_slice *second) {       \
+    /* This function heavily mirrors TYPE##_reserve_push_range, see that for   \
+     * explanation of all the atomic operations occurring in here. */          \
+    size_t n;                                                                  \
+    size_t empty =                                                             \
+        atomic_load_explicit(&s->committed_empty, memory_order_relaxed);       \
+    for (;;) {                                                                 \
+      size_t available = TYPE##_size(s) - empty;                               \
+      n = max < available ? max : available;                                   \
+      if (n < min) {                                                           \
+        srb_stat(s, pop_empty, 1);                                             \
+        return 1;                                                              \
+      }                                                                        \
+      if (atomic_compare_exchange_weak_explicit(                               \
+              &s->committed_empty, &empty, empty + n, memory_order_acquire,    \
+              memory_order_relaxed)) {                                         \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, pop_claim_retries, 1);                                       \
+    }                                                                          \
+    size_t next_head;                                                          \
+    size_t head;                                                               \
+    size_t tail;                                                               \
+    for (;;) {                                                                 \
+      head = atomic_load_explicit(&s->head_commit, memory_order_relaxed);      \
+      /* Pairs with the release in TYPE##_commit_push, so the elements are     \
+       * written before we read them. */                                       \
+      tail = atomic_load_explicit(&s->tail_valid, memory_order_acquire);       \
+      if (!srb_wrapping_pop(&next_head, head, tail, TYPE##_size(s), n) &&      \
+          atomic_compare_exchange_weak_explicit(                               \
+              &s->head_commit, &head, next_head, memory_order_relaxed,         \
+              memory_order_relaxed)) {                                         \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, pop_commit_retries, 1);                                      \
+    }                                                                          \
+                                                                               \
+    SRB_PRINTF("pop: n %zu size %zu head %zu next_head %zu\n", n,              \
+               TYPE##_size(s), head, next_head);                               \
+                                                                               \
+    srb_split(first, second, srb_data(s, ELEM_TYPE),                           \
+              srb_index(head, TYPE##_size(s)), srb_span(s), n);                \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_reserve_some(LINKAGE, TYPE, ELEM_TYPE, pop)                          \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Finds everything a pop could reserve, without reserving it. Only   \
+   * meaningful if nobody else is popping.                                     \
+   */                                                                          \
+  static inline void TYPE##_peek_pop(TYPE *s, srb_##ELEM_TYPE##_slice *first,  \
+                                     srb_##ELEM_TYPE##_slice *second) {        \
+    /* Sized from committed_empty rather than tail_valid, like                 \
+     * TYPE##_peek_push: pushes publish tail_valid before they hand their      \
+     * elements over in committed_empty, so a reservation of what's in between \
+     * would fail. Acquire pairs with the release in TYPE##_commit_push. */    \
+    size_t empty =                                                             \
+        atomic_load_explicit(&s->committed_empty, memory_order_acquire);       \
+    size_t head = atomic_load_explicit(&s->head_commit, memory_order_relaxed); \
+    size_t n = TYPE##_size(s) - empty;                                         \
+    srb_split(first, second, srb_data(s, ELEM_TYPE),                           \
+              srb_index(head, TYPE##_size(s)), srb_span(s), n);                \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_release_pop(TYPE *s, srb_##ELEM_TYPE##_slice first,      \
+                                  srb_##ELEM_TYPE##_slice second) {            \
+    size_t n = first.size + second.size;                                       \
+    if (n == 0) {                                                              \
+      /* Same as TYPE##_commit_push, empty reservations free nothing. */       \
+      return;                                                                  \
+    }                                                                          \
+    size_t index = (size_t)(first.data - srb_data(s, ELEM_TYPE));              \
+    size_t head;                                                               \
+                                                                               \
+    /* Same handoff as TYPE##_commit_push, releasing the slots we're done      \
+     * reading to the acquire in TYPE##_reserve_push_range. */                 \
+    size_t expected;                                                           \
+    unsigned spins = 0;                                                        \
+    for (;;) {                                                                 \
+      head = srb_unindex(                                                      \
+          index, atomic_load_explicit(&s->head_valid, memory_order_relaxed),   \
+          TYPE##_size(s));                                                     \
+      expected = head;                                                         \
+      size_t next = srb_advance(head, n, TYPE##_size(s));                      \
+      if (atomic_compare_exchange_weak_explicit(&s->head_valid, &expected,     \
+                                                next, memory_order_release,    \
+                                                memory_order_relaxed)) {       \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, pop_publish_spins, 1);                                       \
+      srb_backoff(&spins);                                                     \
+    }                                                                          \
+    srb_stat(s, pops, 1);                                                      \
+    srb_stat(s, popped, n);                                                    \
+                                                                               \
+    /* Release, so a push that claims this room sees the head_valid that       \
+     * frees it. */                                                            \
+    srb_eventfd_edge(atomic_fetch_sub_explicit(&s->committed_filled, n,        \
+                                               memory_order_release) ==        \
+                         srb_usable(TYPE##_size(s)),                           \
+                     s->writable_fd)                                           \
+    srb_notify(&s->not_full);                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_pop_copy(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @brief Defines the copying wrappers around `TYPE##_try_reserve_pop`.
+ *
+ * @see SRB_DEF_push_copy
+ */
+#define SRB_DEF_pop_copy(LINKAGE, TYPE, ELEM_TYPE)                             \
+  LINKAGE int TYPE##_try_pop(TYPE *s, srb_##ELEM_TYPE##_slice v) {             \
+    srb_##ELEM_TYPE##_slice first, second;                                     \
+    SRB_TRY(TYPE##_try_reserve_pop(s, v.size, &first, &second));               \
+    /* TODO: checked mul */                                                    \
+    SRB_COPY_POP(v.data, first.data, first.size * sizeof(ELEM_TYPE));          \
+    if (second.size > 0) {                                                     \
+      SRB_COPY_POP(&v.data[first.size], second.data,                           \
+                   second.size * sizeof(ELEM_TYPE));                           \
+    }                                                                          \
+    TYPE##_release_pop(s, first, second);                                      \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_some(TYPE *s, srb_##ELEM_TYPE##_slice v,          \
+                                  size_t *n) {                                 \
+    srb_##ELEM_TYPE##_slice first, second;                                     \
+    *n = 0;                                                                    \
+    SRB_TRY(TYPE##_try_reserve_pop_some(s, v.size, &first, &second));          \
+    SRB_COPY_POP(v.data, first.data, first.size * sizeof(ELEM_TYPE));          \
+    if (second.size > 0) {                                                     \
+      SRB_COPY_POP(&v.data[first.size], second.data,                           \
+                   second.size * sizeof(ELEM_TYPE));                           \
+    }                                                                          \
+    TYPE##_release_pop(s, first, second);                                      \
+    *n = first.size + second.size;                                             \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_pop(TYPE *s, srb_##ELEM_TYPE##_slice v) {                \
+    SRB_UNWRAP(TYPE##_try_pop(s, v));                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i) {                      \
+    srb_##ELEM_TYPE##_slice out = {i, 1};                                      \
+    return TYPE##_try_pop(s, out);                                             \
+  }                                                                            \
+                                                                               \
+  LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s) {                                  \
+    ELEM_TYPE out;                                                             \
+    SRB_UNWRAP(TYPE##_try_pop_one(s, &out));                                   \
+    return out;                                                                \
+  }
+
+/**
+ * @internal
+ * @brief Defines `TYPE##_size`, the number of slots of `s`, which is `SIZE`.
+ * Everything reads the size through it, so for `SRB_DECL_STATIC` ringbuffers
+ * it's a constant the compiler can fold into the index arithmetic.
+ */
+#define SRB_DEF_size(TYPE, SIZE)                                               \
+  static inline size_t TYPE##_size(TYPE *s) {                                  \
+    (void)s;                                                                   \
+    return SIZE;                                                               \
+  }
+
+/**
+ * @internal
+ * @brief Declares `TYPE##_len` and `TYPE##_capacity`, shared by all the
+ * ringbuffer flavours.
+ *
+ * `TYPE##_len` is only a snapshot: by the time it returns, other threads may
+ * have pushed or popped.
+ */
+#define SRB_DECL_len(LINKAGE, TYPE)                                            \
+  srb_maybe_unused LINKAGE size_t TYPE##_len(TYPE *s);                         \
+  srb_maybe_unused LINKAGE size_t TYPE##_capacity(TYPE *s);
+
+/**
+ * @internal
+ * @brief Defines `TYPE##_len` and `TYPE##_capacity` from the published
+ * counters of `SRB_DECL`'s ringbuffer.
+ *
+ * head is read before tail, so a pop racing in between can only make the
+ * answer too big, never wrap it below zero; it gets clamped to the capacity.
+ */
+#define SRB_DEF_len(LINKAGE, TYPE)                                             \
+  LINKAGE size_t TYPE##_len(TYPE *s) {                                         \
+    /* Acquire keeps the load of tail after it */                              \
+    size_t head = atomic_load_explicit(&s->head_valid, memory_order_acquire);  \
+    size_t tail = atomic_load_explicit(&s->tail_valid, memory_order_relaxed);  \
+    size_t len = srb_used(head, tail, TYPE##_size(s));                         \
+    size_t capacity = srb_usable(TYPE##_size(s));                              \
+    return len > capacity ? capacity : len;                                    \
+  }                                                                            \
+                                                                               \
+  LINKAGE size_t TYPE##_capacity(TYPE *s) {                                    \
+    return srb_usable(TYPE##_size(s));                                         \
+  }
+
+#ifdef SRB_BLOCKING
+/**
+ * @internal
+ * @brief Declares the blocking functions, shared by all the ringbuffer
+ * flavours.
+ *
+ * `TYPE##_{push,pop}_until` give up once `deadline` passes, returning nonzero.
+ * It's absolute, on the `TIME_UTC` clock, like `cnd_timedwait`'s. They also
+ * fail straight away if `v` could never fit in the ringbuffer.
+ * `TYPE##_{push,pop}_wait{,_one}` wait for as long as it takes.
+ */
+#define SRB_DECL_wait(LINKAGE, TYPE, ELEM_TYPE)                                \
+  srb_maybe_unused LINKAGE int TYPE##_push_until(                              \
+      TYPE *s, srb_##ELEM_TYPE##_slice v, const struct timespec *deadline);    \
+  srb_maybe_unused LINKAGE void TYPE##_push_wait(TYPE *s,                      \
+                                                 srb_##ELEM_TYPE##_slice v);   \
+  srb_maybe_unused LINKAGE void TYPE##_push_wait_one(TYPE *s, ELEM_TYPE i);    \
+  srb_maybe_unused LINKAGE int TYPE##_pop_until(                               \
+      TYPE *s, srb_##ELEM_TYPE##_slice v, const struct timespec *deadline);    \
+  srb_maybe_unused LINKAGE void TYPE##_pop_wait(TYPE *s,                       \
+                                                srb_##ELEM_TYPE##_slice v);    \
+  srb_maybe_unused LINKAGE ELEM_TYPE TYPE##_pop_wait_one(TYPE *s);
+
+/**
+ * @internal
+ * @brief Defines `TYPE##_OP##_until` and `TYPE##_OP##_wait` on top of
+ * `TYPE##_try_##OP`, sleeping on the waitq `WAITQ`.
+ */
+#define SRB_DEF_wait_op(LINKAGE, TYPE, ELEM_TYPE, OP, WAITQ)                   \
+  LINKAGE int TYPE##_##OP##_until(TYPE *s, srb_##ELEM_TYPE##_slice v,          \
+                                  const struct timespec *deadline) {           \
+    if (v.size > TYPE##_capacity(s)) {                                         \
+      return 1;                                                                \
+    }                                                                          \
+    for (int i = 0; i < SRB_SPIN; i++) {                                       \
+      if (TYPE##_try_##OP(s, v) == 0) {                                        \
+        return 0;                                                              \
+      }                                                                        \
+      srb_pause();                                                             \
+    }                                                                          \
+                                                                               \
+    unsigned token = srb_waitq_prepare(&s->WAITQ);                             \
+    int err;                                                                   \
+    while ((err = TYPE##_try_##OP(s, v)) != 0) {                               \
+      if (srb_waitq_wait(&s->WAITQ, &token, deadline)) {                       \
+        err = TYPE##_try_##OP(s, v);                                           \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+    srb_waitq_finish(&s->WAITQ);                                               \
+    return err;                                                                \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_##OP##_wait(TYPE *s, srb_##ELEM_TYPE##_slice v) {        \
+    SRB_UNWRAP(TYPE##_##OP##_until(s, v, NULL));                               \
+  }
+
+/**
+ * @internal
+ * @see SRB_DECL_wait
+ */
+#define SRB_DEF_wait(LINKAGE, TYPE, ELEM_TYPE)                                 \
+  SRB_DEF_wait_op(LINKAGE, TYPE, ELEM_TYPE, push, not_full)                    \
+                                                                               \
+  LINKAGE void TYPE##_push_wait_one(TYPE *s, ELEM_TYPE i) {                    \
+    srb_##ELEM_TYPE##_slice in = {&i, 1};                                      \
+    TYPE##_push_wait(s, in);                                                   \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_wait_op(LINKAGE, TYPE, ELEM_TYPE, pop, not_empty)                    \
+                                                                               \
+  LINKAGE ELEM_TYPE TYPE##_pop_wait_one(TYPE *s) {                             \
+    ELEM_TYPE out;                                                             \
+    srb_##ELEM_TYPE##_slice v = {&out, 1};                                     \
+    TYPE##_pop_wait(s, v);                                                     \
+    return out;                                                                \
+  }
+#else // SRB_BLOCKING
+#define SRB_DECL_wait(LINKAGE, TYPE, ELEM_TYPE)
+#define SRB_DEF_wait(LINKAGE, TYPE, ELEM_TYPE)
+#endif // SRB_BLOCKING
+
+/**
+ * @brief A free-running element count. At 64 bits it never wraps in practice,
+ * so two of them can be compared and subtracted without any wrapping logic.
+ */
+typedef uint64_t srb_seq;
+typedef _Atomic(uint64_t) srb_atomic_seq;
+
+/**
+ * @internal
+ * @brief Defines `TYPE##_len` and `TYPE##_capacity` for the flavours that
+ * publish free-running `srb_seq` counters in the fields `HEAD` and `TAIL`.
+ * Every slot of those is usable.
+ *
+ * @see SRB_DEF_len
+ */
+#define SRB_DEF_SEQ_len(LINKAGE, TYPE, HEAD, TAIL)                             \
+  LINKAGE size_t TYPE##_len(TYPE *s) {                                         \
+    srb_seq head = atomic_load_explicit(&s->HEAD, memory_order_acquire);       \
+    srb_seq tail = atomic_load_explicit(&s->TAIL, memory_order_acquire);       \
+    srb_seq len = tail - head;                                                 \
+    return len > TYPE##_size(s) ? TYPE##_size(s) : (size_t)len;                \
+  }                                                                            \
+                                                                               \
+  LINKAGE size_t TYPE##_capacity(TYPE *s) { return TYPE##_size(s); }
+
+/**
+ * @internal
+ * @see SRB_DECL_SPSC
+ */
+#define SRB_DECL_SPSC_type(LINKAGE, TYPE, ELEM_TYPE, STORAGE)                  \
+  /**                                                                          \
+   * @brief A wait-free ringbuffer for exactly one producer and one consumer   \
+   */                                                                          \
+  typedef struct {                                                             \
+    /** @brief Stores all the elements. Also contains the size. */             \
+    srb_##ELEM_TYPE##_slice buffer;                                            \
+    srb_mirror_fields                                                          \
+    srb_shm_fields                                                             \
+    srb_mmap_fields                                                            \
+    srb_eventfd_fields                                                         \
+    /* Consumer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Sequence number of the next element to pop. Only written by     \
+     * the consumer. */                                                        \
+    srb_atomic_seq head;                                                       \
+    /** @brief Where head is in the buffer, see `srb_index`. */                \
+    size_t head_index;                                                         \
+    /** @brief The consumer's last look at tail. */                            \
+    srb_seq tail_cache;                                                        \
+    /* Producer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Sequence number of the next slot to push to. Only written by    \
+     * the producer. */                                                        \
+    srb_atomic_seq tail;                                                       \
+    /** @brief Where tail is in the buffer, see `srb_index`. */                \
+    size_t tail_index;                                                         \
+    /** @brief The producer's last look at head. */                            \
+    srb_seq head_cache;                                                        \
+    srb_waitq_fields                                                           \
+    srb_stats_fields                                                           \
+    STORAGE                                                                    \
+  } TYPE
+
+/**
+ * @brief Declares a ringbuffer `TYPE` for exactly one producer thread and one
+ * consumer thread, with the same functions as `SRB_DECL`.
+ *
+ * Each side owns its index outright and publishes it with a plain
+ * store-release, so neither pushes nor pops do any read-modify-write. Each side
+ * also keeps a private copy of the other side's index, and only reloads it when
+ * that copy says the ringbuffer is full/empty. Unlike `SRB_DECL`, the indices
+ * are free-running, so all `N` slots can be used.
+ *
+ * Does not declare `srb_##ELEM_TYPE##_slice`, see `SRB_DECL_SLICE`.
+ *
+ * @param TYPE the type name you wish the newly-generated structure to have.
+ * @param ELEM_TYPE the type of elements to be stored in the ringbuffer
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_SPSC(LINKAGE, TYPE, ELEM_TYPE)                                \
+  SRB_DECL_SPSC_type(LINKAGE, TYPE, ELEM_TYPE, );                              \
+  SRB_DECL_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_SPSC`
+ *
+ * @see SRB_DECL_SPSC
+ */
+#define SRB_DEF_SPSC(LINKAGE, TYPE, ELEM_TYPE)                                 \
+  SRB_DEF_size(TYPE, s->buffer.size)                                           \
+  SRB_DEF_SPSC_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @see SRB_DEF_SPSC
+ */
+#define SRB_DEF_SPSC_methods(LINKAGE, TYPE, ELEM_TYPE)                         \
+  SRB_DEF_SPSC_push(LINKAGE, TYPE, ELEM_TYPE);                                 \
+  SRB_DEF_SPSC_pop(LINKAGE, TYPE, ELEM_TYPE);                                  \
+  SRB_DEF_SEQ_len(LINKAGE, TYPE, head, tail)                                   \
+  SRB_DEF_stats(LINKAGE, TYPE)                                                 \
+  SRB_DEF_wait(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_SPSC`,
+ * with `N` spaces
+ */
+#define SRB_INIT_SPSC(VAR, N)                                                  \
+  SRB_INIT_buffer(VAR, N)                                                      \
+  SRB_INIT_SPSC_state(VAR)
+
+/**
+ * @internal
+ * @see SRB_INIT_state
+ */
+#define SRB_INIT_SPSC_state(VAR)                                               \
+  atomic_init(&(VAR).head, 0);                                                 \
+  (VAR).head_index = 0;                                                        \
+  (VAR).tail_cache = 0;                                                        \
+  atomic_init(&(VAR).tail, 0);                                                 \
+  (VAR).tail_index = 0;                                                        \
+  (VAR).head_cache = 0;                                                        \
+  SRB_INIT_wait(VAR)                                                           \
+  SRB_INIT_eventfd(VAR)                                                        \
+  SRB_INIT_stats(VAR)
+
+/**
+ * @internal
+ * @see SRB_DEF_SPSC
+ */
+#define SRB_DEF_SPSC_push(LINKAGE, TYPE, ELEM_TYPE)                            \
+  static int TYPE##_reserve_push_range(TYPE *s, size_t min, size_t max,        \
+                                       srb_##ELEM_TYPE##_slice *first,         \
+                                       srb_##ELEM_TYPE##_slice *second) {      \
+    /* We're the only one who writes tail, no need to synchronize with it */   \
+    srb_seq tail = atomic_load_explicit(&s->tail, memory_order_relaxed);       \
+    size_t room = TYPE##_size(s) - (size_t)(tail - s->head_cache);             \
+    if (room < max) {                                                          \
+      srb_eventfd_fence(s->writable_fd);                                       \
+      /* Pairs with the release in TYPE##_release_pop, so that the consumer is \
+       * done reading the slots before we write over them. */                  \
+      s->head_cache = atomic_load_explicit(&s->head, memory_order_acquire);    \
+      room = TYPE##_size(s) - (size_t)(tail - s->head_cache);                  \
+      if (room < min) {                                                        \
+        srb_stat(s, push_full, 1);                                             \
+        return 1;                                                              \
+      }                                                                        \
+    }                                                                          \
+    size_t n = max < room ? max : room;                                        \
+    size_t index = srb_index(s->tail_index, TYPE##_size(s));                   \
+    srb_split(first, second, srb_data(s, ELEM_TYPE), index, srb_span(s), n);   \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_reserve_some(LINKAGE, TYPE, ELEM_TYPE, push)                         \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Finds the free space a push could reserve, without reserving it.   \
+   * Push reservations here don't change anything until they're committed, so  \
+   * this is just a reservation that never will be.                            \
+   */                                                                          \
+  static inline void TYPE##_peek_push(TYPE *s, srb_##ELEM_TYPE##_slice *first, \
+                                      srb_##ELEM_TYPE##_slice *second) {       \
+    SRB_UNWRAP(TYPE##_reserve_push_range(s, 0, SIZE_MAX, first, second));      \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_commit_push(TYPE *s, srb_##ELEM_TYPE##_slice first,      \
+                                  srb_##ELEM_TYPE##_slice second) {            \
+    srb_seq tail = atomic_load_explicit(&s->tail, memory_order_relaxed);       \
+    size_t n = first.size + second.size;                                       \
+    if (n == 0) {                                                              \
+      /* Nothing to publish, and nobody to wake. */                            \
+      return;                                                                  \
+    }                                                                          \
+    s->tail_index = srb_advance(s->tail_index, n, TYPE##_size(s));             \
+    atomic_store_explicit(&s->tail, tail + n, memory_order_release);           \
+    srb_eventfd_after_publish(&s->head, tail, s->readable_fd);                 \
+    srb_stat(s, pushes, 1);                                                    \
+    srb_stat(s, pushed, n);                                                    \
+    srb_stat_occupancy(s, srb_stats_used(                                      \
+                              atomic_load_explicit(&s->head,                   \
+                                                   memory_order_relaxed),      \
+                              tail + n, TYPE##_size(s)));                      \
+    srb_notify(&s->not_empty);                                                 \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_push_copy(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @see SRB_DEF_SPSC
+ */
+#define SRB_DEF_SPSC_pop(LINKAGE, TYPE, ELEM_TYPE)                             \
+  static int TYPE##_reserve_pop_range(TYPE *s, size_t min, size_t max,         \
+                                      srb_##ELEM_TYPE##_slice *first,          \
+                                      srb_##ELEM_TYPE##_slice *second) {       \
+    srb_seq head = atomic_load_explicit(&s->head, memory_order_relaxed);       \
+    size_t available = (size_t)(s->tail_cache - head);                         \
+    if (available < max) {                                                     \
+      srb_eventfd_fence(s->readable_fd);                                       \
+      /* Pairs with the release in TYPE##_commit_push, so that the producer's  \
+       * writes to the slots are visible. */                                   \
+      s->tail_cache = atomic_load_explicit(&s->tail, memory_order_acquire);    \
+      available = (size_t)(s->tail_cache - head);                              \
+      if (available < min) {                                                   \
+        srb_stat(s, pop_empty, 1);                                             \
+        return 1;                                                              \
+      }                                                                        \
+    }                                                                          \
+    size_t n = max < available ? max : available;                              \
+    size_t index = srb_index(s->head_index, TYPE##_size(s));                   \
+    srb_split(first, second, srb_data(s, ELEM_TYPE), index, srb_span(s), n);   \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_reserve_some(LINKAGE, TYPE, ELEM_TYPE, pop)                          \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Finds everything a pop could reserve, without reserving it. Pop    \
+   * reservations here don't change anything until they're released, so this   \
+   * is just a reservation that never will be.                                 \
+   */                                                                          \
+  static inline void TYPE##_peek_pop(TYPE *s, srb_##ELEM_TYPE##_slice *first,  \
+                                     srb_##ELEM_TYPE##_slice *second) {        \
+    SRB_UNWRAP(TYPE##_reserve_pop_range(s, 0, SIZE_MAX, first, second));       \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_release_pop(TYPE *s, srb_##ELEM_TYPE##_slice first,      \
+                                  srb_##ELEM_TYPE##_slice second) {            \
+    srb_seq head = atomic_load_explicit(&s->head, memory_order_relaxed);       \
+    size_t n = first.size + second.size;                                       \
+    if (n == 0) {                                                              \
+      /* Nothing to free, and nobody to wake. */                               \
+      return;                                                                  \
+    }                                                                          \
+    s->head_index = srb_advance(s->head_index, n, TYPE##_size(s));             \
+    atomic_store_explicit(&s->head, head + n, memory_order_release);           \
+    srb_eventfd_after_publish(&s->tail, head + TYPE##_size(s),                 \
+                              s->writable_fd);                                 \
+    srb_stat(s, pops, 1);                                                      \
+    srb_stat(s, popped, n);                                                    \
+    srb_notify(&s->not_full);                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_pop_copy(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @see SRB_DECL_MPSC
+ */
+#define SRB_DECL_MPSC_type(LINKAGE, TYPE, ELEM_TYPE, STORAGE)                  \
+  /**                                                                          \
+   * @brief A lock-free ringbuffer for many producers and one consumer         \
+   */                                                                          \
+  typedef struct {                                                             \
+    /** @brief Stores all the elements. Also contains the size. */             \
+    srb_##ELEM_TYPE##_slice buffer;                                            \
+    srb_mirror_fields                                                          \
+    srb_shm_fields                                                             \
+    srb_mmap_fields                                                            \
+    srb_eventfd_fields                                                         \
+    /* Consumer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Sequence number of the next element to pop. Only written by     \
+     * the consumer. */                                                        \
+    srb_atomic_seq head;                                                       \
+    /** @brief Where head is in the buffer, see `srb_index`. */                \
+    size_t head_index;                                                         \
+    /** @brief The consumer's last look at tail_valid. */                      \
+    srb_seq tail_cache;                                                        \
+    /* Producer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Sequence number of the next slot that can be read. */           \
+    srb_atomic_seq tail_valid;                                                 \
+    /** @brief Sequence number of the next slot without a pending push. */     \
+    srb_atomic_seq tail_commit;                                                \
+    /** @brief Sequence number where a lap of the buffer starts, near enough   \
+     * to tail_commit for `srb_slot_near`. Moved along by the push that        \
+     * reaches the end of the buffer. */                                       \
+    srb_atomic_seq tail_lap;                                                   \
+    /** @brief The producers' last look at head. Only ever too small. */       \
+    srb_atomic_seq head_cache;                                                 \
+    srb_waitq_fields                                                           \
+    srb_stats_fields                                                           \
+    STORAGE                                                                    \
+  } TYPE
+
+/**
+ * @brief Declares a ringbuffer `TYPE` for any number of producer threads and
+ * exactly one consumer thread, with the same functions as `SRB_DECL`.
+ *
+ * Producers claim and publish space the same way as `SRB_DECL`, except that
+ * the indices are free-running, so there is no ABA to guard against and the
+ * `committed_filled` step goes away. The consumer side is the same as
+ * `SRB_DECL_SPSC`, with no read-modify-writes at all.
+ *
+ * Does not declare `srb_##ELEM_TYPE##_slice`, see `SRB_DECL_SLICE`.
+ *
+ * @param TYPE the type name you wish the newly-generated structure to have.
+ * @param ELEM_TYPE the type of elements to be stored in the ringbuffer
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_MPSC(LINKAGE, TYPE, ELEM_TYPE)                                \
+  SRB_DECL_MPSC_type(LINKAGE, TYPE, ELEM_TYPE, );                              \
+  SRB_DECL_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_MPSC`
+ *
+ * @see SRB_DECL_MPSC
+ */
+#define SRB_DEF_MPSC(LINKAGE, TYPE, ELEM_TYPE)                                 \
+  SRB_DEF_size(TYPE, s->buffer.size)                                           \
+  SRB_DEF_MPSC_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @see SRB_DEF_MPSC
+ */
+#define SRB_DEF_MPSC_methods(LINKAGE, TYPE, ELEM_TYPE)                         \
+  SRB_DEF_MPSC_push(LINKAGE, TYPE, ELEM_TYPE);                                 \
+  SRB_DEF_MPSC_pop(LINKAGE, TYPE, ELEM_TYPE);                                  \
+  SRB_DEF_SEQ_len(LINKAGE, TYPE, head, tail_valid)                             \
+  SRB_DEF_stats(LINKAGE, TYPE)                                                 \
+  SRB_DEF_wait(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_MPSC`,
+ * with `N` spaces
+ */
+#define SRB_INIT_MPSC(VAR, N)                                                  \
+  SRB_INIT_buffer(VAR, N)                                                      \
+  SRB_INIT_MPSC_state(VAR)
+
+/**
+ * @internal
+ * @see SRB_INIT_state
+ */
+#define SRB_INIT_MPSC_state(VAR)                                               \
+  atomic_init(&(VAR).head, 0);                                                 \
+  (VAR).head_index = 0;                                                        \
+  (VAR).tail_cache = 0;                                                        \
+  atomic_init(&(VAR).tail_valid, 0);                                           \
+  atomic_init(&(VAR).tail_commit, 0);                                          \
+  atomic_init(&(VAR).tail_lap, 0);                                             \
+  atomic_init(&(VAR).head_cache, 0);                                           \
+  SRB_INIT_wait(VAR)                                                           \
+  SRB_INIT_eventfd(VAR)                                                        \
+  SRB_INIT_stats(VAR)
+
+/**
+ * @internal
+ * @see SRB_DEF_MPSC
+ */
+#define SRB_DEF_MPSC_push(LINKAGE, TYPE, ELEM_TYPE)                            \
+  static int TYPE##_reserve_push_range(TYPE *s, size_t min, size_t max,        \
+                                       srb_##ELEM_TYPE##_slice *first,         \
+                                       srb_##ELEM_TYPE##_slice *second) {      \
+    srb_seq tail =                                                             \
+        atomic_load_explicit(&s->tail_commit, memory_order_relaxed);           \
+    size_t n;                                                                  \
+    do {                                                                       \
+      /* head_cache is passed between producers with release/acquire too, so   \
+       * that whoever uses it also sees the consumer finish with its slots. */ \
+      srb_seq head =                                                           \
+          atomic_load_explicit(&s->head_cache, memory_order_acquire);          \
+      /* head_cache can be more than a lap behind, so this has to saturate */  \
+      srb_seq used = tail - head;                                              \
+      size_t room = used < TYPE##_size(s) ? TYPE##_size(s) - used : 0;         \
+      if (room < max) {                                                        \
+        srb_eventfd_fence(s->writable_fd);                                     \
+        /* Pairs with the release in TYPE##_release_pop */                     \
+        head = atomic_load_explicit(&s->head, memory_order_acquire);           \
+        atomic_store_explicit(&s->head_cache, head, memory_order_release);     \
+        used = tail - head;                                                    \
+        room = used < TYPE##_size(s) ? TYPE##_size(s) - used : 0;              \
+        if (room < min) {                                                      \
+          /* Our tail may be older than the head we just loaded, in which      \
+           * case the subtraction above is garbage. Only give up if tail is    \
+           * still current. */                                                 \
+          srb_seq current =                                                    \
+              atomic_load_explicit(&s->tail_commit, memory_order_relaxed);     \
+          if (current == tail) {                                               \
+            srb_stat(s, push_full, 1);                                         \
+            return 1;                                                          \
+          }                                                                    \
+          tail = current;                                                      \
+          continue;                                                            \
+        }                                                                      \
+      }                                                                        \
+      n = max < room ? max : room;                                             \
+      if (atomic_compare_exchange_weak_explicit(                               \
+              &s->tail_commit, &tail, tail + n, memory_order_relaxed,          \
+              memory_order_relaxed)) {                                         \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, push_claim_retries, 1);                                      \
+    } while (1);                                                               \
+                                                                               \
+    /* An empty reservation may have come from a stale head_cache, which says  \
+     * nothing about tail_lap, and it has no slots to find anyway. */          \
+    size_t index = 0;                                                          \
+    if (n > 0) {                                                               \
+      /* Our room came from a head past the end of the lap before ours, so the \
+       * push that reached it has moved tail_lap at least that far. Nobody can \
+       * push a lap past our unpublished slots, so not much further either. */ \
+      index = srb_slot_near(                                                   \
+          tail, atomic_load_explicit(&s->tail_lap, memory_order_relaxed),      \
+          TYPE##_size(s));                                                     \
+      if (srb_tracks_laps && index + n >= TYPE##_size(s)) {                    \
+        /* Release, for TYPE##_commit_push */                                  \
+        atomic_store_explicit(&s->tail_lap, tail - index + TYPE##_size(s),     \
+                              memory_order_release);                           \
+      }                                                                        \
+    }                                                                          \
+    srb_split(first, second, srb_data(s, ELEM_TYPE), index, srb_span(s), n);   \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_reserve_some(LINKAGE, TYPE, ELEM_TYPE, push)                         \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Finds the free space a push could reserve, without reserving it.   \
+   * Only meaningful if nobody else is pushing.                                \
+   */                                                                          \
+  static inline void TYPE##_peek_push(TYPE *s, srb_##ELEM_TYPE##_slice *first, \
+                                      srb_##ELEM_TYPE##_slice *second) {       \
+    srb_seq tail =                                                             \
+        atomic_load_explicit(&s->tail_commit, memory_order_relaxed);           \
+    /* Pairs with the release in TYPE##_release_pop */                         \
+    srb_seq head = atomic_load_explicit(&s->head, memory_order_acquire);       \
+    size_t n = TYPE##_size(s) - (size_t)(tail - head);                         \
+    size_t index = srb_slot_near(                                              \
+        tail, atomic_load_explicit(&s->tail_lap, memory_order_relaxed),        \
+        TYPE##_size(s));                                                       \
+    srb_split(first, second, srb_data(s, ELEM_TYPE), index, srb_span(s), n);   \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_commit_push(TYPE *s, srb_##ELEM_TYPE##_slice first,      \
+                                  srb_##ELEM_TYPE##_slice second) {            \
+    size_t n = first.size + second.size;                                       \
+    if (n == 0) {                                                              \
+      /* Empty reservations don't move tail_commit, so there's nothing to      \
+       * publish. */                                                           \
+      return;                                                                  \
+    }                                                                          \
+    size_t index = (size_t)(first.data - srb_data(s, ELEM_TYPE));              \
+    /* Same ordered handoff as SRB_DEF_push. Everything between tail_valid and \
+     * the end of our reservation is claimed, so that's less than a lap, and   \
+     * it's our turn exactly when tail_valid lands on our first slot. Only     \
+     * the owner of that slot ever writes tail_valid, so a store suffices. */  \
+    srb_seq tail;                                                              \
+    unsigned spins = 0;                                                        \
+    for (;;) {                                                                 \
+      /* Whoever moved tail_lap here had room from a head at most a lap        \
+       * before it, and tail_valid is at least that, so it's near enough. */   \
+      srb_seq lap =                                                            \
+          srb_tracks_laps                                                      \
+              ? atomic_load_explicit(&s->tail_lap, memory_order_acquire)       \
+              : 0;                                                             \
+      /* Acquire, so that the earlier producers' writes are carried along by   \
+       * our release below. */                                                 \
+      tail = atomic_load_explicit(&s->tail_valid, memory_order_acquire);       \
+      if (srb_slot_near(tail, lap, TYPE##_size(s)) == index) {                 \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, push_publish_spins, 1);                                      \
+      srb_backoff(&spins);                                                     \
+    }                                                                          \
+    atomic_store_explicit(&s->tail_valid, tail + n, memory_order_release);     \
+    srb_eventfd_after_publish(&s->head, tail, s->readable_fd);                 \
+    srb_stat(s, pushes, 1);                                                    \
+    srb_stat(s, pushed, n);                                                    \
+    srb_stat_occupancy(s, srb_stats_used(                                      \
+                              atomic_load_explicit(&s->head,                   \
+                                                   memory_order_relaxed),      \
+                              tail + n, TYPE##_size(s)));                      \
+    srb_notify(&s->not_empty);                                                 \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_push_copy(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @see SRB_DEF_MPSC
+ */
+#define SRB_DEF_MPSC_pop(LINKAGE, TYPE, ELEM_TYPE)                             \
+  static int TYPE##_reserve_pop_range(TYPE *s, size_t min, size_t max,         \
+                                      srb_##ELEM_TYPE##_slice *first,          \
+                                      srb_##ELEM_TYPE##_slice *second) {       \
+    srb_seq head = atomic_load_explicit(&s->head, memory_order_relaxed);       \
+    size_t available = (size_t)(s->tail_cache - head);                         \
+    if (available < max) {                                                     \
+      srb_eventfd_fence(s->readable_fd);                                       \
+      /* Pairs with the release in TYPE##_commit_push */                       \
+      s->tail_cache =                                                          \
+          atomic_load_explicit(&s->tail_valid, memory_order_acquire);          \
+      available = (size_t)(s->tail_cache - head);                              \
+      if (available < min) {                                                   \
+        srb_stat(s, pop_empty, 1);                                             \
+        return 1;                                                              \
+      }                                                                        \
+    }                                                                          \
+    size_t n = max < available ? max : available;                              \
+    size_t index = srb_index(s->head_index, TYPE##_size(s));                   \
+    srb_split(first, second, srb_data(s, ELEM_TYPE), index, srb_span(s), n);   \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_reserve_some(LINKAGE, TYPE, ELEM_TYPE, pop)                          \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Finds everything a pop could reserve, without reserving it. Pop    \
+   * reservations here don't change anything until they're released, so this   \
+   * is just a reservation that never will be.                                 \
+   */                                                                          \
+  static inline void TYPE##_peek_pop(TYPE *s, srb_##ELEM_TYPE##_slice *first,  \
+                                     srb_##ELEM_TYPE##_slice *second) {        \
+    SRB_UNWRAP(TYPE##_reserve_pop_range(s, 0, SIZE_MAX, first, second));       \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_release_pop(TYPE *s, srb_##ELEM_TYPE##_slice first,      \
+                                  srb_##ELEM_TYPE##_slice second) {            \
+    srb_seq head = atomic_load_explicit(&s->head, memory_order_relaxed);       \
+    size_t n = first.size + second.size;                                       \
+    if (n == 0) {                                                              \
+      /* Nothing to free, and nobody to wake. */                               \
+      return;                                                                  \
+    }                                                                          \
+    s->head_index = srb_advance(s->head_index, n, TYPE##_size(s));             \
+    atomic_store_explicit(&s->head, head + n, memory_order_release);           \
+    srb_eventfd_after_publish(&s->tail_commit, head + TYPE##_size(s),          \
+                              s->writable_fd);                                 \
+    srb_stat(s, pops, 1);                                                      \
+    srb_stat(s, popped, n);                                                    \
+    srb_notify(&s->not_full);                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_pop_copy(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @brief The storage that `SRB_DECL_STATIC` and friends keep inside the
+ * ringbuffer.
+ */
+#define srb_static_storage(ELEM_TYPE, N)                                       \
+  _Static_assert(srb_valid_capacity(N), "not a valid ringbuffer size");        \
+  /** @brief Where buffer.data points. */                                      \
+  srb_cacheline_aligned ELEM_TYPE storage[N];
+
+/**
+ * @brief Declares a ringbuffer `TYPE` like `SRB_DECL`, with room for exactly
+ * `N` elements inside the structure itself, so it never allocates.
+ *
+ * Initialize it with `SRB_STATIC_INIT`, a constant initializer, so it can live
+ * in static storage or inside another structure with nothing to do at startup.
+ * `N` must be a constant, and with `SRB_POW2`, a power of two. The functions
+ * see it as a constant too, so the compiler can fold it into all the index
+ * arithmetic. There's nothing to free, and since `buffer.data` points into the
+ * ringbuffer itself, it can't be copied or moved.
+ *
+ * @param TYPE the type name you wish the newly-generated structure to have.
+ * @param ELEM_TYPE the type of elements to be stored in the ringbuffer
+ * @param LINKAGE the linkage specifier for the functions to declare
+ * @param N the number of spaces
+ */
+#define SRB_DECL_STATIC(LINKAGE, TYPE, ELEM_TYPE, N)                           \
+  SRB_DECL_slice(LINKAGE, TYPE, ELEM_TYPE);                                    \
+  SRB_DECL_type(LINKAGE, TYPE, ELEM_TYPE, srb_static_storage(ELEM_TYPE, N));   \
+  SRB_DECL_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Like `SRB_DECL_SPSC`, with the storage inside, see `SRB_DECL_STATIC`.
+ */
+#define SRB_DECL_SPSC_STATIC(LINKAGE, TYPE, ELEM_TYPE, N)                      \
+  SRB_DECL_SPSC_type(LINKAGE, TYPE, ELEM_TYPE,                                 \
+                     srb_static_storage(ELEM_TYPE, N));                        \
+  SRB_DECL_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Like `SRB_DECL_MPSC`, with the storage inside, see `SRB_DECL_STATIC`.
+ */
+#define SRB_DECL_MPSC_STATIC(LINKAGE, TYPE, ELEM_TYPE, N)                      \
+  SRB_DECL_MPSC_type(LINKAGE, TYPE, ELEM_TYPE,                                 \
+                     srb_static_storage(ELEM_TYPE, N));                        \
+  SRB_DECL_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @returns the number of spaces of a ringbuffer from `SRB_DECL_STATIC` and
+ * friends, as a constant expression.
+ */
+#define srb_static_size(s) (sizeof((s)->storage) / sizeof(*(s)->storage))
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_STATIC`
+ */
+#define SRB_DEF_STATIC(LINKAGE, TYPE, ELEM_TYPE)                               \
+  SRB_DEF_size(TYPE, srb_static_size(s))                                       \
+  SRB_DEF_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_SPSC_STATIC`
+ */
+#define SRB_DEF_SPSC_STATIC(LINKAGE, TYPE, ELEM_TYPE)                          \
+  SRB_DEF_size(TYPE, srb_static_size(s))                                       \
+  SRB_DEF_SPSC_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_MPSC_STATIC`
+ */
+#define SRB_DEF_MPSC_STATIC(LINKAGE, TYPE, ELEM_TYPE)                          \
+  SRB_DEF_size(TYPE, srb_static_size(s))                                       \
+  SRB_DEF_MPSC_methods(LINKAGE, TYPE, ELEM_TYPE)
+
+/**
+ * @internal
+ * @brief What every static ringbuffer's initializer has in common.
+ */
+#define srb_static_init(TYPE, VAR)                                             \
+  .buffer = {(VAR).storage, srb_static_size(&(VAR))},                          \
+  srb_mirror_static_init(srb_static_size(&(VAR)))                              \
+  srb_shm_static_init(TYPE) srb_wait_static_init srb_eventfd_static_init
+
+/**
+ * @brief A constant initializer for `VAR`, a ringbuffer of `TYPE` declared by
+ * `SRB_DECL_STATIC`, as in `static TYPE VAR = SRB_STATIC_INIT(TYPE, VAR);`.
+ *
+ * With `SRB_BLOCKING`, this needs futexes: condition variables can't be
+ * initialized by a constant.
+ */
+#define SRB_STATIC_INIT(TYPE, VAR)                                             \
+  {srb_static_init(TYPE, VAR).committed_empty = srb_static_size(&(VAR))}
+
+/**
+ * @brief A constant initializer for `VAR`, a ringbuffer of `TYPE` declared by
+ * `SRB_DECL_SPSC_STATIC`, see `SRB_STATIC_INIT`.
+ */
+#define SRB_SPSC_STATIC_INIT(TYPE, VAR) {srb_static_init(TYPE, VAR)}
+
+/**
+ * @brief A constant initializer for `VAR`, a ringbuffer of `TYPE` declared by
+ * `SRB_DECL_MPSC_STATIC`, see `SRB_STATIC_INIT`.
+ */
+#define SRB_MPSC_STATIC_INIT(TYPE, VAR) {srb_static_init(TYPE, VAR)}
+
+/**
+ * @internal
+ * @see SRB_DECL_SLOTS
+ */
+#define SRB_DECL_SLOTS_type(LINKAGE, TYPE, ELEM_TYPE)                          \
+  /**                                                                          \
+   * @brief A slot of a `SRB_DECL_SLOTS` ringbuffer                            \
+   */                                                                          \
+  typedef struct {                                                             \
+    /**                                                                        \
+     * @brief Says who's next to use the slot. A push at sequence number `i`   \
+     * waits for it to be `i`, then sets it to `i + 1`; the pop of that        \
+     * element waits for `i + 1`, then sets it to `i + size`, for the push a   \
+     * lap later.                                                              \
+     */                                                                        \
+    srb_atomic_seq seq;                                                        \
+    ELEM_TYPE value;                                                           \
+  } TYPE##_slot;                                                               \
+                                                                               \
+  /**                                                                          \
+   * @brief A lock-free ringbuffer with a sequence number in every slot        \
+   */                                                                          \
+  typedef struct {                                                             \
+    /** @brief Stores all the slots. Also contains the size. */                \
+    struct {                                                                   \
+      TYPE##_slot *data;                                                       \
+      size_t size;                                                             \
+    } buffer;                                                                  \
+    /* Consumer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Sequence number of the next element to pop. */                  \
+    srb_atomic_seq head;                                                       \
+    /* Producer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Sequence number of the next slot to push to. */                 \
+    srb_atomic_seq tail;                                                       \
+    srb_stats_fields                                                           \
+  } TYPE
+
+/**
+ * @brief Declares a ringbuffer `TYPE` for any number of producer and consumer
+ * threads, which only moves one element at a time.
+ *
+ * `SRB_DECL`'s ringbuffers publish pushes and pops in the order they were
+ * reserved, so a thread that gets descheduled in the middle of one holds up
+ * everyone who reserved after it. Here, every slot carries its own sequence
+ * number instead, saying whether it's ready for a push or a pop, so a push or
+ * pop only has to claim its position with one compare-exchange, and is
+ * published by a store to its own slot. Nobody waits for anyone else to finish.
+ *
+ * In exchange, there are no reservations or slices: only
+ * `TYPE##_{try_,}push_one`, `TYPE##_{try_,}pop_one`, `TYPE##_len` and
+ * `TYPE##_capacity`, and no blocking versions. Initialize with
+ * `SRB_INIT_SLOTS`, free with `SRB_FREE_SLOTS`.
+ *
+ * Positions are never wrapped, since the sequence numbers in the slots need
+ * them to keep counting up, so `SRB_INIT_SLOTS` always rounds `N` up to a
+ * power of two, with or without `SRB_POW2`: then a position's slot is a mask,
+ * not a division. All the slots can be used.
+ *
+ * @param TYPE the type name you wish the newly-generated structure to have.
+ * @param ELEM_TYPE the type of elements to be stored in the ringbuffer
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_SLOTS(LINKAGE, TYPE, ELEM_TYPE)                               \
+  SRB_DECL_SLOTS_type(LINKAGE, TYPE, ELEM_TYPE);                               \
+  srb_maybe_unused LINKAGE int TYPE##_try_push_one(TYPE *s, ELEM_TYPE i);      \
+  srb_maybe_unused LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i);         \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i);      \
+  srb_maybe_unused LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s);                  \
+  SRB_DECL_len(LINKAGE, TYPE);                                                 \
+  SRB_DECL_stats(LINKAGE, TYPE)
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_SLOTS`
+ *
+ * @see SRB_DECL_SLOTS
+ */
+#define SRB_DEF_SLOTS(LINKAGE, TYPE, ELEM_TYPE)                                \
+  SRB_DEF_size(TYPE, s->buffer.size)                                           \
+  LINKAGE int TYPE##_try_push_one(TYPE *s, ELEM_TYPE i) {                      \
+    srb_seq tail = atomic_load_explicit(&s->tail, memory_order_relaxed);       \
+    TYPE##_slot *slot;                                                         \
+    for (;;) {                                                                 \
+      slot = &s->buffer.data[srb_mask_slot(tail, s->buffer.size)];             \
+      /* Pairs with the release in TYPE##_try_pop_one, so that the last pop    \
+       * from this slot is done reading it. */                                 \
+      srb_seq seq = atomic_load_explicit(&slot->seq, memory_order_acquire);    \
+      if (seq == tail) {                                                       \
+        if (atomic_compare_exchange_weak_explicit(&s->tail, &tail, tail + 1,   \
+                                                  memory_order_relaxed,        \
+                                                  memory_order_relaxed)) {     \
+          break;                                                               \
+        }                                                                      \
+        srb_stat(s, push_claim_retries, 1);                                    \
+      } else if (seq < tail) {                                                 \
+        /* The element from a lap ago hasn't been popped yet */                \
+        srb_stat(s, push_full, 1);                                             \
+        return 1;                                                              \
+      } else {                                                                 \
+        /* Another push took this position since we loaded tail */             \
+        tail = atomic_load_explicit(&s->tail, memory_order_relaxed);           \
+      }                                                                        \
+    }                                                                          \
+    slot->value = i;                                                           \
+    atomic_store_explicit(&slot->seq, tail + 1, memory_order_release);         \
+    srb_stat(s, pushes, 1);                                                    \
+    srb_stat(s, pushed, 1);                                                    \
+    srb_stat_occupancy(s, srb_stats_used(atomic_load_explicit(                 \
+                                             &s->head, memory_order_relaxed),  \
+                                         tail + 1, s->buffer.size));           \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i) {                         \
+    SRB_UNWRAP(TYPE##_try_push_one(s, i));                                     \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i) {                      \
+    srb_seq head = atomic_load_explicit(&s->head, memory_order_relaxed);       \
+    TYPE##_slot *slot;                                                         \
+    for (;;) {                                                                 \
+      slot = &s->buffer.data[srb_mask_slot(head, s->buffer.size)];             \
+      /* Pairs with the release in TYPE##_try_push_one */                      \
+      srb_seq seq = atomic_load_explicit(&slot->seq, memory_order_acquire);    \
+      if (seq == head + 1) {                                                   \
+        if (atomic_compare_exchange_weak_explicit(&s->head, &head, head + 1,   \
+                                                  memory_order_relaxed,        \
+                                                  memory_order_relaxed)) {     \
+          break;                                                               \
+        }                                                                      \
+        srb_stat(s, pop_claim_retries, 1);                                     \
+      } else if (seq < head + 1) {                                             \
+        /* The push for this position hasn't happened, or isn't done */        \
+        srb_stat(s, pop_empty, 1);                                             \
+        return 1;                                                              \
+      } else {                                                                 \
+        head = atomic_load_explicit(&s->head, memory_order_relaxed);           \
+      }                                                                        \
+    }                                                                          \
+    *i = slot->value;                                                          \
+    atomic_store_explicit(&slot->seq, head + s->buffer.size,                   \
+                          memory_order_release);                               \
+    srb_stat(s, pops, 1);                                                      \
+    srb_stat(s, popped, 1);                                                    \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s) {                                  \
+    ELEM_TYPE out;                                                             \
+    SRB_UNWRAP(TYPE##_try_pop_one(s, &out));                                   \
+    return out;                                                                \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_SEQ_len(LINKAGE, TYPE, head, tail)                                   \
+  SRB_DEF_stats(LINKAGE, TYPE)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_SLOTS`,
+ * with `N` spaces, rounded up to a power of two
+ */
+#define SRB_INIT_SLOTS(VAR, N)                                                 \
+  /* Always a power of two, see SRB_DECL_SLOTS */                              \
+  (VAR).buffer.size = srb_next_pow2(N);                                        \
+  assert(((VAR).buffer.size & ((VAR).buffer.size - 1)) == 0);                  \
+  (VAR).buffer.data =                                                          \
+      malloc(sizeof(*((VAR).buffer.data)) * (VAR).buffer.size);                \
+  assert((VAR).buffer.data != NULL);                                           \
+  for (size_t srb_i = 0; srb_i < (VAR).buffer.size; srb_i++) {                 \
+    atomic_init(&(VAR).buffer.data[srb_i].seq, srb_i);                         \
+  }                                                                            \
+  atomic_init(&(VAR).head, 0);                                                 \
+  atomic_init(&(VAR).tail, 0);                                                 \
+  SRB_INIT_stats(VAR)
+
+/**
+ * @brief Frees the slots of the ringbuffer `VAR`, from `SRB_INIT_SLOTS`
+ */
+#define SRB_FREE_SLOTS(VAR)                                                    \
+  do {                                                                         \
+    free((VAR).buffer.data);                                                   \
+    (VAR).buffer.data = NULL;                                                  \
+  } while (1 == 0)
+
+/**
+ * @brief Declares `TYPE`, a ringbuffer made of several independent
+ * ringbuffers of `LANE_TYPE` ("lanes"), so producers don't all fight over the
+ * same counters.
+ *
+ * Every thread pushes to its own lane, `TYPE##_lane(s)`, picked by a
+ * thread-local id, so with as many lanes as producer threads no two producers
+ * ever touch the same cache lines. If there are more threads than lanes, some
+ * share one, so `LANE_TYPE` must allow several producers (a `SRB_DECL` or
+ * `SRB_DECL_MPSC` ringbuffer), unless you push to `s->lanes[i]` yourself, e.g.
+ * one per CPU. Pops go through the lanes round-robin, taking at most
+ * `s->quantum` elements from each lane on the way (0, the default, for no
+ * limit), and start from the next lane each time, so a busy lane can't starve
+ * the others. Pops can happen concurrently only if `LANE_TYPE` allows it.
+ *
+ * Elements from one lane come out in the order they went in, but there's no
+ * order between lanes. `LANE_TYPE` must be declared before this, and the slice
+ * type of `ELEM_TYPE` with it. Initialize with `SRB_INIT_SHARDED`, free with
+ * `SRB_FREE_SHARDED`.
+ *
+ * @param TYPE the type name you wish the newly-generated structure to have.
+ * @param LANE_TYPE the ringbuffer type of each lane
+ * @param ELEM_TYPE the type of elements to be stored in the ringbuffer
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_SHARDED(LINKAGE, TYPE, LANE_TYPE, ELEM_TYPE)                  \
+  /**                                                                          \
+   * @brief Several ringbuffers, one per producer                              \
+   */                                                                          \
+  typedef struct {                                                             \
+    /** @brief The lanes. */                                                   \
+    LANE_TYPE *lanes;                                                          \
+    /** @brief How many lanes there are. */                                    \
+    size_t count;                                                              \
+    /** @brief How many elements a pop takes from one lane at most, or 0. */   \
+    size_t quantum;                                                            \
+    srb_cacheline_aligned                                                      \
+    /** @brief The lane the next pop starts from. */                           \
+    atomic_size_t next;                                                        \
+  } TYPE;                                                                      \
+  srb_maybe_unused LINKAGE LANE_TYPE *TYPE##_lane(TYPE *s);                    \
+  srb_maybe_unused LINKAGE int TYPE##_try_push(TYPE *s,                        \
+                                               srb_##ELEM_TYPE##_slice v);     \
+  srb_maybe_unused LINKAGE int TYPE##_try_push_some(TYPE *s,                   \
+                                                    srb_##ELEM_TYPE##_slice v, \
+                                                    size_t *n);                \
+  srb_maybe_unused LINKAGE void TYPE##_push(TYPE *s,                           \
+                                            srb_##ELEM_TYPE##_slice v);        \
+  srb_maybe_unused LINKAGE int TYPE##_try_push_one(TYPE *s, ELEM_TYPE i);      \
+  srb_maybe_unused LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i);         \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_some(TYPE *s,                    \
+                                                   srb_##ELEM_TYPE##_slice v,  \
+                                                   size_t *n);                 \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i);      \
+  srb_maybe_unused LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s);                  \
+  SRB_DECL_len(LINKAGE, TYPE)
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_SHARDED`
+ *
+ * @see SRB_DECL_SHARDED
+ */
+#define SRB_DEF_SHARDED(LINKAGE, TYPE, LANE_TYPE, ELEM_TYPE)                   \
+  LINKAGE LANE_TYPE *TYPE##_lane(TYPE *s) {                                    \
+    return &s->lanes[srb_thread_id() % s->count];                              \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_push(TYPE *s, srb_##ELEM_TYPE##_slice v) {            \
+    return LANE_TYPE##_try_push(TYPE##_lane(s), v);                            \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_push_some(TYPE *s, srb_##ELEM_TYPE##_slice v,         \
+                                   size_t *n) {                                \
+    return LANE_TYPE##_try_push_some(TYPE##_lane(s), v, n);                    \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_push(TYPE *s, srb_##ELEM_TYPE##_slice v) {               \
+    LANE_TYPE##_push(TYPE##_lane(s), v);                                       \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_push_one(TYPE *s, ELEM_TYPE i) {                      \
+    return LANE_TYPE##_try_push_one(TYPE##_lane(s), i);                        \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i) {                         \
+    LANE_TYPE##_push_one(TYPE##_lane(s), i);                                   \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_some(TYPE *s, srb_##ELEM_TYPE##_slice v,          \
+                                  size_t *n) {                                 \
+    size_t start = atomic_load_explicit(&s->next, memory_order_relaxed);       \
+    size_t done = 0;                                                           \
+    for (size_t i = 0; i < s->count && done < v.size; i++) {                   \
+      size_t want = v.size - done;                                             \
+      if (s->quantum > 0 && want > s->quantum) {                               \
+        want = s->quantum;                                                     \
+      }                                                                        \
+      size_t got;                                                              \
+      if (LANE_TYPE##_try_pop_some(                                            \
+              &s->lanes[(start + i) % s->count],                               \
+              (srb_##ELEM_TYPE##_slice){&v.data[done], want}, &got) == 0) {    \
+        done += got;                                                           \
+      }                                                                        \
+    }                                                                          \
+    /* Only a hint, so racing pops may skip or repeat a starting lane */       \
+    atomic_store_explicit(&s->next, (start + 1) % s->count,                    \
+                          memory_order_relaxed);                               \
+    *n = done;                                                                 \
+    return done == 0;                                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i) {                      \
+    size_t n;                                                                  \
+    return TYPE##_try_pop_some(s, (srb_##ELEM_TYPE##_slice){i, 1}, &n);        \
+  }                                                                            \
+                                                                               \
+  LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s) {                                  \
+    ELEM_TYPE out;                                                             \
+    SRB_UNWRAP(TYPE##_try_pop_one(s, &out));                                   \
+    return out;                                                                \
+  }                                                                            \
+                                                                               \
+  LINKAGE size_t TYPE##_len(TYPE *s) {                                         \
+    size_t len = 0;                                                            \
+    for (size_t i = 0; i < s->count; i++) {                                    \
+      len += LANE_TYPE##_len(&s->lanes[i]);                                    \
+    }                                                                          \
+    return len;                                                                \
+  }                                                                            \
+                                                                               \
+  LINKAGE size_t TYPE##_capacity(TYPE *s) {                                    \
+    size_t capacity = 0;                                                       \
+    for (size_t i = 0; i < s->count; i++) {                                    \
+      capacity += LANE_TYPE##_capacity(&s->lanes[i]);                          \
+    }                                                                          \
+    return capacity;                                                           \
+  }
+
+/**
+ * @internal
+ * @brief Lanes have to stay on their own cache lines in an array.
+ */
+#ifdef SRB_CACHELINE
+#define srb_alloc_lanes(bytes) aligned_alloc(SRB_CACHELINE, bytes)
+#else // SRB_CACHELINE
+#define srb_alloc_lanes(bytes) malloc(bytes)
+#endif // SRB_CACHELINE
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_SHARDED`,
+ * with `LANES` lanes of `N` spaces each
+ *
+ * @param INIT how to initialize each lane, e.g. `SRB_INIT_MPSC`
+ */
+#define SRB_INIT_SHARDED(VAR, LANES, N, INIT)                                  \
+  assert((LANES) > 0);                                                         \
+  (VAR).count = (LANES);                                                       \
+  (VAR).lanes = srb_alloc_lanes(sizeof(*(VAR).lanes) * (VAR).count);           \
+  assert((VAR).lanes != NULL);                                                 \
+  for (size_t srb_i = 0; srb_i < (VAR).count; srb_i++) {                       \
+    INIT((VAR).lanes[srb_i], N);                                               \
+  }                                                                            \
+  (VAR).quantum = 0;                                                           \
+  atomic_init(&(VAR).next, 0)
+
+/**
+ * @brief Frees all the lanes of the ringbuffer `VAR`, from `SRB_INIT_SHARDED`
+ */
+#define SRB_FREE_SHARDED(VAR)                                                  \
+  do {                                                                         \
+    for (size_t srb_i = 0; srb_i < (VAR).count; srb_i++) {                     \
+      SRB_FREE((VAR).lanes[srb_i]);                                            \
+    }                                                                          \
+    free((VAR).lanes);                                                         \
+    (VAR).lanes = NULL;                                                        \
+  } while (1 == 0)
+
+/**
+ * @internal
+ * @brief Brackets reads that are allowed to race with writes, because they're
+ * checked afterwards and thrown away if they did, so ThreadSanitizer doesn't
+ * report them.
+ */
+#if defined(__SANITIZE_THREAD__)
+#define SRB_TSAN
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define SRB_TSAN
+#endif // __has_feature(thread_sanitizer)
+#endif // __SANITIZE_THREAD__
+#ifdef SRB_TSAN
+void AnnotateIgnoreReadsBegin(const char *file, int line);
+void AnnotateIgnoreReadsEnd(const char *file, int line);
+#define srb_racy_reads_begin() AnnotateIgnoreReadsBegin(__FILE__, __LINE__)
+#define srb_racy_reads_end() AnnotateIgnoreReadsEnd(__FILE__, __LINE__)
+#else // SRB_TSAN
+#define srb_racy_reads_begin() ((void)0)
+#define srb_racy_reads_end() ((void)0)
+#endif // SRB_TSAN
+
+/**
+ * @brief Declares a ringbuffer `TYPE` that, once full, overwrites the oldest
+ * elements instead of turning pushes away.
+ *
+ * Pushes always succeed and never wait for a consumer: each one takes the next
+ * position with one fetch-add and writes to its slot, whether or not the
+ * element a lap ago was popped. A pop that finds its element overwritten skips
+ * ahead and says how many elements it lost. Any number of threads may push and
+ * pop.
+ *
+ * Every slot is a seqlock: a push marks it as being written, writes it, then
+ * marks it as holding its position; a pop copies the element out, then checks
+ * that the slot still holds the same position, and tries again if it doesn't.
+ * So pops may copy an element while it's being overwritten, and throw the copy
+ * away: `ELEM_TYPE` must be fine to copy in that state (no pointers that get
+ * freed, say). A push only ever waits for another push that got to the same
+ * slot a lap earlier and is still writing it.
+ *
+ * Like `SRB_DECL_SLOTS`, its size is always a power of two, since the slots
+ * keep track of positions that are never wrapped.
+ *
+ * Provides `TYPE##_push_one`, `TYPE##_push`, `TYPE##_try_pop_one`,
+ * `TYPE##_try_pop_some`, `TYPE##_len` and `TYPE##_capacity`. Initialize with
+ * `SRB_INIT_LOSSY`, free with `SRB_FREE_LOSSY`. Declare the slice type of
+ * `ELEM_TYPE` before this, with `SRB_DECL_SLICE`.
+ *
+ * @param TYPE the type name you wish the newly-generated structure to have.
+ * @param ELEM_TYPE the type of elements to be stored in the ringbuffer
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_LOSSY(LINKAGE, TYPE, ELEM_TYPE)                               \
+  /**                                                                          \
+   * @brief A slot of a `SRB_DECL_LOSSY` ringbuffer                            \
+   */                                                                          \
+  typedef struct {                                                             \
+    /**                                                                        \
+     * @brief `2 * i + 1` while the element at position `i` is being written,  \
+     * `2 * i + 2` once it's there. 0 before the first push.                   \
+     */                                                                        \
+    srb_atomic_seq seq;                                                        \
+    ELEM_TYPE value;                                                           \
+  } TYPE##_slot;                                                               \
+                                                                               \
+  /**                                                                          \
+   * @brief A ringbuffer that overwrites its oldest elements when it's full    \
+   */                                                                          \
+  typedef struct {                                                             \
+    /** @brief Stores all the slots. Also contains the size. */                \
+    struct {                                                                   \
+      TYPE##_slot *data;                                                       \
+      size_t size;                                                             \
+    } buffer;                                                                  \
+    /* Consumer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Position of the next element to pop. */                         \
+    srb_atomic_seq head;                                                       \
+    /* Producer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Position of the next push. */                                   \
+    srb_atomic_seq tail;                                                       \
+    srb_stats_fields                                                           \
+  } TYPE;                                                                      \
+  srb_maybe_unused LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i);         \
+  srb_maybe_unused LINKAGE void TYPE##_push(TYPE *s,                           \
+                                            srb_##ELEM_TYPE##_slice v);        \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i,       \
+                                                  size_t *dropped);            \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_some(TYPE *s,                    \
+                                                   srb_##ELEM_TYPE##_slice v,  \
+                                                   size_t *n,                  \
+                                                   size_t *dropped);           \
+  SRB_DECL_len(LINKAGE, TYPE)                                                  \
+  SRB_DECL_stats(LINKAGE, TYPE)
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_LOSSY`
+ *
+ * - `TYPE##_push_one`/`TYPE##_push`: push, overwriting the oldest elements if
+ *   there's no space.
+ * - `TYPE##_try_pop_one`: pops the oldest element still there into `i`. Sets
+ *   `dropped` to how many elements were overwritten since the last pop. Returns
+ *   0 if it popped an element, and 1 if there was none (`dropped` may still be
+ *   more than 0).
+ * - `TYPE##_try_pop_some`: pops up to `v.size` elements into `v`, and sets `n`
+ *   to how many. Returns 1 if there were none.
+ *
+ * @see SRB_DECL_LOSSY
+ */
+#define SRB_DEF_LOSSY(LINKAGE, TYPE, ELEM_TYPE)                                \
+  SRB_DEF_size(TYPE, s->buffer.size)                                           \
+  LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i) {                         \
+    srb_seq tail =                                                             \
+        atomic_fetch_add_explicit(&s->tail, 1, memory_order_relaxed);          \
+    TYPE##_slot *slot = &s->buffer.data[srb_mask_slot(tail, s->buffer.size)];  \
+    srb_seq seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);      \
+    unsigned spins = 0;                                                        \
+    for (;;) {                                                                 \
+      if (seq >= 2 * tail + 1) {                                               \
+        /* A push a lap or more ahead got here first, which would have         \
+         * overwritten this element anyway */                                  \
+        break;                                                                 \
+      }                                                                        \
+      if (seq % 2 == 1) {                                                      \
+        /* A push a lap or more behind is still writing */                     \
+        srb_stat(s, push_publish_spins, 1);                                    \
+        srb_backoff(&spins);                                                   \
+        seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);          \
+        continue;                                                              \
+      }                                                                        \
+      /* Acquire pairs with the release store of the push a lap ago, so we     \
+       * write the slot after it did */                                        \
+      if (atomic_compare_exchange_weak_explicit(&slot->seq, &seq,              \
+                                                2 * tail + 1,                  \
+                                                memory_order_acquire,          \
+                                                memory_order_relaxed)) {       \
+        /* Pops checking the slot again after copying it see the odd number    \
+         * if they saw any of the new element */                               \
+        atomic_thread_fence(memory_order_release);                             \
+        slot->value = i;                                                       \
+        atomic_store_explicit(&slot->seq, 2 * tail + 2, memory_order_release); \
+        break;                                                                 \
+      }                                                                        \
+      srb_stat(s, push_claim_retries, 1);                                      \
+    }                                                                          \
+    srb_stat(s, pushes, 1);                                                    \
+    srb_stat(s, pushed, 1);                                                    \
+    srb_stat_occupancy(s, srb_stats_used(atomic_load_explicit(                 \
+                                             &s->head, memory_order_relaxed),  \
+                                         tail + 1, s->buffer.size));           \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_push(TYPE *s, srb_##ELEM_TYPE##_slice v) {               \
+    for (size_t i = 0; i < v.size; i++) {                                      \
+      TYPE##_push_one(s, v.data[i]);                                           \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i, size_t *dropped) {     \
+    srb_seq head = atomic_load_explicit(&s->head, memory_order_relaxed);       \
+    *dropped = 0;                                                              \
+    for (;;) {                                                                 \
+      srb_seq tail = atomic_load_explicit(&s->tail, memory_order_relaxed);     \
+      if (tail == head) {                                                      \
+        srb_stat(s, pop_empty, 1);                                             \
+        return 1;                                                              \
+      }                                                                        \
+      srb_seq skip = head + 1;                                                 \
+      if (tail - head > s->buffer.size) {                                      \
+        /* Lapped: everything before the last buffer.size is gone */           \
+        skip = tail - s->buffer.size;                                          \
+      } else {                                                                 \
+        TYPE##_slot *slot =                                                    \
+            &s->buffer.data[srb_mask_slot(head, s->buffer.size)];              \
+        /* Pairs with the release store in TYPE##_push_one */                  \
+        srb_seq seq = atomic_load_explicit(&slot->seq, memory_order_acquire);  \
+        if (seq < 2 * head + 2) {                                              \
+          /* Its push hasn't finished yet */                                   \
+          srb_stat(s, pop_empty, 1);                                           \
+          return 1;                                                            \
+        }                                                                      \
+        if (seq == 2 * head + 2) {                                             \
+          srb_racy_reads_begin();                                              \
+          ELEM_TYPE out = slot->value;                                         \
+          srb_racy_reads_end();                                                \
+          atomic_thread_fence(memory_order_acquire);                           \
+          if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) { \
+            /* Overwritten while we were copying it, so skip it */             \
+            continue;                                                          \
+          }                                                                    \
+          if (atomic_compare_exchange_weak_explicit(                           \
+                  &s->head, &head, head + 1, memory_order_relaxed,             \
+                  memory_order_relaxed)) {                                     \
+            *i = out;                                                          \
+            srb_stat(s, pops, 1);                                              \
+            srb_stat(s, popped, 1);                                            \
+            return 0;                                                          \
+          }                                                                    \
+          srb_stat(s, pop_claim_retries, 1);                                   \
+          continue;                                                            \
+        }                                                                      \
+        /* Otherwise, it was overwritten by a later lap */                     \
+      }                                                                        \
+      if (atomic_compare_exchange_weak_explicit(&s->head, &head, skip,         \
+                                                memory_order_relaxed,          \
+                                                memory_order_relaxed)) {       \
+        *dropped += skip - head;                                               \
+        srb_stat(s, dropped, skip - head);                                     \
+        head = skip;                                                           \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_some(TYPE *s, srb_##ELEM_TYPE##_slice v,          \
+                                  size_t *n, size_t *dropped) {                \
+    *n = 0;                                                                    \
+    *dropped = 0;                                                              \
+    for (size_t lost; *n < v.size; *dropped += lost) {                         \
+      if (TYPE##_try_pop_one(s, &v.data[*n], &lost)) {                         \
+        *dropped += lost;                                                      \
+        break;                                                                 \
+      }                                                                        \
+      (*n)++;                                                                  \
+    }                                                                          \
+    return *n == 0;                                                            \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_SEQ_len(LINKAGE, TYPE, head, tail)                                   \
+  SRB_DEF_stats(LINKAGE, TYPE)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by `SRB_DECL_LOSSY`,
+ * with `N` spaces, rounded up to a power of two
+ */
+#define SRB_INIT_LOSSY(VAR, N)                                                 \
+  /* Always a power of two, see SRB_DECL_LOSSY */                              \
+  (VAR).buffer.size = srb_next_pow2(N);                                        \
+  assert(((VAR).buffer.size & ((VAR).buffer.size - 1)) == 0);                  \
+  (VAR).buffer.data =                                                          \
+      malloc(sizeof(*((VAR).buffer.data)) * (VAR).buffer.size);                \
+  assert((VAR).buffer.data != NULL);                                           \
+  for (size_t srb_i = 0; srb_i < (VAR).buffer.size; srb_i++) {                 \
+    atomic_init(&(VAR).buffer.data[srb_i].seq, 0);                             \
+  }                                                                            \
+  atomic_init(&(VAR).head, 0);                                                 \
+  atomic_init(&(VAR).tail, 0);                                                 \
+  SRB_INIT_stats(VAR)
+
+/**
+ * @brief Frees the slots of the ringbuffer `VAR`, from `SRB_INIT_LOSSY`
+ */
+#define SRB_FREE_LOSSY(VAR) SRB_FREE_SLOTS(VAR)
+
+/**
+ * @internal
+ * @brief What a `SRB_DECL_BROADCAST` cursor is up to.
+ */
+enum {
+  SRB_CURSOR_FREE,
+  SRB_CURSOR_JOINING,
+  SRB_CURSOR_ACTIVE,
+};
+
+/**
+ * @brief Declares a ringbuffer `TYPE` whose elements are seen by every one of
+ * its consumers, for one producer thread.
+ *
+ * Instead of one head, every consumer has a cursor of its own, and reads the
+ * elements in place between its cursor and the producer's tail, without taking
+ * them out for anyone else. The producer only reuses a slot once every cursor
+ * is past it, so the slowest consumer holds it up. Consumers are
+ * `TYPE##_subscribe`d and `TYPE##_unsubscribe`d at any time, up to the number
+ * of cursors given to `SRB_INIT_BROADCAST`; a new one starts at the tail, and
+ * sees everything pushed after it joined.
+ *
+ * The producer has the same push functions as `SRB_DECL`. Each consumer, with
+ * its cursor `c`:
+ *
+ * - `TYPE##_try_reserve_read(s, c, n, &first, &second)`: hands back up to `n`
+ *   elements after the cursor, in the one or two regions of the buffer they're
+ *   in, or fails if there are none. Read them there, then
+ * - `TYPE##_release_read(s, c, first, second)`: moves the cursor past them.
+ * - `TYPE##_try_read_one(s, c, &elem)`: copies out the next element and moves
+ *   past it.
+ * - `TYPE##_len(s, c)`: how many elements the cursor has left to read.
+ *
+ * Each cursor may only be used by one thread at a time. Initialize with
+ * `SRB_INIT_BROADCAST`, free with `SRB_FREE_BROADCAST`. Declare the slice type
+ * of `ELEM_TYPE` before this, with `SRB_DECL_SLICE`.
+ *
+ * @param TYPE the type name you wish the newly-generated structure to have.
+ * @param ELEM_TYPE the type of elements to be stored in the ringbuffer
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_BROADCAST(LINKAGE, TYPE, ELEM_TYPE)                           \
+  /**                                                                          \
+   * @brief One consumer's place in a `SRB_DECL_BROADCAST` ringbuffer          \
+   */                                                                          \
+  typedef struct {                                                             \
+    srb_cacheline_aligned                                                      \
+    /** @brief Sequence number of the next element to read. */                 \
+    srb_atomic_seq head;                                                       \
+    /** @brief Where head is in the buffer, see `srb_index`. Only used by the  \
+     * consumer. */                                                            \
+    size_t head_index;                                                         \
+    /** @brief One of `SRB_CURSOR_FREE`, `_JOINING` and `_ACTIVE`. */          \
+    atomic_int state;                                                          \
+  } TYPE##_cursor;                                                             \
+                                                                               \
+  /**                                                                          \
+   * @brief A ringbuffer whose elements are read by every consumer             \
+   */                                                                          \
+  typedef struct {                                                             \
+    /** @brief Stores all the elements. Also contains the size. */             \
+    srb_##ELEM_TYPE##_slice buffer;                                            \
+    srb_mirror_fields                                                          \
+    srb_shm_fields                                                             \
+    srb_mmap_fields                                                            \
+    /** @brief The consumers' cursors, some of them free. */                   \
+    TYPE##_cursor *cursors;                                                    \
+    /** @brief How many cursors there are. */                                  \
+    size_t count;                                                              \
+    /* Producer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief Sequence number of the next slot to push to. Only written by    \
+     * the producer. */                                                        \
+    srb_atomic_seq tail;                                                       \
+    /** @brief Where tail is in the buffer, see `srb_index`. */                \
+    size_t tail_index;                                                         \
+    /** @brief The producer's last look at the slowest cursor. */              \
+    srb_seq min_cache;                                                         \
+    srb_stats_fields                                                           \
+  } TYPE;                                                                      \
+  SRB_DECL_push(LINKAGE, TYPE, ELEM_TYPE);                                     \
+  srb_maybe_unused LINKAGE int TYPE##_subscribe(TYPE *s, size_t *c);           \
+  srb_maybe_unused LINKAGE void TYPE##_unsubscribe(TYPE *s, size_t c);         \
+  srb_maybe_unused LINKAGE int TYPE##_try_reserve_read(                        \
+      TYPE *s, size_t c, size_t n, srb_##ELEM_TYPE##_slice *first,             \
+      srb_##ELEM_TYPE##_slice *second);                                        \
+  srb_maybe_unused LINKAGE void TYPE##_release_read(                           \
+      TYPE *s, size_t c, srb_##ELEM_TYPE##_slice first,                        \
+      srb_##ELEM_TYPE##_slice second);                                         \
+  srb_maybe_unused LINKAGE int TYPE##_try_read_one(TYPE *s, size_t c,          \
+                                                   ELEM_TYPE *i);              \
+  srb_maybe_unused LINKAGE size_t TYPE##_len(TYPE *s, size_t c);               \
+  srb_maybe_unused LINKAGE size_t TYPE##_capacity(TYPE *s);                    \
+  SRB_DECL_stats(LINKAGE, TYPE)
+
+/**
+ * @brief Defines all the methods for the ringbuffer `TYPE`, as generated by
+ * `SRB_DECL_BROADCAST`
+ *
+ * @see SRB_DECL_BROADCAST
+ */
+#define SRB_DEF_BROADCAST(LINKAGE, TYPE, ELEM_TYPE)                            \
+  SRB_DEF_size(TYPE, s->buffer.size)                                           \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @returns the sequence number of the slowest cursor, or `tail` if there    \
+   * are none                                                                  \
+   */                                                                          \
+  static srb_seq TYPE##_slowest(TYPE *s, srb_seq tail) {                       \
+    /* Pairs with the fence in TYPE##_subscribe: either we see the new cursor  \
+     * here, or it sees our tail and starts after everything we might          \
+     * overwrite. */                                                           \
+    atomic_thread_fence(memory_order_seq_cst);                                 \
+    srb_seq min = tail;                                                        \
+    for (size_t i = 0; i < s->count; i++) {                                    \
+      TYPE##_cursor *c = &s->cursors[i];                                       \
+      if (atomic_load_explicit(&c->state, memory_order_acquire) !=             \
+          SRB_CURSOR_ACTIVE) {                                                 \
+        continue;                                                              \
+      }                                                                        \
+      /* Pairs with the release in TYPE##_release_read, so that the consumer   \
+       * is done reading the slots before we write over them. */               \
+      srb_seq head = atomic_load_explicit(&c->head, memory_order_acquire);     \
+      if (tail - head > tail - min) {                                          \
+        min = head;                                                            \
+      }                                                                        \
+    }                                                                          \
+    return min;                                                                \
+  }                                                                            \
+                                                                               \
+  static int TYPE##_reserve_push_range(TYPE *s, size_t min, size_t max,        \
+                                       srb_##ELEM_TYPE##_slice *first,         \
+                                       srb_##ELEM_TYPE##_slice *second) {      \
+    /* We're the only one who writes tail, no need to synchronize with it */   \
+    srb_seq tail = atomic_load_explicit(&s->tail, memory_order_relaxed);       \
+    size_t room = TYPE##_size(s) - (size_t)(tail - s->min_cache);              \
+    if (room < max) {                                                          \
+      s->min_cache = TYPE##_slowest(s, tail);                                  \
+      /* A cursor that's just joined may still be more than a lap behind, so   \
+       * this has to saturate */                                               \
+      srb_seq used = tail - s->min_cache;                                      \
+      room = used < TYPE##_size(s) ? TYPE##_size(s) - (size_t)used : 0;        \
+      if (room < min) {                                                        \
+        srb_stat(s, push_full, 1);                                             \
+        return 1;                                                              \
+      }                                                                        \
+    }                                                                          \
+    size_t n = max < room ? max : room;                                        \
+    size_t index = srb_index(s->tail_index, TYPE##_size(s));                   \
+    srb_split(first, second, srb_data(s, ELEM_TYPE), index, srb_span(s), n);   \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_reserve_some(LINKAGE, TYPE, ELEM_TYPE, push)                         \
+                                                                               \
+  LINKAGE void TYPE##_commit_push(TYPE *s, srb_##ELEM_TYPE##_slice first,      \
+                                  srb_##ELEM_TYPE##_slice second) {            \
+    srb_seq tail = atomic_load_explicit(&s->tail, memory_order_relaxed);       \
+    size_t n = first.size + second.size;                                       \
+    if (n == 0) {                                                              \
+      /* Nothing to publish. */                                                \
+      return;                                                                  \
+    }                                                                          \
+    s->tail_index = srb_advance(s->tail_index, n, TYPE##_size(s));             \
+    atomic_store_explicit(&s->tail, tail + n, memory_order_release);           \
+    srb_stat(s, pushes, 1);                                                    \
+    srb_stat(s, pushed, n);                                                    \
+  }                                                                            \
+                                                                               \
+  SRB_DEF_push_copy(LINKAGE, TYPE, ELEM_TYPE)                                  \
+                                                                               \
+  LINKAGE int TYPE##_subscribe(TYPE *s, size_t *c) {                           \
+    for (size_t i = 0; i < s->count; i++) {                                    \
+      TYPE##_cursor *cur = &s->cursors[i];                                     \
+      int expected = SRB_CURSOR_FREE;                                          \
+      if (!atomic_compare_exchange_strong(&cur->state, &expected,              \
+                                          SRB_CURSOR_JOINING)) {               \
+        continue;                                                              \
+      }                                                                        \
+      /* The producer doesn't look at us until we're active, and then it       \
+       * might not see us straight away, having just looked. Starting here     \
+       * makes it wait for us if it does. */                                   \
+      atomic_store_explicit(                                                   \
+          &cur->head, atomic_load_explicit(&s->tail, memory_order_relaxed),    \
+          memory_order_relaxed);                                               \
+      atomic_store_explicit(&cur->state, SRB_CURSOR_ACTIVE,                    \
+                            memory_order_release);                             \
+      atomic_thread_fence(memory_order_seq_cst);                               \
+      /* Whatever the producer overwrites without having seen us comes before  \
+       * this, so start here. Joining is rare enough to find its slot by       \
+       * division, and from then on we keep track of it. */                    \
+      srb_seq tail = atomic_load_explicit(&s->tail, memory_order_acquire);     \
+      cur->head_index = srb_slot(tail, TYPE##_size(s));                        \
+      atomic_store_explicit(&cur->head, tail, memory_order_release);           \
+      *c = i;                                                                  \
+      return 0;                                                                \
+    }                                                                          \
+    return 1;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_unsubscribe(TYPE *s, size_t c) {                         \
+    assert(atomic_load(&s->cursors[c].state) == SRB_CURSOR_ACTIVE);            \
+    /* Release, so that we're done reading before the producer stops waiting   \
+     * for us */                                                               \
+    atomic_store_explicit(&s->cursors[c].state, SRB_CURSOR_FREE,               \
+                          memory_order_release);                               \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_reserve_read(TYPE *s, size_t c, size_t n,             \
+                                      srb_##ELEM_TYPE##_slice *first,          \
+                                      srb_##ELEM_TYPE##_slice *second) {       \
+    /* Only we write our cursor */                                             \
+    srb_seq head =                                                             \
+        atomic_load_explicit(&s->cursors[c].head, memory_order_relaxed);       \
+    /* Pairs with the release in TYPE##_commit_push */                         \
+    srb_seq tail = atomic_load_explicit(&s->tail, memory_order_acquire);       \
+    size_t available = (size_t)(tail - head);                                  \
+    if (available == 0) {                                                      \
+      return 1;                                                                \
+    }                                                                          \
+    n = n < available ? n : available;                                         \
+    size_t index = srb_index(s->cursors[c].head_index, TYPE##_size(s));        \
+    srb_split(first, second, srb_data(s, ELEM_TYPE), index, srb_span(s), n);   \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_release_read(TYPE *s, size_t c,                          \
+                                   srb_##ELEM_TYPE##_slice first,              \
+                                   srb_##ELEM_TYPE##_slice second) {           \
+    TYPE##_cursor *cur = &s->cursors[c];                                       \
+    srb_seq head = atomic_load_explicit(&cur->head, memory_order_relaxed);     \
+    size_t n = first.size + second.size;                                       \
+    cur->head_index = srb_advance(cur->head_index, n, TYPE##_size(s));         \
+    atomic_store_explicit(&cur->head, head + n, memory_order_release);         \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_read_one(TYPE *s, size_t c, ELEM_TYPE *i) {           \
+    srb_##ELEM_TYPE##_slice first, second;                                     \
+    SRB_TRY(TYPE##_try_reserve_read(s, c, 1, &first, &second));                \
+    *i = first.data[0];                                                        \
+    TYPE##_release_read(s, c, first, second);                                  \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE size_t TYPE##_len(TYPE *s, size_t c) {                               \
+    srb_seq head = atomic_load_explicit(&s->cursors[c].head,                   \
+                                        memory_order_acquire);                 \
+    srb_seq tail = atomic_load_explicit(&s->tail, memory_order_acquire);       \
+    return (size_t)(tail - head);                                              \
+  }                                                                            \
+                                                                               \
+  LINKAGE size_t TYPE##_capacity(TYPE *s) { return TYPE##_size(s); }           \
+                                                                               \
+  SRB_DEF_stats(LINKAGE, TYPE)
+
+/**
+ * @brief Initializes a `VAR` to be a ringbuffer declared by
+ * `SRB_DECL_BROADCAST`, with `N` spaces and room for `CONSUMERS` consumers
+ */
+#define SRB_INIT_BROADCAST(VAR, N, CONSUMERS)                                  \
+  SRB_INIT_buffer(VAR, N)                                                      \
+  (VAR).count = (CONSUMERS);                                                   \
+  (VAR).cursors = srb_alloc_lanes(sizeof(*(VAR).cursors) * (VAR).count);       \
+  assert((VAR).cursors != NULL);                                               \
+  for (size_t srb_i = 0; srb_i < (VAR).count; srb_i++) {                       \
+    atomic_init(&(VAR).cursors[srb_i].head, 0);                                \
+    (VAR).cursors[srb_i].head_index = 0;                                       \
+    atomic_init(&(VAR).cursors[srb_i].state, SRB_CURSOR_FREE);                 \
+  }                                                                            \
+  atomic_init(&(VAR).tail, 0);                                                 \
+  (VAR).tail_index = 0;                                                        \
+  (VAR).min_cache = 0;                                                         \
+  SRB_INIT_stats(VAR)
+
+/**
+ * @brief Frees the storage and cursors of the ringbuffer `VAR`, from
+ * `SRB_INIT_BROADCAST`
+ */
+#define SRB_FREE_BROADCAST(VAR)                                                \
+  do {                                                                         \
+    SRB_FREE_mapped(VAR) { SRB_FREE_buffer(VAR) }                              \
+    (VAR).buffer.data = NULL;                                                  \
+    free((VAR).cursors);                                                       \
+    (VAR).cursors = NULL;                                                      \
+  } while (1 == 0)
+
+/**
+ * @brief Declares a queue `TYPE` that never fills up: a linked list of
+ * `SRB_DECL_SPSC` ringbuffers of a fixed size, called segments.
+ *
+ * The producer pushes to the last segment, and when that's full, links a new
+ * one after it and carries on there. The consumer pops from the first one, and
+ * when that's empty and has a successor, hands it back and moves on. Handed
+ * back segments go on a free list (itself an `SRB_DECL_SPSC` ringbuffer of
+ * pointers) for the producer to reuse, and only once that's full are they
+ * freed. So bursts are absorbed by allocating whole segments, never single
+ * elements, and after a burst the queue goes back to the segment in use plus
+ * the spares the free list holds.
+ *
+ * One thread may push and one may pop. Pushes always succeed; they assert that
+ * a new segment could be allocated.
+ *
+ * Provides `TYPE##_push`, `TYPE##_push_one`, `TYPE##_try_pop_some`,
+ * `TYPE##_try_pop_one`, `TYPE##_pop_one` and `TYPE##_segments`, and declares
+ * the ringbuffer types `TYPE##_ring` and `TYPE##_spares`. Initialize with
+ * `SRB_INIT_UNBOUNDED`, free with `SRB_FREE_UNBOUNDED`. Declare the slice type
+ * of `ELEM_TYPE` before this, with `SRB_DECL_SLICE`.
+ *
+ * @param TYPE the type name you wish the newly-generated structure to have.
+ * @param ELEM_TYPE the type of elements to be stored in the queue
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_UNBOUNDED(LINKAGE, TYPE, ELEM_TYPE)                           \
+  SRB_DECL_SPSC(LINKAGE, TYPE##_ring, ELEM_TYPE);                              \
+                                                                               \
+  /**                                                                          \
+   * @brief One segment of a `SRB_DECL_UNBOUNDED` queue                        \
+   */                                                                          \
+  typedef struct TYPE##_segment {                                              \
+    /** @brief The elements. */                                                \
+    TYPE##_ring ring;                                                          \
+    /** @brief The segment after this one, or NULL while the producer is still \
+     * pushing to this one. */                                                 \
+    _Atomic(struct TYPE##_segment *) next;                                     \
+  } TYPE##_segment;                                                            \
+  typedef TYPE##_segment *TYPE##_segment_ptr;                                  \
+  SRB_DECL_SLICE(TYPE##_segment_ptr);                                          \
+  SRB_DECL_SPSC(LINKAGE, TYPE##_spares, TYPE##_segment_ptr);                   \
+                                                                               \
+  /**                                                                          \
+   * @brief A queue of linked segments, that grows as needed                   \
+   */                                                                          \
+  typedef struct {                                                             \
+    /** @brief How many elements a segment holds. */                           \
+    size_t segment_size;                                                       \
+    /** @brief How many segments are allocated, spares included. */            \
+    atomic_size_t segments;                                                    \
+    /** @brief Emptied segments, for the producer to reuse. */                 \
+    TYPE##_spares spares;                                                      \
+    /* Consumer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief The segment to pop from. Only used by the consumer. */          \
+    TYPE##_segment *head;                                                      \
+    /* Producer side */                                                        \
+    srb_cacheline_aligned                                                      \
+    /** @brief The segment to push to. Only used by the producer. */           \
+    TYPE##_segment *tail;                                                      \
+  } TYPE;                                                                      \
+  srb_maybe_unused LINKAGE void TYPE##_push(TYPE *s,                           \
+                                            srb_##ELEM_TYPE##_slice v);        \
+  srb_maybe_unused LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i);         \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_some(TYPE *s,                    \
+                                                   srb_##ELEM_TYPE##_slice v,  \
+                                                   size_t *n);                 \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i);      \
+  srb_maybe_unused LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s);                  \
+  srb_maybe_unused LINKAGE size_t TYPE##_segments(TYPE *s)
+
+/**
+ * @brief Defines all the methods for the queue `TYPE`, as generated by
+ * `SRB_DECL_UNBOUNDED`
+ *
+ * @see SRB_DECL_UNBOUNDED
+ */
+#define SRB_DEF_UNBOUNDED(LINKAGE, TYPE, ELEM_TYPE)                            \
+  SRB_DEF_SPSC(LINKAGE, TYPE##_ring, ELEM_TYPE);                               \
+  SRB_DEF_SPSC(LINKAGE, TYPE##_spares, TYPE##_segment_ptr);                    \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Links a spare or new segment after the last one, and moves the     \
+   * producer on to it.                                                        \
+   */                                                                          \
+  static void TYPE##_grow(TYPE *s) {                                           \
+    TYPE##_segment *seg;                                                       \
+    if (TYPE##_spares_try_pop_one(&s->spares, &seg) != 0) {                    \
+      SRB_INIT_segment(seg, s->segment_size);                                  \
+      atomic_fetch_add_explicit(&s->segments, 1, memory_order_relaxed);        \
+    }                                                                          \
+    /* A spare is empty, and its ring carries on from where it stopped. Its    \
+     * last successor was read before it was handed back, so this doesn't      \
+     * race with that. */                                                      \
+    atomic_store_explicit(&seg->next, NULL, memory_order_relaxed);             \
+    /* Pairs with the acquire in TYPE##_try_pop_some, so the consumer sees     \
+     * everything we pushed to the old segment once it sees the new one. */    \
+    atomic_store_explicit(&s->tail->next, seg, memory_order_release);          \
+    s->tail = seg;                                                             \
+  }                                                                            \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Hands an emptied segment back for reuse, or frees it if there      \
+   * are spares enough already.                                                \
+   */                                                                          \
+  static void TYPE##_retire(TYPE *s, TYPE##_segment *seg) {                    \
+    if (TYPE##_spares_try_push_one(&s->spares, seg) != 0) {                    \
+      SRB_FREE_segment(seg);                                                   \
+      atomic_fetch_sub_explicit(&s->segments, 1, memory_order_relaxed);        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_push(TYPE *s, srb_##ELEM_TYPE##_slice v) {               \
+    size_t done = 0;                                                           \
+    while (done < v.size) {                                                    \
+      size_t n;                                                                \
+      if (TYPE##_ring_try_push_some(                                           \
+              &s->tail->ring,                                                  \
+              (srb_##ELEM_TYPE##_slice){&v.data[done], v.size - done},         \
+              &n) != 0) {                                                      \
+        TYPE##_grow(s);                                                        \
+        continue;                                                              \
+      }                                                                        \
+      done += n;                                                               \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE void TYPE##_push_one(TYPE *s, ELEM_TYPE i) {                         \
+    TYPE##_push(s, (srb_##ELEM_TYPE##_slice){&i, 1});                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_some(TYPE *s, srb_##ELEM_TYPE##_slice v,          \
+                                  size_t *n) {                                 \
+    if (v.size == 0) {                                                         \
+      /* An empty pop can't tell us whether a segment is empty */              \
+      *n = 0;                                                                  \
+      return 1;                                                                \
+    }                                                                          \
+    for (;;) {                                                                 \
+      TYPE##_segment *seg = s->head;                                           \
+      if (TYPE##_ring_try_pop_some(&seg->ring, v, n) == 0) {                   \
+        return 0;                                                              \
+      }                                                                        \
+      TYPE##_segment *next =                                                   \
+          atomic_load_explicit(&seg->next, memory_order_acquire);              \
+      if (next == NULL) {                                                      \
+        return 1;                                                              \
+      }                                                                        \
+      /* The producer has left this segment for good. Whatever it pushed       \
+       * here before that is visible now, so look once more. */                \
+      if (TYPE##_ring_try_pop_some(&seg->ring, v, n) == 0) {                   \
+        return 0;                                                              \
+      }                                                                        \
+      s->head = next;                                                          \
+      TYPE##_retire(s, seg);                                                   \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_one(TYPE *s, ELEM_TYPE *i) {                      \
+    size_t n;                                                                  \
+    return TYPE##_try_pop_some(s, (srb_##ELEM_TYPE##_slice){i, 1}, &n);        \
+  }                                                                            \
+                                                                               \
+  LINKAGE ELEM_TYPE TYPE##_pop_one(TYPE *s) {                                  \
+    ELEM_TYPE out;                                                             \
+    SRB_UNWRAP(TYPE##_try_pop_one(s, &out));                                   \
+    return out;                                                                \
+  }                                                                            \
+                                                                               \
+  LINKAGE size_t TYPE##_segments(TYPE *s) {                                    \
+    return atomic_load_explicit(&s->segments, memory_order_relaxed);           \
+  }
+
+/**
+ * @internal
+ * @brief Allocates the segment `SEG` and its ringbuffer of `N` spaces.
+ */
+#define SRB_INIT_segment(SEG, N)                                               \
+  (SEG) = srb_alloc_lanes(sizeof(*(SEG)));                                     \
+  assert((SEG) != NULL);                                                       \
+  SRB_INIT_SPSC((SEG)->ring, N);                                               \
+  atomic_init(&(SEG)->next, NULL)
+
+/**
+ * @internal
+ * @brief Frees the segment `SEG` and its ringbuffer.
+ */
+#define SRB_FREE_segment(SEG)                                                  \
+  SRB_FREE((SEG)->ring);                                                       \
+  free(SEG)
+
+/**
+ * @brief Initializes a `VAR` to be a queue declared by `SRB_DECL_UNBOUNDED`,
+ * with segments of `N` spaces, and keeping up to `SPARES` emptied segments
+ * for reuse
+ */
+#define SRB_INIT_UNBOUNDED(VAR, N, SPARES)                                     \
+  assert((N) > 0 && (SPARES) > 0);                                             \
+  (VAR).segment_size = (N);                                                    \
+  SRB_INIT_SPSC((VAR).spares, SPARES);                                         \
+  SRB_INIT_segment((VAR).head, (VAR).segment_size);                            \
+  (VAR).tail = (VAR).head;                                                     \
+  atomic_init(&(VAR).segments, 1)
+
+/**
+ * @brief Frees all the segments of the queue `VAR`, from `SRB_INIT_UNBOUNDED`,
+ * spares included
+ */
+#define SRB_FREE_UNBOUNDED(VAR)                                                \
+  do {                                                                         \
+    srb_seq srb_i = atomic_load(&(VAR).spares.head);                           \
+    for (; srb_i != atomic_load(&(VAR).spares.tail); srb_i++) {                \
+      (VAR).tail = (VAR).spares.buffer                                         \
+                       .data[srb_slot(srb_i, (VAR).spares.buffer.size)];       \
+      SRB_FREE_segment((VAR).tail);                                            \
+    }                                                                          \
+    SRB_FREE((VAR).spares);                                                    \
+    while ((VAR).head != NULL) {                                               \
+      (VAR).tail = atomic_load(&(VAR).head->next);                             \
+      SRB_FREE_segment((VAR).head);                                            \
+      (VAR).head = (VAR).tail;                                                 \
+    }                                                                          \
+  } while (1 == 0)
+
+/**
+ * @internal
+ * @brief Messages are framed by a `uint32_t` header, and padded so every
+ * header starts at a multiple of its own size. As long as the buffer size is
+ * a multiple of that too, headers never get split by the wraparound.
+ */
+#define SRB_MSG_ALIGN sizeof(uint32_t)
+/**
+ * @internal
+ * @brief Set in a header that starts padding rather than a message. The rest
+ * of the header is the size of the padding, header included.
+ */
+#define SRB_MSG_PAD UINT32_C(0x80000000)
+/**
+ * @brief The longest message `TYPE##_try_push_msg` takes.
+ */
+#define SRB_MSG_MAX ((size_t)SRB_MSG_PAD - 2 * SRB_MSG_ALIGN)
+
+/**
+ * @internal
+ * @returns the number of bytes a message of `len` bytes takes up, header and
+ * padding included
+ */
+static inline size_t srb_msg_record(size_t len) {
+  return (SRB_MSG_ALIGN + len + SRB_MSG_ALIGN - 1) / SRB_MSG_ALIGN *
+         SRB_MSG_ALIGN;
+}
+
+/**
+ * @internal
+ * @brief Turns `len` reserved bytes at `at` into padding.
+ */
+static inline void srb_msg_pad(char *at, size_t len) {
+  if (len > 0) {
+    uint32_t header = SRB_MSG_PAD | (uint32_t)len;
+    memcpy(at, &header, sizeof(header));
+  }
+}
+
+/**
+ * @brief Declares functions to use the `char` ringbuffer `TYPE` for whole
+ * messages instead of a stream of bytes.
+ *
+ * `TYPE` can be any flavour of ringbuffer with `char` elements, and its size
+ * must be a multiple of 4. Every message is pushed with a single reservation,
+ * so messages from different producers never interleave. It's kept in one
+ * piece: a message that would wrap around the end of the buffer is pushed
+ * again at the start, and the space it would have taken becomes padding. The
+ * popping side skips the padding on its own. That can take up to two extra
+ * messages' worth of space, so make the ringbuffer a few times bigger than the
+ * longest message, or use `SRB_MIRROR`, where nothing wraps.
+ *
+ * - `TYPE##_try_push_msg(s, msg, len)`: pushes a message of `len` bytes, or
+ *   fails if there's no room for it.
+ * - `TYPE##_try_pop_msg(s, buf, cap, &len)`: pops the next message into `buf`,
+ *   which has room for `cap` bytes, and sets `len` to its length. Fails,
+ *   returning 1, if there is no message. Fails, returning 2 and leaving the
+ *   message where it is, if it's longer than `cap`, but still sets `len`.
+ * - `TYPE##_peek_msg_len(s, &len)`: sets `len` to the length of the next
+ *   message without popping it, or fails if there is no message.
+ *
+ * Popping and peeking look at the next message before reserving it, so they
+ * must only ever be called from one thread at a time. Don't mix them with
+ * ordinary pushes and pops on the same ringbuffer.
+ *
+ * @param TYPE the ringbuffer type, which must have `char` elements
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_MSG(LINKAGE, TYPE)                                            \
+  srb_maybe_unused LINKAGE int TYPE##_try_push_msg(TYPE *s, const void *msg,   \
+                                                   size_t len);                \
+  srb_maybe_unused LINKAGE int TYPE##_try_pop_msg(TYPE *s, void *buf,          \
+                                                  size_t cap, size_t *len);    \
+  srb_maybe_unused LINKAGE int TYPE##_peek_msg_len(TYPE *s, size_t *len);
+
+/**
+ * @brief Defines the functions declared by `SRB_DECL_MSG`. Must come after the
+ * ringbuffer's own definition.
+ *
+ * @see SRB_DECL_MSG
+ */
+#define SRB_DEF_MSG(LINKAGE, TYPE)                                             \
+  LINKAGE int TYPE##_try_push_msg(TYPE *s, const void *msg, size_t len) {      \
+    assert(s->buffer.size % SRB_MSG_ALIGN == 0);                               \
+    size_t n = srb_msg_record(len);                                            \
+    if (len > SRB_MSG_MAX || n > TYPE##_capacity(s)) {                         \
+      return 1;                                                                \
+    }                                                                          \
+    srb_char_slice first, second;                                              \
+    for (;;) {                                                                 \
+      SRB_TRY(TYPE##_try_reserve_push(s, n, &first, &second));                 \
+      if (second.size == 0) {                                                  \
+        break;                                                                 \
+      }                                                                        \
+      /* Both halves are a multiple of SRB_MSG_ALIGN, so each has room for a   \
+       * header. Pad them out, and try again from the start of the buffer. */  \
+      srb_msg_pad(first.data, first.size);                                     \
+      srb_msg_pad(second.data, second.size);                                   \
+      TYPE##_commit_push(s, first, second);                                    \
+    }                                                                          \
+    uint32_t header = (uint32_t)len;                                           \
+    memcpy(first.data, &header, sizeof(header));                               \
+    SRB_COPY_PUSH(&first.data[SRB_MSG_ALIGN], msg, len);                       \
+    TYPE##_commit_push(s, first, second);                                      \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  /**                                                                          \
+   * @internal                                                                 \
+   * @brief Skips any padding, then reads the header of the next message into  \
+   * `len`, and its record size into `n`.                                      \
+   */                                                                          \
+  static int TYPE##_next_msg(TYPE *s, size_t *len, size_t *n) {                \
+    srb_char_slice first, second;                                              \
+    for (;;) {                                                                 \
+      TYPE##_peek_pop(s, &first, &second);                                     \
+      if (first.size < SRB_MSG_ALIGN) {                                        \
+        return 1;                                                              \
+      }                                                                        \
+      uint32_t header;                                                         \
+      memcpy(&header, first.data, sizeof(header));                             \
+      if ((header & SRB_MSG_PAD) == 0) {                                       \
+        *len = header;                                                         \
+        *n = srb_msg_record(header);                                           \
+        /* Pushes publish whole records, so the rest is there too */           \
+        return 0;                                                              \
+      }                                                                        \
+      SRB_TRY(TYPE##_try_reserve_pop(s, header & ~SRB_MSG_PAD, &first,         \
+                                     &second));                                \
+      TYPE##_release_pop(s, first, second);                                    \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_try_pop_msg(TYPE *s, void *buf, size_t cap,               \
+                                 size_t *len) {                                \
+    size_t n;                                                                  \
+    SRB_TRY(TYPE##_next_msg(s, len, &n));                                      \
+    if (*len > cap) {                                                          \
+      return 2;                                                                \
+    }                                                                          \
+    srb_char_slice first, second;                                              \
+    SRB_TRY(TYPE##_try_reserve_pop(s, n, &first, &second));                    \
+    SRB_COPY_POP(buf, &first.data[SRB_MSG_ALIGN], *len);                       \
+    TYPE##_release_pop(s, first, second);                                      \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE int TYPE##_peek_msg_len(TYPE *s, size_t *len) {                      \
+    size_t n;                                                                  \
+    return TYPE##_next_msg(s, len, &n);                                        \
+  }
+
+#ifdef SRB_FDIO
+#if !defined(__unix__) && !defined(__APPLE__)
+#error "SRB_FDIO needs readv and writev, which are POSIX-only"
+#endif // !__unix__ && !__APPLE__
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * @internal
+ * @brief Points `iov` at up to `max` bytes of the regions `a` and `b`.
+ *
+ * @returns how many of `iov` it used
+ */
+static inline int srb_fd_iov(struct iovec iov[2], char *a, size_t a_size,
+                             char *b, size_t b_size, size_t max) {
+  /* What fits in the ssize_t the system call returns, without needing the
+   * POSIX-only SSIZE_MAX */
+  if (max > (size_t)-1 >> 1) {
+    max = (size_t)-1 >> 1;
+  }
+  int cnt = 0;
+  if (a_size > 0 && max > 0) {
+    iov[cnt].iov_base = a;
+    iov[cnt].iov_len = a_size < max ? a_size : max;
+    max -= iov[cnt++].iov_len;
+  }
+  if (b_size > 0 && max > 0) {
+    iov[cnt].iov_base = b;
+    iov[cnt].iov_len = b_size < max ? b_size : max;
+    cnt++;
+  }
+  return cnt;
+}
+
+/**
+ * @brief Declares functions to move bytes straight between the `char`
+ * ringbuffer `TYPE` and a file descriptor, with no copy in between.
+ *
+ * `TYPE` can be any flavour of ringbuffer with `char` elements. Both functions
+ * hand the one or two regions of the buffer they cover to a single
+ * `writev`/`readv`, and then only pop or push as many bytes as it actually
+ * moved, so short reads and writes lose nothing.
+ *
+ * - `TYPE##_write_to_fd(s, fd, max)`: writes up to `max` bytes from the front
+ *   of the ringbuffer to `fd`, and pops what was written. Returns what `writev`
+ *   did: the number of bytes, or -1 with `errno` set, in which case nothing is
+ *   popped. Returns 0 if the ringbuffer is empty.
+ * - `TYPE##_read_from_fd(s, fd, max)`: reads up to `max` bytes from `fd` into
+ *   the free space of the ringbuffer, and pushes what was read. Returns what
+ *   `readv` did: the number of bytes, 0 at end of file, or -1 with `errno` set.
+ *   Returns -1 with `errno` set to `ENOBUFS` if the ringbuffer is full.
+ *
+ * Both look at the ringbuffer before reserving anything, since they can't know
+ * how much they'll move until the system call returns. So while
+ * `TYPE##_write_to_fd` runs, it must be the only thing popping from the
+ * ringbuffer, and while `TYPE##_read_from_fd` runs, the only thing pushing.
+ *
+ * Only there if `SRB_FDIO` is defined, on POSIX systems.
+ *
+ * @param TYPE the ringbuffer type, which must have `char` elements
+ * @param LINKAGE the linkage specifier for the functions to declare
+ */
+#define SRB_DECL_FDIO(LINKAGE, TYPE)                                           \
+  srb_maybe_unused LINKAGE ssize_t TYPE##_write_to_fd(TYPE *s, int fd,         \
+                                                      size_t max);             \
+  srb_maybe_unused LINKAGE ssize_t TYPE##_read_from_fd(TYPE *s, int fd,        \
+                                                       size_t max);
+
+/**
+ * @brief Defines the functions declared by `SRB_DECL_FDIO`. Must come after
+ * the ringbuffer's own definition.
+ *
+ * @see SRB_DECL_FDIO
+ */
+#define SRB_DEF_FDIO(LINKAGE, TYPE)                                            \
+  LINKAGE ssize_t TYPE##_write_to_fd(TYPE *s, int fd, size_t max) {            \
+    srb_char_slice first, second;                                              \
+    TYPE##_peek_pop(s, &first, &second);                                       \
+    struct iovec iov[2];                                                       \
+    int cnt = srb_fd_iov(iov, first.data, first.size, second.data,             \
+                         second.size, max);                                    \
+    if (cnt == 0) {                                                            \
+      return 0;                                                                \
+    }                                                                          \
+    ssize_t n = writev(fd, iov, cnt);                                          \
+    if (n > 0) {                                                               \
+      /* Nobody else pops, so this is the front of what we peeked at */        \
+      SRB_UNWRAP(TYPE##_try_reserve_pop(s, (size_t)n, &first, &second));       \
+      TYPE##_release_pop(s, first, second);                                    \
+    }                                                                          \
+    return n;                                                                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE ssize_t TYPE##_read_from_fd(TYPE *s, int fd, size_t max) {           \
+    srb_char_slice first, second;                                              \
+    TYPE##_peek_push(s, &first, &second);                                      \
+    if (first.size == 0) {                                                     \
+      errno = ENOBUFS;                                                         \
+      return -1;                                                               \
+    }                                                                          \
+    struct iovec iov[2];                                                       \
+    int cnt = srb_fd_iov(iov, first.data, first.size, second.data,             \
+                         second.size, max);                                    \
+    if (cnt == 0) {                                                            \
+      return 0;                                                                \
+    }                                                                          \
+    ssize_t n = readv(fd, iov, cnt);                                           \
+    if (n > 0) {                                                               \
+      /* Nobody else pushes, so this is the front of what we peeked at, which  \
+       * readv just filled in */                                               \
+      SRB_UNWRAP(TYPE##_try_reserve_push(s, (size_t)n, &first, &second));      \
+      TYPE##_commit_push(s, first, second);                                    \
+    }                                                                          \
+    return n;                                                                  \
   }
+#endif // SRB_FDIO
 
 #endif // SILLY_RINGBUFFER_H
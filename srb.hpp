@@ -0,0 +1,446 @@
+#ifndef SILLY_RINGBUFFER_HPP
+#define SILLY_RINGBUFFER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @file
+ * @brief The ringbuffers of `srb.h` for C++, with elements of any type.
+ *
+ * The C macros copy elements around as bytes, so they only take trivially
+ * copyable types, and they're built on C11 `_Atomic`, which C++ can't include.
+ * `srb::ring<T, Policy>` uses the same free-running counters as
+ * `SRB_DECL_SPSC`/`SRB_DECL_MPSC` on top of `std::atomic`, and constructs
+ * elements in place in their slots, moves them out on pop, and destroys
+ * whatever's left when the ring goes away.
+ */
+/**
+ * @brief How many times a thread waiting for another one to publish pauses
+ * before it starts yielding its CPU instead, as in `srb.h`.
+ */
+#ifndef SRB_BACKOFF
+#define SRB_BACKOFF 64
+#endif // SRB_BACKOFF
+
+namespace srb {
+
+/**
+ * @brief Picks a ring's capacity, how many threads may use each side, and its
+ * layout, all at compile time, so that a side with one thread does no
+ * read-modify-writes and waits for nobody.
+ *
+ * @tparam Capacity the number of elements, kept inside the ring itself, or 0
+ * to allocate them when the ring is constructed
+ * @tparam ManyProducers whether several threads may push at once
+ * @tparam ManyConsumers whether several threads may pop at once
+ * @tparam CacheLine the cache line size to keep the two sides apart by, or 0
+ * to pack them together, like `srb.h` without `SRB_CACHELINE`
+ */
+template <std::size_t Capacity = 0, bool ManyProducers = true,
+          bool ManyConsumers = true, std::size_t CacheLine = 64>
+struct policy {
+  static constexpr std::size_t capacity = Capacity;
+  static constexpr bool many_producers = ManyProducers;
+  static constexpr bool many_consumers = ManyConsumers;
+  static constexpr std::size_t cache_line = CacheLine;
+};
+
+/** @brief One producer, one consumer, like `SRB_DECL_SPSC`. */
+template <std::size_t Capacity = 0>
+using spsc = policy<Capacity, false, false>;
+/** @brief Any number of producers, one consumer, like `SRB_DECL_MPSC`. */
+template <std::size_t Capacity = 0>
+using mpsc = policy<Capacity, true, false>;
+/** @brief Any number of producers and consumers. */
+template <std::size_t Capacity = 0>
+using mpmc = policy<Capacity, true, true>;
+
+namespace detail {
+
+/**
+ * @brief Tells the CPU we're in a spin loop, like `srb_pause`.
+ */
+inline void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/**
+ * @brief Spins a while, then starts giving the CPU away, so that a thread
+ * we're waiting on that got descheduled can run.
+ */
+inline void backoff(unsigned &spins) {
+  if (spins < SRB_BACKOFF) {
+    spins++;
+    pause();
+  } else {
+    std::this_thread::yield();
+  }
+}
+
+/**
+ * @brief Uninitialized room for one `T`.
+ */
+template <class T> struct slot {
+  alignas(T) std::byte bytes[sizeof(T)];
+};
+
+/**
+ * @brief Where the elements live: inside the ring if the capacity is known at
+ * compile time, on the heap otherwise.
+ */
+template <class T, std::size_t Capacity> struct storage {
+  slot<T> slots[Capacity];
+
+  explicit storage() = default;
+  static constexpr std::size_t size() { return Capacity; }
+  slot<T> &at(std::uint64_t seq) { return slots[seq % Capacity]; }
+};
+
+template <class T> struct storage<T, 0> {
+  std::unique_ptr<slot<T>[]> slots;
+  std::size_t mask;
+
+  /** @brief Rounds `capacity` up to a power of two, to index with a mask. */
+  explicit storage(std::size_t capacity)
+      : slots(new slot<T>[std::bit_ceil(std::max<std::size_t>(capacity, 1))]),
+        mask(std::bit_ceil(std::max<std::size_t>(capacity, 1)) - 1) {}
+  std::size_t size() const { return mask + 1; }
+  slot<T> &at(std::uint64_t seq) { return slots[seq & mask]; }
+};
+
+/**
+ * @brief The counters of one side of a ring.
+ */
+struct side {
+  /** @brief Sequence number of the next slot to claim. */
+  std::atomic<std::uint64_t> commit{0};
+  /** @brief Sequence number of the first slot not yet finished with. */
+  std::atomic<std::uint64_t> valid{0};
+  /**
+   * @brief Our last look at the other side's `valid`. Only ever too old.
+   * Passed on with release/acquire, so that a thread going by another's look
+   * is ordered after the other side is done too.
+   */
+  std::atomic<std::uint64_t> cache{0};
+};
+
+/**
+ * @brief A `side` alone on its cache lines, unless `CacheLine` is 0.
+ */
+template <std::size_t CacheLine>
+struct alignas(CacheLine ? CacheLine : alignof(side)) padded_side : side {};
+
+} // namespace detail
+
+/**
+ * @brief A lock-free ringbuffer of `T`.
+ *
+ * Pushes and pops first claim slots on their side's `commit` counter (a
+ * compare-exchange if that side has several threads, a plain store if not),
+ * then construct or move out the elements, then publish by moving their side's
+ * `valid` counter past them. With several threads on a side, they publish in
+ * the order they claimed, so a thread descheduled in between holds up the
+ * others on its side. The counters are free-running, so every slot can be
+ * used.
+ *
+ * `T` must be nothrow move constructible, since a claimed slot can't be given
+ * back. Pushes that construct `T` from arguments that might throw do so
+ * before claiming anything, and move it in after. Rings can't be copied or
+ * moved.
+ *
+ * @tparam Policy an `srb::policy`
+ */
+template <class T, class Policy = mpmc<>> class ring {
+  static_assert(std::is_nothrow_move_constructible_v<T> &&
+                    std::is_nothrow_destructible_v<T>,
+                "elements have to move and destroy without throwing");
+
+  static constexpr bool many_producers = Policy::many_producers;
+  static constexpr bool many_consumers = Policy::many_consumers;
+
+public:
+  /**
+   * @brief Makes an empty ring with room for at least `capacity` elements,
+   * rounded up to a power of two. Only for rings with a capacity of 0 in
+   * their `Policy`.
+   */
+  explicit ring(std::size_t capacity)
+    requires(Policy::capacity == 0)
+      : storage_(capacity) {}
+
+  /**
+   * @brief Makes an empty ring with room for `Policy::capacity` elements.
+   */
+  ring()
+    requires(Policy::capacity != 0)
+  = default;
+
+  ring(const ring &) = delete;
+  ring &operator=(const ring &) = delete;
+
+  /**
+   * @brief Destroys every element still in the ring. Nobody may be using it.
+   */
+  ~ring() {
+    std::uint64_t tail = producers_.valid.load(std::memory_order_acquire);
+    for (std::uint64_t i = consumers_.valid.load(std::memory_order_relaxed);
+         i != tail; i++) {
+      element(i)->~T();
+    }
+  }
+
+  /**
+   * @brief Constructs an element from `args` at the end of the ring.
+   *
+   * @returns false if it was full, in which case nothing was constructed
+   */
+  template <class... Args> bool try_emplace(Args &&...args) {
+    if constexpr (std::is_nothrow_constructible_v<T, Args...>) {
+      std::uint64_t start;
+      if (claim_push(1, start) == 0) {
+        return false;
+      }
+      ::new (element(start)) T(std::forward<Args>(args)...);
+      publish<many_producers>(producers_, start, 1);
+      return true;
+    } else {
+      /* Might throw, so do it before there's a slot to give back */
+      T value(std::forward<Args>(args)...);
+      return try_emplace(std::move(value));
+    }
+  }
+
+  /** @brief Copies `value` to the end of the ring, if there's room. */
+  bool try_push(const T &value) { return try_emplace(value); }
+  /** @brief Moves `value` to the end of the ring, if there's room. */
+  bool try_push(T &&value) { return try_emplace(std::move(value)); }
+
+  /**
+   * @brief Copies as many of `values` as fit to the end of the ring, in one
+   * go.
+   *
+   * @returns how many were pushed
+   */
+  std::size_t try_push_some(std::span<const T> values) {
+    static_assert(std::is_nothrow_copy_constructible_v<T>,
+                  "copies have to be made before claiming slots, use "
+                  "try_emplace");
+    return push_range(values);
+  }
+
+  /**
+   * @brief Moves as many of `values` as fit to the end of the ring, in one
+   * go, leaving them moved-from.
+   *
+   * @returns how many were pushed
+   */
+  std::size_t try_move_some(std::span<T> values) { return push_range(values); }
+
+  /**
+   * @brief Moves the first element out of the ring.
+   *
+   * @returns the element, or nothing if the ring was empty
+   */
+  std::optional<T> try_pop() {
+    std::uint64_t start;
+    if (claim_pop(1, start) == 0) {
+      return std::nullopt;
+    }
+    std::optional<T> out(std::move(*element(start)));
+    element(start)->~T();
+    publish<many_consumers>(consumers_, start, 1);
+    return out;
+  }
+
+  /**
+   * @brief Moves the first element out of the ring into `out`.
+   *
+   * @returns false if the ring was empty, leaving `out` alone
+   */
+  bool try_pop(T &out) { return try_pop_some(std::span<T>(&out, 1)) == 1; }
+
+  /**
+   * @brief Moves as many elements as there are, up to `out.size()`, into the
+   * start of `out`, in one go.
+   *
+   * @returns how many were popped
+   */
+  std::size_t try_pop_some(std::span<T> out) {
+    static_assert(std::is_nothrow_move_assignable_v<T>,
+                  "elements have to be move-assigned without throwing");
+    if (out.empty()) {
+      return 0;
+    }
+    std::uint64_t start;
+    std::size_t n = claim_pop(out.size(), start);
+    for (std::size_t i = 0; i < n; i++) {
+      T *e = element(start + i);
+      out[i] = std::move(*e);
+      e->~T();
+    }
+    if (n > 0) {
+      publish<many_consumers>(consumers_, start, n);
+    }
+    return n;
+  }
+
+  /**
+   * @returns how many elements are in the ring right now. Only a snapshot if
+   * anyone else is using it.
+   */
+  std::size_t len() const {
+    std::uint64_t head = consumers_.valid.load(std::memory_order_acquire);
+    std::uint64_t tail = producers_.valid.load(std::memory_order_acquire);
+    std::uint64_t len = tail - head;
+    return len > capacity() ? capacity() : static_cast<std::size_t>(len);
+  }
+
+  /** @returns how many elements the ring can hold. */
+  std::size_t capacity() const { return storage_.size(); }
+
+private:
+  T *element(std::uint64_t seq) {
+    return std::launder(reinterpret_cast<T *>(storage_.at(seq).bytes));
+  }
+
+  template <class Range> std::size_t push_range(Range values) {
+    if (values.empty()) {
+      return 0;
+    }
+    std::uint64_t start;
+    std::size_t n = claim_push(values.size(), start);
+    for (std::size_t i = 0; i < n; i++) {
+      ::new (element(start + i)) T(std::move(values[i]));
+    }
+    if (n > 0) {
+      publish<many_producers>(producers_, start, n);
+    }
+    return n;
+  }
+
+  /**
+   * @brief Claims up to `max` free slots.
+   *
+   * @returns how many, 0 if the ring was full
+   */
+  std::size_t claim_push(std::size_t max, std::uint64_t &start) {
+    const std::size_t size = capacity();
+    /* Only look at the consumers' counter when our last look doesn't leave
+     * enough room, as that's the cache line they're writing to */
+    start = producers_.commit.load(std::memory_order_relaxed);
+    for (;;) {
+      std::uint64_t used =
+          start - producers_.cache.load(std::memory_order_acquire);
+      if (used > size || size - used < max) {
+        /* Pairs with the release in publish, so that pops are done with the
+         * slots before we reuse them */
+        std::uint64_t head = consumers_.valid.load(std::memory_order_acquire);
+        producers_.cache.store(head, std::memory_order_release);
+        used = start - head;
+        if (used > size) {
+          /* Another producer claimed and published since we loaded start */
+          start = producers_.commit.load(std::memory_order_relaxed);
+          continue;
+        }
+        if (used == size) {
+          return 0;
+        }
+      }
+      std::size_t n = std::min<std::size_t>(size - used, max);
+      if (claim<many_producers>(producers_, start, n)) {
+        return n;
+      }
+    }
+  }
+
+  /**
+   * @brief Claims up to `max` filled slots.
+   *
+   * @returns how many, 0 if the ring was empty
+   */
+  std::size_t claim_pop(std::size_t max, std::uint64_t &start) {
+    const std::size_t size = capacity();
+    start = consumers_.commit.load(std::memory_order_relaxed);
+    for (;;) {
+      std::uint64_t used =
+          consumers_.cache.load(std::memory_order_acquire) - start;
+      if (used > size || used < max) {
+        /* Pairs with the release in publish, so that the elements are there */
+        std::uint64_t tail = producers_.valid.load(std::memory_order_acquire);
+        consumers_.cache.store(tail, std::memory_order_release);
+        used = tail - start;
+        if (used > size) {
+          /* Another consumer claimed and published since we loaded start */
+          start = consumers_.commit.load(std::memory_order_relaxed);
+          continue;
+        }
+        if (used == 0) {
+          return 0;
+        }
+      }
+      std::size_t n = std::min<std::size_t>(used, max);
+      if (claim<many_consumers>(consumers_, start, n)) {
+        return n;
+      }
+    }
+  }
+
+  /**
+   * @brief Moves `s.commit` from `start` to `start + n`.
+   *
+   * @returns false if someone else moved it first, and loads where it is now
+   * into `start`
+   */
+  template <bool Many>
+  static bool claim(detail::side &s, std::uint64_t &start, std::size_t n) {
+    if constexpr (Many) {
+      return s.commit.compare_exchange_weak(start, start + n,
+                                            std::memory_order_relaxed,
+                                            std::memory_order_relaxed);
+    } else {
+      s.commit.store(start + n, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  /**
+   * @brief Moves `s.valid` past the `n` slots from `start`, after waiting for
+   * everyone who claimed before us on that side.
+   */
+  template <bool Many>
+  static void publish(detail::side &s, std::uint64_t start, std::size_t n) {
+    if constexpr (Many) {
+      /* Acquire, so whoever sees our release sees what they published too */
+      unsigned spins = 0;
+      while (s.valid.load(std::memory_order_acquire) != start) {
+        detail::backoff(spins);
+      }
+    }
+    s.valid.store(start + n, std::memory_order_release);
+  }
+
+  detail::storage<T, Policy::capacity> storage_;
+  /* Consumer side */
+  detail::padded_side<Policy::cache_line> consumers_;
+  /* Producer side */
+  detail::padded_side<Policy::cache_line> producers_;
+};
+
+} // namespace srb
+
+#endif // SILLY_RINGBUFFER_HPP
@@ -0,0 +1,68 @@
+#define SRB_MMAP
+#define SRB_MIRROR
+#include "srb.h"
+#include "flavours.h"
+
+static void check_alloc(const flavour *f, size_t n, srb_alloc_opts opts) {
+  any_ring r;
+  f->init_ex(&r, n, opts);
+  assert(f->mapped(&r) >= n * sizeof(size_t));
+  assert((uintptr_t)f->buffer(&r).data % (size_t)sysconf(_SC_PAGESIZE) == 0);
+  for (size_t i = 0; i < 3 * f->capacity(&r); i++) {
+    f->push_one(&r, i);
+    assert(f->pop_one(&r) == i);
+  }
+  f->free(&r);
+}
+
+int main() {
+  srb_alloc_opts opts[] = {
+      {0},
+      {.flags = SRB_ALLOC_PREFAULT},
+      {.flags = SRB_ALLOC_THP},
+  };
+  for (size_t i = 0; i < FLAVOURS; i++) {
+    for (size_t j = 0; j < sizeof(opts) / sizeof(*opts); j++) {
+      check_alloc(&flavours[i], 1000, opts[j]);
+    }
+  }
+
+  // Huge pages come aligned to the huge page size, or fall back to ordinary
+  // pages if there are none
+  size_t mapped;
+  void *p = srb_alloc_ex(1 << 20,
+                         (srb_alloc_opts){.flags = SRB_ALLOC_THP |
+                                                   SRB_ALLOC_PREFAULT},
+                         &mapped);
+  assert(p != NULL && mapped == SRB_HUGEPAGE_SIZE);
+  assert((uintptr_t)p % SRB_HUGEPAGE_SIZE == 0);
+  munmap(p, mapped);
+  p = srb_alloc_ex(100, (srb_alloc_opts){.flags = SRB_ALLOC_HUGETLB}, &mapped);
+  assert(p != NULL && mapped >= 100);
+  munmap(p, mapped);
+
+  // Node 0 always exists, unless the kernel has no NUMA support at all
+  p = srb_alloc_ex(100, (srb_alloc_opts){.flags = SRB_ALLOC_NODE, .node = 0},
+                   &mapped);
+  if (p != NULL) {
+    munmap(p, mapped);
+    check_alloc(&flavours[0], 1000,
+                (srb_alloc_opts){.flags = SRB_ALLOC_NODE, .node = 0});
+  }
+  // But nodes that can't exist fail
+  srb_alloc_opts missing = {.flags = SRB_ALLOC_NODE, .node = -1};
+  assert(srb_alloc_ex(100, missing, &mapped) == NULL);
+  missing.node = 1 << 20;
+  assert(srb_alloc_ex(100, missing, &mapped) == NULL);
+
+  // Other storage is still freed the usual way
+  queue q;
+  SRB_INIT(q, 10);
+  assert(q.mapped == 0);
+  SRB_FREE(q);
+  SRB_INIT_MIRROR(q, 10);
+  assert(q.mapped == 0);
+  SRB_FREE(q);
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+#include "srb.h"
+#include "flavours.h"
+#include <threads.h>
+
+#define ITERATIONS 200000
+#define WRITERS 4
+#define BURST 64
+
+static queue q;
+
+int writer(void *arg) {
+  size_t id = (size_t)arg;
+  size_t burst[BURST];
+  size_t next = 0;
+  while (next < ITERATIONS) {
+    size_t count = 0;
+    for (; count < BURST && next + count < ITERATIONS; count++) {
+      burst[count] = (next + count) * WRITERS + id;
+    }
+    size_t n;
+    if (queue_try_push_some(&q, (srb_size_t_slice){burst, count}, &n)) {
+      thrd_yield();
+      continue;
+    }
+    assert(n > 0 && n <= count);
+    next += n;
+  }
+  return 0;
+}
+
+#define SIZE 8
+
+static void check_some(const flavour *f) {
+  any_ring r;
+  size_t in[SIZE + 2];
+  size_t out[SIZE + 2];
+  size_t n;
+  for (size_t i = 0; i < SIZE + 2; i++) {
+    in[i] = i;
+  }
+  f->init(&r, SIZE);
+  size_t cap = f->capacity(&r);
+  // Nothing to pop
+  assert(f->try_pop_some(&r, (srb_size_t_slice){out, 4}, &n) != 0);
+  assert(n == 0);
+  // Only part of it fits
+  assert(f->try_push_some(&r, (srb_size_t_slice){in, SIZE + 2}, &n) == 0);
+  assert(n == cap);
+  assert(f->try_push_some(&r, (srb_size_t_slice){in, 1}, &n) != 0);
+  // Only part of what's asked for is there, and pops wrap
+  assert(f->try_pop_some(&r, (srb_size_t_slice){out, 2}, &n) == 0);
+  assert(n == 2 && out[0] == 0 && out[1] == 1);
+  assert(f->try_push_some(&r, (srb_size_t_slice){in, 2}, &n) == 0);
+  assert(n == 2);
+  assert(f->try_pop_some(&r, (srb_size_t_slice){out, SIZE + 2}, &n) == 0);
+  assert(n == cap);
+  for (size_t i = 0; i < cap - 2; i++) {
+    assert(out[i] == i + 2);
+  }
+  assert(out[cap - 2] == 0 && out[cap - 1] == 1);
+  // Asking for nothing always works
+  assert(f->try_pop_some(&r, (srb_size_t_slice){out, 0}, &n) == 0);
+  assert(n == 0);
+  f->free(&r);
+}
+
+int main() {
+  for (size_t i = 0; i < FLAVOURS; i++) {
+    check_some(&flavours[i]);
+  }
+
+  // Producers and the consumer both move whole bursts at a time
+  SRB_INIT(q, 256);
+  thrd_t ws[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], writer, (void *)i) == thrd_success);
+  }
+  size_t expected[WRITERS] = {0};
+  size_t burst[BURST];
+  for (size_t total = 0; total < ITERATIONS * WRITERS;) {
+    size_t n;
+    if (queue_try_pop_some(&q, (srb_size_t_slice){burst, BURST}, &n)) {
+      thrd_yield();
+      continue;
+    }
+    for (size_t i = 0; i < n; i++) {
+      size_t id = burst[i] % WRITERS;
+      assert(burst[i] / WRITERS == expected[id]);
+      expected[id]++;
+    }
+    total += n;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  SRB_FREE(q);
+
+  return 0;
+}
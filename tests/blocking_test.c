@@ -0,0 +1,137 @@
+#define SRB_BLOCKING
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+#include <time.h>
+
+SRB_DECL(static, queue, size_t);
+SRB_DEF(static, queue, size_t);
+SRB_DECL_SPSC(static, spsc, size_t);
+SRB_DEF_SPSC(static, spsc, size_t);
+SRB_DECL_MPSC(static, mpsc, size_t);
+SRB_DEF_MPSC(static, mpsc, size_t);
+
+#define ITERATIONS 100000
+#define WRITERS 4
+
+static queue q;
+static spsc sq;
+static mpsc mq;
+
+static struct timespec after_ms(long ms) {
+  struct timespec t;
+  timespec_get(&t, TIME_UTC);
+  t.tv_nsec += ms * 1000000;
+  t.tv_sec += t.tv_nsec / 1000000000;
+  t.tv_nsec %= 1000000000;
+  return t;
+}
+
+static double elapsed_ms(struct timespec since) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (now.tv_sec - since.tv_sec) * 1e3 +
+         (now.tv_nsec - since.tv_nsec) / 1e6;
+}
+
+int late_writer(void *arg) {
+  (void)arg;
+  thrd_sleep(&(struct timespec){.tv_nsec = 20000000}, NULL);
+  queue_push_wait_one(&q, 42);
+  return 0;
+}
+
+int queue_writer(void *arg) {
+  for (size_t i = (size_t)arg; i < ITERATIONS; i += WRITERS) {
+    queue_push_wait_one(&q, i);
+  }
+  return 0;
+}
+
+int spsc_writer(void *arg) {
+  (void)arg;
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    spsc_push_wait_one(&sq, i);
+  }
+  return 0;
+}
+
+int mpsc_writer(void *arg) {
+  for (size_t i = (size_t)arg; i < ITERATIONS; i += WRITERS) {
+    mpsc_push_wait_one(&mq, i);
+  }
+  return 0;
+}
+
+int main() {
+  SRB_INIT(q, 4);
+  size_t x;
+  srb_size_t_slice one = {&x, 1};
+
+  // Timed waits give up once the deadline passes
+  struct timespec start;
+  timespec_get(&start, TIME_UTC);
+  struct timespec deadline = after_ms(30);
+  assert(queue_pop_until(&q, one, &deadline) != 0);
+  assert(elapsed_ms(start) >= 29);
+  size_t vs[] = {1, 2, 3};
+  queue_push(&q, (srb_size_t_slice){vs, 3});
+  deadline = after_ms(10);
+  assert(queue_push_until(&q, one, &deadline) != 0);
+  // Things that could never fit fail straight away
+  size_t big[4];
+  assert(queue_pop_until(&q, (srb_size_t_slice){big, 4}, NULL) != 0);
+  assert(queue_pop_until(&q, (srb_size_t_slice){vs, 3}, &deadline) == 0);
+  assert(vs[0] == 1 && vs[1] == 2 && vs[2] == 3);
+
+  // A sleeping consumer gets woken up by a push
+  thrd_t w;
+  assert(thrd_create(&w, late_writer, NULL) == thrd_success);
+  deadline = after_ms(5000);
+  assert(queue_pop_until(&q, one, &deadline) == 0);
+  assert(x == 42);
+  assert(thrd_join(w, NULL) == thrd_success);
+  SRB_FREE(q);
+
+  // Small buffers, so both sides spend time asleep
+  SRB_INIT(q, 4);
+  thrd_t ws[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], queue_writer, (void *)i) == thrd_success);
+  }
+  size_t last[WRITERS] = {0};
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    x = queue_pop_wait_one(&q);
+    assert(x >= last[x % WRITERS]);
+    last[x % WRITERS] = x;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  SRB_FREE(q);
+
+  SRB_INIT_SPSC(sq, 4);
+  assert(thrd_create(&w, spsc_writer, NULL) == thrd_success);
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    assert(spsc_pop_wait_one(&sq) == i);
+  }
+  assert(thrd_join(w, NULL) == thrd_success);
+  SRB_FREE(sq);
+
+  SRB_INIT_MPSC(mq, 4);
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], mpsc_writer, (void *)i) == thrd_success);
+  }
+  size_t mlast[WRITERS] = {0};
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    x = mpsc_pop_wait_one(&mq);
+    assert(x >= mlast[x % WRITERS]);
+    mlast[x % WRITERS] = x;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  SRB_FREE(mq);
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+
+SRB_DECL_SLICE(size_t);
+SRB_DECL_BROADCAST(static, bcast, size_t);
+SRB_DEF_BROADCAST(static, bcast, size_t);
+
+#define ITERATIONS 200000
+#define READERS 3
+
+static bcast q;
+static atomic_int done;
+
+// Reads everything, in place, from the start
+int reader(void *arg) {
+  size_t c = (size_t)arg;
+  size_t expected = 0;
+  while (expected < ITERATIONS) {
+    srb_size_t_slice first, second;
+    if (bcast_try_reserve_read(&q, c, 16, &first, &second)) {
+      thrd_yield();
+      continue;
+    }
+    for (size_t i = 0; i < first.size; i++) {
+      assert(first.data[i] == expected++);
+    }
+    for (size_t i = 0; i < second.size; i++) {
+      assert(second.data[i] == expected++);
+    }
+    bcast_release_read(&q, c, first, second);
+  }
+  return 0;
+}
+
+// Keeps joining and leaving while the others read
+int dropper(void *arg) {
+  (void)arg;
+  while (!atomic_load(&done)) {
+    size_t c, v, last;
+    if (bcast_subscribe(&q, &c)) {
+      thrd_yield();
+      continue;
+    }
+    // Whatever it sees, it sees in order and with no gaps
+    for (size_t i = 0; i < 100 && !atomic_load(&done);) {
+      if (bcast_try_read_one(&q, c, &v)) {
+        thrd_yield();
+        continue;
+      }
+      assert(i == 0 || v == last + 1);
+      last = v;
+      i++;
+    }
+    bcast_unsubscribe(&q, c);
+  }
+  return 0;
+}
+
+int main() {
+  bcast b;
+  size_t c1, c2, c3, v;
+  SRB_INIT_BROADCAST(b, 4, 2);
+  size_t cap = bcast_capacity(&b);
+  // Nobody's listening, so nothing holds the producer up
+  for (size_t i = 0; i < 3 * cap; i++) {
+    bcast_push_one(&b, i);
+  }
+  SRB_UNWRAP(bcast_subscribe(&b, &c1));
+  SRB_UNWRAP(bcast_subscribe(&b, &c2));
+  assert(bcast_subscribe(&b, &c3) == 1);
+  // New cursors start at the tail
+  assert(bcast_len(&b, c1) == 0 && bcast_try_read_one(&b, c1, &v) == 1);
+  for (size_t i = 0; i < cap; i++) {
+    assert(bcast_try_push_one(&b, i) == 0);
+  }
+  assert(bcast_try_push_one(&b, 0) == 1);
+  // Both cursors see everything
+  for (size_t i = 0; i < cap; i++) {
+    assert(bcast_try_read_one(&b, c1, &v) == 0 && v == i);
+  }
+  assert(bcast_len(&b, c1) == 0 && bcast_len(&b, c2) == cap);
+  // The slowest cursor holds the producer up
+  assert(bcast_try_push_one(&b, 0) == 1);
+  assert(bcast_try_read_one(&b, c2, &v) == 0 && v == 0);
+  assert(bcast_try_push_one(&b, cap) == 0);
+  assert(bcast_try_push_one(&b, 0) == 1);
+  // Until it leaves
+  bcast_unsubscribe(&b, c2);
+  assert(bcast_try_push_one(&b, cap + 1) == 0);
+  assert(bcast_try_read_one(&b, c1, &v) == 0 && v == cap);
+  // Its cursor can be had again
+  SRB_UNWRAP(bcast_subscribe(&b, &c3));
+  assert(c3 == c2 && bcast_len(&b, c3) == 0);
+  // Empty pushes go through, and leave nothing to read
+  assert(bcast_try_push(&b, (srb_size_t_slice){&v, 0}) == 0);
+  assert(bcast_len(&b, c3) == 0 && bcast_try_read_one(&b, c3, &v) == 1);
+  SRB_FREE_BROADCAST(b);
+  assert(b.buffer.data == NULL && b.cursors == NULL);
+
+  // One producer, several readers that each see everything, and one that
+  // comes and goes
+  SRB_INIT_BROADCAST(q, 64, READERS + 1);
+  thrd_t rs[READERS], d;
+  for (size_t i = 0; i < READERS; i++) {
+    size_t c;
+    SRB_UNWRAP(bcast_subscribe(&q, &c));
+    assert(thrd_create(&rs[i], reader, (void *)c) == thrd_success);
+  }
+  assert(thrd_create(&d, dropper, NULL) == thrd_success);
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    while (bcast_try_push_one(&q, i)) {
+      thrd_yield();
+    }
+  }
+  for (size_t i = 0; i < READERS; i++) {
+    assert(thrd_join(rs[i], NULL) == thrd_success);
+  }
+  atomic_store(&done, 1);
+  assert(thrd_join(d, NULL) == thrd_success);
+  SRB_FREE_BROADCAST(q);
+
+  return 0;
+}
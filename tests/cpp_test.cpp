@@ -0,0 +1,205 @@
+#include "srb.hpp"
+#include <cassert>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define ITERATIONS 50000
+#define WRITERS 4
+#define READERS 4
+
+// Counts live instances, to catch leaked or doubly destroyed elements
+struct counted {
+  static inline int live = 0;
+  int value;
+
+  explicit counted(int v) : value(v) { live++; }
+  counted(const counted &o) noexcept : value(o.value) { live++; }
+  counted(counted &&o) noexcept : value(o.value) {
+    o.value = -1;
+    live++;
+  }
+  counted &operator=(const counted &) = default;
+  counted &operator=(counted &&o) noexcept {
+    value = o.value;
+    o.value = -1;
+    return *this;
+  }
+  ~counted() { live--; }
+};
+
+// Constructing might throw, so it has to happen before a slot is claimed
+struct throwing {
+  int value;
+
+  explicit throwing(int v) : value(v) {
+    if (v < 0) {
+      throw v;
+    }
+  }
+  throwing(throwing &&) noexcept = default;
+};
+
+template <class Policy> static void check_counted() {
+  {
+    srb::ring<counted, Policy> r(5);
+    size_t cap = r.capacity();
+    assert(cap >= 5 && !r.try_pop());
+    // Every slot can be used
+    for (size_t i = 0; i < cap; i++) {
+      assert(r.try_emplace((int)i));
+      assert(r.len() == i + 1);
+    }
+    assert(!r.try_emplace(0));
+    assert(counted::live == (int)cap);
+    for (size_t i = 0; i < cap; i++) {
+      assert(r.try_pop()->value == (int)i);
+    }
+    assert(counted::live == 0 && r.len() == 0);
+    // Many laps around the buffer, in batches
+    std::vector<counted> in, out;
+    for (int i = 0; i < 3; i++) {
+      in.emplace_back(i);
+      out.emplace_back(0);
+    }
+    for (size_t i = 0; i < 100 * cap; i++) {
+      assert(r.try_push_some(in) == 3);
+      assert(r.try_pop_some(out) == 3);
+      assert(out[0].value == 0 && out[2].value == 2);
+    }
+    assert(counted::live == 6);
+    // Moved in, and left moved-from
+    assert(r.try_move_some(in) == 3 && in[0].value == -1);
+    counted c(7);
+    assert(r.try_push(std::move(c)) && c.value == -1);
+    assert(counted::live == 11);
+    // Destroyed with the ring
+  }
+  assert(counted::live == 0);
+}
+
+int main() {
+  check_counted<srb::spsc<>>();
+  check_counted<srb::mpsc<>>();
+  check_counted<srb::mpmc<>>();
+  check_counted<srb::policy<0, true, true, 0>>();
+
+  // Move-only elements
+  {
+    srb::ring<std::unique_ptr<int>, srb::spsc<4>> r;
+    static_assert(sizeof(r) >= 4 * sizeof(std::unique_ptr<int>));
+    assert(r.capacity() == 4);
+    for (int i = 0; i < 4; i++) {
+      assert(r.try_emplace(new int(i)));
+    }
+    assert(!r.try_push(std::make_unique<int>(4)));
+    std::unique_ptr<int> p;
+    assert(r.try_pop(p) && *p == 0);
+    // Capacity that isn't a power of two, used across the end
+    srb::ring<std::string, srb::mpmc<3>> s;
+    for (int i = 0; i < 10; i++) {
+      assert(s.try_emplace(20, 'a' + i) && s.try_push("x"));
+      assert(*s.try_pop() == std::string(20, 'a' + i));
+      assert(*s.try_pop() == "x");
+    }
+    assert(s.try_push("left behind for the destructor"));
+  }
+
+  // A constructor that throws leaves the ring as it was
+  {
+    srb::ring<throwing, srb::spsc<2>> r;
+    assert(r.try_emplace(1));
+    bool threw = false;
+    try {
+      r.try_emplace(-1);
+    } catch (int) {
+      threw = true;
+    }
+    assert(threw && r.len() == 1);
+    assert(r.try_emplace(2) && r.len() == 2);
+    assert(r.try_pop()->value == 1 && r.try_pop()->value == 2);
+  }
+
+  // Several producers and consumers: everything comes out exactly once, and
+  // each writer's elements in the order they were pushed
+  {
+    srb::ring<std::unique_ptr<size_t>, srb::mpmc<>> q(64);
+    std::vector<std::atomic<int>> seen(ITERATIONS * WRITERS);
+    std::atomic<size_t> popped{0};
+    std::vector<std::thread> ts;
+    for (size_t r = 0; r < READERS; r++) {
+      ts.emplace_back([&] {
+        size_t last[WRITERS];
+        for (size_t i = 0; i < WRITERS; i++) {
+          last[i] = SIZE_MAX;
+        }
+        std::unique_ptr<size_t> out[8];
+        while (popped.load() < ITERATIONS * WRITERS) {
+          size_t n = q.try_pop_some(out);
+          if (n == 0) {
+            std::this_thread::yield();
+          }
+          for (size_t i = 0; i < n; i++) {
+            size_t v = *out[i];
+            size_t id = v % WRITERS;
+            assert(last[id] == SIZE_MAX || v / WRITERS > last[id]);
+            last[id] = v / WRITERS;
+            assert(seen[v].fetch_add(1) == 0);
+          }
+          popped += n;
+        }
+      });
+    }
+    for (size_t w = 0; w < WRITERS; w++) {
+      ts.emplace_back([&, w] {
+        for (size_t i = 0; i < ITERATIONS; i++) {
+          // Left alone when the ring is full
+          auto p = std::make_unique<size_t>(i * WRITERS + w);
+          while (!q.try_push(std::move(p))) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    for (auto &t : ts) {
+      t.join();
+    }
+    for (auto &s : seen) {
+      assert(s.load() == 1);
+    }
+    assert(q.len() == 0);
+  }
+
+  // One producer, one consumer, batches of strings
+  {
+    srb::ring<std::string, srb::spsc<>> q(32);
+    std::thread w([&] {
+      std::string in[5];
+      for (size_t i = 0; i < ITERATIONS;) {
+        for (size_t j = 0; j < 5; j++) {
+          in[j] = std::to_string(i + j);
+        }
+        size_t n =
+            q.try_move_some(std::span(in, std::min<size_t>(5, ITERATIONS - i)));
+        if (n == 0) {
+          std::this_thread::yield();
+        }
+        i += n;
+      }
+    });
+    std::string out[7];
+    for (size_t i = 0; i < ITERATIONS;) {
+      size_t n = q.try_pop_some(out);
+      if (n == 0) {
+        std::this_thread::yield();
+      }
+      for (size_t j = 0; j < n; j++, i++) {
+        assert(out[j] == std::to_string(i));
+      }
+    }
+    w.join();
+  }
+
+  return 0;
+}
@@ -0,0 +1,118 @@
+#define SRB_EVENTFD
+#include "srb.h"
+#include "flavours.h"
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <threads.h>
+
+#define ITERATIONS 20000
+#define RINGS 16
+
+static spsc rings[RINGS];
+
+// How many times fd was signalled since it was last cleared
+static uint64_t signals(int fd) {
+  uint64_t count = 0;
+  if (read(fd, &count, sizeof(count)) < 0) {
+    assert(errno == EAGAIN);
+  }
+  return count;
+}
+
+static void check_eventfd(const flavour *f) {
+  any_ring r;
+  f->init(&r, 4);
+  assert(f->readable_fd(&r) == -1 && f->writable_fd(&r) == -1);
+  // Works without them
+  f->push_one(&r, 0);
+  assert(f->pop_one(&r) == 0);
+  assert(f->init_eventfd(&r) == 0);
+  // Both start out readable
+  assert(signals(f->readable_fd(&r)) == 1 && signals(f->writable_fd(&r)) == 1);
+  // Only the first push into an empty ring signals
+  f->push_one(&r, 1);
+  f->push_one(&r, 2);
+  assert(signals(f->readable_fd(&r)) == 1);
+  f->push_one(&r, 3);
+  assert(signals(f->readable_fd(&r)) == 0);
+  assert(f->pop_one(&r) == 1);
+  assert(f->pop_one(&r) == 2);
+  assert(f->pop_one(&r) == 3);
+  f->push_one(&r, 4);
+  assert(signals(f->readable_fd(&r)) == 1);
+  assert(f->pop_one(&r) == 4);
+  // Only the first pop out of a full ring signals
+  signals(f->writable_fd(&r));
+  while (f->try_push_one(&r, 5) == 0) {
+  }
+  assert(signals(f->writable_fd(&r)) == 0);
+  assert(f->pop_one(&r) == 5);
+  assert(f->pop_one(&r) == 5);
+  assert(signals(f->writable_fd(&r)) == 1);
+  signals(f->readable_fd(&r));
+  f->free(&r);
+  assert(f->readable_fd(&r) == -1 && f->writable_fd(&r) == -1);
+}
+
+int writer(void *arg) {
+  spsc *r = arg;
+  for (size_t i = 0; i < ITERATIONS;) {
+    if (spsc_try_push_one(r, i) == 0) {
+      i++;
+      continue;
+    }
+    // Full: sleep until the consumer makes room
+    struct pollfd p = {.fd = r->writable_fd, .events = POLLIN};
+    srb_eventfd_clear(r->writable_fd);
+    if (spsc_try_push_one(r, i) == 0) {
+      i++;
+      continue;
+    }
+    assert(poll(&p, 1, 10000) == 1);
+  }
+  return 0;
+}
+
+int main() {
+  for (size_t i = 0; i < FLAVOURS; i++) {
+    check_eventfd(&flavours[i]);
+  }
+
+  // One thread waits on many rings with epoll, and never misses a push
+  int ep = epoll_create1(EPOLL_CLOEXEC);
+  assert(ep >= 0);
+  thrd_t ws[RINGS];
+  for (size_t i = 0; i < RINGS; i++) {
+    SRB_INIT_SPSC(rings[i], 8);
+    assert(SRB_INIT_EVENTFD(rings[i]) == 0);
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = i};
+    assert(epoll_ctl(ep, EPOLL_CTL_ADD, rings[i].readable_fd, &ev) == 0);
+    assert(thrd_create(&ws[i], writer, &rings[i]) == thrd_success);
+  }
+  size_t expected[RINGS] = {0};
+  for (size_t total = 0; total < ITERATIONS * RINGS;) {
+    struct epoll_event evs[RINGS];
+    // A lost wakeup would hang here
+    int n = epoll_wait(ep, evs, RINGS, 10000);
+    assert(n > 0);
+    for (int e = 0; e < n; e++) {
+      size_t i = (size_t)evs[e].data.u64;
+      srb_eventfd_clear(rings[i].readable_fd);
+      size_t v;
+      while (spsc_try_pop_one(&rings[i], &v) == 0) {
+        assert(v == expected[i]);
+        expected[i]++;
+        total++;
+      }
+    }
+  }
+  for (size_t i = 0; i < RINGS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+    assert(spsc_len(&rings[i]) == 0);
+    SRB_FREE(rings[i]);
+  }
+  close(ep);
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+// Several producers push into a `char` ringbuffer while one thread drains it
+// into a pipe with write_to_fd, and another reads the pipe back. Producers push
+// whole records, so the stream has to come out as records, each producer's in
+// order, and none of them missing or sent twice.
+//
+//   fdio_stress_test [records per producer]
+#define SRB_FDIO
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+#include <unistd.h>
+
+SRB_DECL(static, charq, char);
+SRB_DEF(static, charq, char);
+SRB_DECL_FDIO(static, charq);
+SRB_DEF_FDIO(static, charq);
+
+#define PRODUCERS 8
+// Small, so the writer keeps finding pushes half done
+#define CAPACITY 61
+// Producer, then a 6 byte sequence number, then a check byte
+#define RECORD 8
+
+static charq q;
+static int p[2];
+static size_t records;
+static atomic_size_t next_id;
+static atomic_int producers_done;
+
+static unsigned char check(const unsigned char *rec) {
+  unsigned char c = 0x5a;
+  for (size_t i = 0; i < RECORD - 1; i++) {
+    c = (unsigned char)(c * 31 + rec[i]);
+  }
+  return c;
+}
+
+static int producer(void *arg) {
+  (void)arg;
+  unsigned char id = (unsigned char)atomic_fetch_add(&next_id, 1);
+  char rec[RECORD];
+  for (uint64_t seq = 0; seq < records; seq++) {
+    rec[0] = (char)id;
+    for (size_t i = 0; i < 6; i++) {
+      rec[1 + i] = (char)(seq >> (8 * i));
+    }
+    rec[RECORD - 1] = (char)check((unsigned char *)rec);
+    while (charq_try_push(&q, (srb_char_slice){rec, RECORD}) != 0) {
+      thrd_yield();
+    }
+  }
+  atomic_fetch_add(&producers_done, 1);
+  return 0;
+}
+
+static int writer(void *arg) {
+  (void)arg;
+  for (;;) {
+    int done = atomic_load(&producers_done) == PRODUCERS;
+    ssize_t n = charq_write_to_fd(&q, p[1], SIZE_MAX);
+    assert(n >= 0);
+    if (n == 0) {
+      if (done) {
+        break;
+      }
+      thrd_yield();
+    }
+  }
+  close(p[1]);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  records = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+
+  SRB_INIT(q, CAPACITY);
+  SRB_UNWRAP(pipe(p));
+  thrd_t ts[PRODUCERS + 1];
+  SRB_UNWRAP(thrd_create(&ts[PRODUCERS], writer, NULL) != thrd_success);
+  for (size_t i = 0; i < PRODUCERS; i++) {
+    SRB_UNWRAP(thrd_create(&ts[i], producer, NULL) != thrd_success);
+  }
+
+  uint64_t next[PRODUCERS] = {0};
+  unsigned char rec[RECORD];
+  size_t have = 0;
+  for (;;) {
+    ssize_t n = read(p[0], &rec[have], RECORD - have);
+    assert(n >= 0);
+    if (n == 0) {
+      break;
+    }
+    have += (size_t)n;
+    if (have < RECORD) {
+      continue;
+    }
+    have = 0;
+    assert(rec[RECORD - 1] == check(rec));
+    assert(rec[0] < PRODUCERS);
+    uint64_t seq = 0;
+    for (size_t i = 0; i < 6; i++) {
+      seq |= (uint64_t)rec[1 + i] << (8 * i);
+    }
+    assert(seq == next[rec[0]]);
+    next[rec[0]]++;
+  }
+  assert(have == 0);
+  for (size_t i = 0; i < PRODUCERS; i++) {
+    assert(next[i] == records);
+  }
+
+  for (size_t i = 0; i <= PRODUCERS; i++) {
+    SRB_UNWRAP(thrd_join(ts[i], NULL) != thrd_success);
+  }
+  close(p[0]);
+  assert(charq_len(&q) == 0);
+  SRB_FREE(q);
+  return 0;
+}
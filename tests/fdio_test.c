@@ -0,0 +1,137 @@
+#define SRB_FDIO
+#include "srb.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <threads.h>
+#include <unistd.h>
+
+SRB_DECL(static, charq, char);
+SRB_DEF(static, charq, char);
+SRB_DECL_FDIO(static, charq);
+SRB_DEF_FDIO(static, charq);
+SRB_DECL_SPSC(static, spsc, char);
+SRB_DEF_SPSC(static, spsc, char);
+SRB_DECL_FDIO(static, spsc);
+SRB_DEF_FDIO(static, spsc);
+
+#define TOTAL 1000000
+
+static int in[2], out[2];
+
+// Writes TOTAL bytes of a known pattern into the pipe in[1]
+int source(void *arg) {
+  (void)arg;
+  char buf[777];
+  for (size_t sent = 0; sent < TOTAL;) {
+    size_t n = TOTAL - sent < sizeof(buf) ? TOTAL - sent : sizeof(buf);
+    for (size_t i = 0; i < n; i++) {
+      buf[i] = (char)((sent + i) % 251);
+    }
+    ssize_t w = write(in[1], buf, n);
+    assert(w > 0);
+    sent += (size_t)w;
+  }
+  close(in[1]);
+  return 0;
+}
+
+// Checks the pattern comes out of the pipe out[0] whole
+int sink(void *arg) {
+  (void)arg;
+  char buf[1000];
+  size_t got = 0;
+  for (;;) {
+    ssize_t r = read(out[0], buf, sizeof(buf));
+    assert(r >= 0);
+    if (r == 0) {
+      break;
+    }
+    for (ssize_t i = 0; i < r; i++) {
+      assert(buf[i] == (char)((got + (size_t)i) % 251));
+    }
+    got += (size_t)r;
+  }
+  assert(got == TOTAL);
+  return 0;
+}
+
+// readv and writev don't depend on the flavour, so this only checks one, and
+// keeps wrapping around the end of its buffer
+static void check_fdio(void) {
+  charq r;
+  SRB_INIT(r, 16);
+  size_t cap = charq_capacity(&r);
+  int p[2];
+  SRB_UNWRAP(pipe(p));
+  SRB_UNWRAP(fcntl(p[0], F_SETFL, O_NONBLOCK));
+  char buf[64];
+  // Nothing to write
+  assert(charq_write_to_fd(&r, p[1], 64) == 0);
+  // Nothing to read: the ringbuffer stays as it was
+  assert(charq_read_from_fd(&r, p[0], 64) == -1 && errno == EAGAIN);
+  assert(charq_len(&r) == 0);
+  for (size_t lap = 0; lap < 10; lap++) {
+    // Offset by a few bytes every lap, so that it keeps wrapping
+    for (size_t i = 0; i < 5; i++) {
+      charq_push_one(&r, (char)('a' + i));
+    }
+    // Only pops what was written
+    assert(charq_write_to_fd(&r, p[1], 3) == 3);
+    assert(charq_len(&r) == 2);
+    assert(charq_write_to_fd(&r, p[1], 64) == 2);
+    assert(read(p[0], buf, sizeof(buf)) == 5);
+    assert(memcmp(buf, "abcde", 5) == 0);
+    // Only pushes what was read, however much room there is
+    assert(write(p[1], "0123456", 7) == 7);
+    assert(charq_read_from_fd(&r, p[0], 64) == 7);
+    assert(charq_len(&r) == 7);
+    for (size_t i = 0; i < 7; i++) {
+      assert(charq_pop_one(&r) == (char)('0' + i));
+    }
+  }
+  // Full
+  memset(buf, 'x', sizeof(buf));
+  assert(write(p[1], buf, cap + 1) == (ssize_t)(cap + 1));
+  assert(charq_read_from_fd(&r, p[0], 64) == (ssize_t)cap);
+  assert(charq_read_from_fd(&r, p[0], 64) == -1 && errno == ENOBUFS);
+  assert(charq_len(&r) == cap);
+  // End of file
+  while (charq_try_pop_one(&r, &buf[0]) == 0) {
+  }
+  close(p[1]);
+  assert(charq_read_from_fd(&r, p[0], 64) == 1);
+  assert(charq_read_from_fd(&r, p[0], 64) == 0);
+  close(p[0]);
+  SRB_FREE(r);
+}
+
+int main() {
+  check_fdio();
+
+  // Forward one pipe into another through a small ringbuffer, with a thread
+  // on either end
+  spsc r;
+  SRB_INIT_SPSC(r, 100);
+  SRB_UNWRAP(pipe(in));
+  SRB_UNWRAP(pipe(out));
+  thrd_t src, dst;
+  SRB_UNWRAP(thrd_create(&src, source, NULL) != thrd_success);
+  SRB_UNWRAP(thrd_create(&dst, sink, NULL) != thrd_success);
+  int eof = 0;
+  while (!eof || spsc_len(&r) > 0) {
+    if (!eof) {
+      ssize_t n = spsc_read_from_fd(&r, in[0], SIZE_MAX);
+      assert(n >= 0 || errno == ENOBUFS);
+      eof = n == 0;
+    }
+    assert(spsc_write_to_fd(&r, out[1], SIZE_MAX) >= 0);
+  }
+  close(out[1]);
+  SRB_UNWRAP(thrd_join(src, NULL) != thrd_success);
+  SRB_UNWRAP(thrd_join(dst, NULL) != thrd_success);
+  close(in[0]);
+  close(out[0]);
+  SRB_FREE(r);
+
+  return 0;
+}
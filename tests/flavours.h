@@ -0,0 +1,235 @@
+// The flavours that share the push/pop API of `SRB_DECL`, as `size_t`
+// ringbuffers behind one table of functions, so that a test can be written once
+// as a plain function taking a `flavour` and run on each of `flavours`.
+//
+// Include after `srb.h`. The functions of options like `SRB_STATS` are only in
+// the table if they're defined by then.
+#ifndef SRB_TESTS_FLAVOURS_H
+#define SRB_TESTS_FLAVOURS_H
+
+#include <stdint.h>
+
+SRB_DECL(static, queue, size_t);
+SRB_DEF(static, queue, size_t);
+SRB_DECL_SPSC(static, spsc, size_t);
+SRB_DEF_SPSC(static, spsc, size_t);
+SRB_DECL_MPSC(static, mpsc, size_t);
+SRB_DEF_MPSC(static, mpsc, size_t);
+
+/**
+ * @brief Room for a ringbuffer of any of the flavours.
+ */
+typedef union {
+  queue queue;
+  spsc spsc;
+  mpsc mpsc;
+} any_ring;
+
+/**
+ * @brief One flavour's functions, on the member of `any_ring` it uses. `init`
+ * and the other initializers set it up, `free` frees it with `SRB_FREE`.
+ */
+typedef struct {
+  const char *name;
+  void (*init)(any_ring *r, size_t n);
+  void (*free)(any_ring *r);
+  srb_size_t_slice (*buffer)(any_ring *r);
+  size_t (*capacity)(any_ring *r);
+  int (*try_reserve_push)(any_ring *r, size_t n, srb_size_t_slice *first,
+                          srb_size_t_slice *second);
+  void (*commit_push)(any_ring *r, srb_size_t_slice first,
+                      srb_size_t_slice second);
+  int (*try_push)(any_ring *r, srb_size_t_slice v);
+  int (*try_push_some)(any_ring *r, srb_size_t_slice v, size_t *n);
+  void (*push)(any_ring *r, srb_size_t_slice v);
+  int (*try_push_one)(any_ring *r, size_t i);
+  void (*push_one)(any_ring *r, size_t i);
+  int (*try_reserve_pop)(any_ring *r, size_t n, srb_size_t_slice *first,
+                         srb_size_t_slice *second);
+  void (*release_pop)(any_ring *r, srb_size_t_slice first,
+                      srb_size_t_slice second);
+  int (*try_pop)(any_ring *r, srb_size_t_slice v);
+  int (*try_pop_some)(any_ring *r, srb_size_t_slice v, size_t *n);
+  void (*pop)(any_ring *r, srb_size_t_slice v);
+  int (*try_pop_one)(any_ring *r, size_t *i);
+  size_t (*pop_one)(any_ring *r);
+#ifdef SRB_STATS
+  srb_stats (*stats_snapshot)(any_ring *r);
+#endif // SRB_STATS
+#ifdef SRB_MIRROR
+  void (*init_mirror)(any_ring *r, size_t n);
+#endif // SRB_MIRROR
+#ifdef SRB_MMAP
+  void (*init_ex)(any_ring *r, size_t n, srb_alloc_opts opts);
+  size_t (*mapped)(any_ring *r);
+#endif // SRB_MMAP
+#ifdef SRB_EVENTFD
+  int (*init_eventfd)(any_ring *r);
+  int (*readable_fd)(any_ring *r);
+  int (*writable_fd)(any_ring *r);
+#endif // SRB_EVENTFD
+} flavour;
+
+#ifdef SRB_STATS
+#define FLAVOUR_stats(TYPE)                                                    \
+  static srb_stats TYPE##_f_stats_snapshot(any_ring *r) {                      \
+    return TYPE##_stats_snapshot(&r->TYPE);                                    \
+  }
+#define FLAVOUR_stats_entries(TYPE) .stats_snapshot = TYPE##_f_stats_snapshot,
+#else
+#define FLAVOUR_stats(TYPE)
+#define FLAVOUR_stats_entries(TYPE)
+#endif // SRB_STATS
+
+#ifdef SRB_MIRROR
+#define FLAVOUR_mirror(TYPE, KIND)                                             \
+  static void TYPE##_f_init_mirror(any_ring *r, size_t n) {                    \
+    SRB_INIT##KIND##_MIRROR(r->TYPE, n);                                       \
+  }
+#define FLAVOUR_mirror_entries(TYPE) .init_mirror = TYPE##_f_init_mirror,
+#else
+#define FLAVOUR_mirror(TYPE, KIND)
+#define FLAVOUR_mirror_entries(TYPE)
+#endif // SRB_MIRROR
+
+#ifdef SRB_MMAP
+#define FLAVOUR_mmap(TYPE, KIND)                                               \
+  static void TYPE##_f_init_ex(any_ring *r, size_t n, srb_alloc_opts opts) {   \
+    SRB_INIT##KIND##_EX(r->TYPE, n, opts);                                     \
+  }                                                                            \
+  static size_t TYPE##_f_mapped(any_ring *r) { return r->TYPE.mapped; }
+#define FLAVOUR_mmap_entries(TYPE)                                             \
+  .init_ex = TYPE##_f_init_ex, .mapped = TYPE##_f_mapped,
+#else
+#define FLAVOUR_mmap(TYPE, KIND)
+#define FLAVOUR_mmap_entries(TYPE)
+#endif // SRB_MMAP
+
+#ifdef SRB_EVENTFD
+#define FLAVOUR_eventfd(TYPE)                                                  \
+  static int TYPE##_f_init_eventfd(any_ring *r) {                              \
+    return SRB_INIT_EVENTFD(r->TYPE);                                          \
+  }                                                                            \
+  static int TYPE##_f_readable_fd(any_ring *r) { return r->TYPE.readable_fd; } \
+  static int TYPE##_f_writable_fd(any_ring *r) { return r->TYPE.writable_fd; }
+#define FLAVOUR_eventfd_entries(TYPE)                                          \
+  .init_eventfd = TYPE##_f_init_eventfd,                                       \
+  .readable_fd = TYPE##_f_readable_fd, .writable_fd = TYPE##_f_writable_fd,
+#else
+#define FLAVOUR_eventfd(TYPE)
+#define FLAVOUR_eventfd_entries(TYPE)
+#endif // SRB_EVENTFD
+
+/**
+ * @brief Defines the functions of `flavour` for the member `TYPE` of
+ * `any_ring`, which is initialized with `SRB_INIT##KIND` and its variants.
+ */
+#define FLAVOUR(TYPE, KIND)                                                    \
+  static void TYPE##_f_init(any_ring *r, size_t n) {                           \
+    SRB_INIT##KIND(r->TYPE, n);                                                \
+  }                                                                            \
+  static void TYPE##_f_free(any_ring *r) { SRB_FREE(r->TYPE); }                \
+  static srb_size_t_slice TYPE##_f_buffer(any_ring *r) {                       \
+    return r->TYPE.buffer;                                                     \
+  }                                                                            \
+  static size_t TYPE##_f_capacity(any_ring *r) {                               \
+    return TYPE##_capacity(&r->TYPE);                                          \
+  }                                                                            \
+  static int TYPE##_f_try_reserve_push(any_ring *r, size_t n,                  \
+                                       srb_size_t_slice *first,                \
+                                       srb_size_t_slice *second) {             \
+    return TYPE##_try_reserve_push(&r->TYPE, n, first, second);                \
+  }                                                                            \
+  static void TYPE##_f_commit_push(any_ring *r, srb_size_t_slice first,        \
+                                   srb_size_t_slice second) {                  \
+    TYPE##_commit_push(&r->TYPE, first, second);                               \
+  }                                                                            \
+  static int TYPE##_f_try_push(any_ring *r, srb_size_t_slice v) {              \
+    return TYPE##_try_push(&r->TYPE, v);                                       \
+  }                                                                            \
+  static int TYPE##_f_try_push_some(any_ring *r, srb_size_t_slice v,           \
+                                    size_t *n) {                               \
+    return TYPE##_try_push_some(&r->TYPE, v, n);                               \
+  }                                                                            \
+  static void TYPE##_f_push(any_ring *r, srb_size_t_slice v) {                 \
+    TYPE##_push(&r->TYPE, v);                                                  \
+  }                                                                            \
+  static int TYPE##_f_try_push_one(any_ring *r, size_t i) {                    \
+    return TYPE##_try_push_one(&r->TYPE, i);                                   \
+  }                                                                            \
+  static void TYPE##_f_push_one(any_ring *r, size_t i) {                       \
+    TYPE##_push_one(&r->TYPE, i);                                              \
+  }                                                                            \
+  static int TYPE##_f_try_reserve_pop(any_ring *r, size_t n,                   \
+                                      srb_size_t_slice *first,                 \
+                                      srb_size_t_slice *second) {              \
+    return TYPE##_try_reserve_pop(&r->TYPE, n, first, second);                 \
+  }                                                                            \
+  static void TYPE##_f_release_pop(any_ring *r, srb_size_t_slice first,        \
+                                   srb_size_t_slice second) {                  \
+    TYPE##_release_pop(&r->TYPE, first, second);                               \
+  }                                                                            \
+  static int TYPE##_f_try_pop(any_ring *r, srb_size_t_slice v) {               \
+    return TYPE##_try_pop(&r->TYPE, v);                                        \
+  }                                                                            \
+  static int TYPE##_f_try_pop_some(any_ring *r, srb_size_t_slice v,            \
+                                   size_t *n) {                                \
+    return TYPE##_try_pop_some(&r->TYPE, v, n);                                \
+  }                                                                            \
+  static void TYPE##_f_pop(any_ring *r, srb_size_t_slice v) {                  \
+    TYPE##_pop(&r->TYPE, v);                                                   \
+  }                                                                            \
+  static int TYPE##_f_try_pop_one(any_ring *r, size_t *i) {                    \
+    return TYPE##_try_pop_one(&r->TYPE, i);                                    \
+  }                                                                            \
+  static size_t TYPE##_f_pop_one(any_ring *r) {                                \
+    return TYPE##_pop_one(&r->TYPE);                                           \
+  }                                                                            \
+  FLAVOUR_stats(TYPE)                                                          \
+  FLAVOUR_mirror(TYPE, KIND)                                                   \
+  FLAVOUR_mmap(TYPE, KIND)                                                     \
+  FLAVOUR_eventfd(TYPE)
+
+FLAVOUR(queue, )
+FLAVOUR(spsc, _SPSC)
+FLAVOUR(mpsc, _MPSC)
+
+#define FLAVOUR_ENTRY(TYPE)                                                    \
+  {                                                                            \
+      .name = #TYPE,                                                           \
+      .init = TYPE##_f_init,                                                   \
+      .free = TYPE##_f_free,                                                   \
+      .buffer = TYPE##_f_buffer,                                               \
+      .capacity = TYPE##_f_capacity,                                           \
+      .try_reserve_push = TYPE##_f_try_reserve_push,                           \
+      .commit_push = TYPE##_f_commit_push,                                     \
+      .try_push = TYPE##_f_try_push,                                           \
+      .try_push_some = TYPE##_f_try_push_some,                                 \
+      .push = TYPE##_f_push,                                                   \
+      .try_push_one = TYPE##_f_try_push_one,                                   \
+      .push_one = TYPE##_f_push_one,                                           \
+      .try_reserve_pop = TYPE##_f_try_reserve_pop,                             \
+      .release_pop = TYPE##_f_release_pop,                                     \
+      .try_pop = TYPE##_f_try_pop,                                             \
+      .try_pop_some = TYPE##_f_try_pop_some,                                   \
+      .pop = TYPE##_f_pop,                                                     \
+      .try_pop_one = TYPE##_f_try_pop_one,                                     \
+      .pop_one = TYPE##_f_pop_one,                                             \
+      FLAVOUR_stats_entries(TYPE)                                              \
+      FLAVOUR_mirror_entries(TYPE)                                             \
+      FLAVOUR_mmap_entries(TYPE)                                               \
+      FLAVOUR_eventfd_entries(TYPE)                                            \
+  }
+
+/**
+ * @brief Every flavour, for tests to loop over.
+ */
+static const flavour flavours[] = {
+    FLAVOUR_ENTRY(queue),
+    FLAVOUR_ENTRY(spsc),
+    FLAVOUR_ENTRY(mpsc),
+};
+
+#define FLAVOURS (sizeof(flavours) / sizeof(*flavours))
+
+#endif // SRB_TESTS_FLAVOURS_H
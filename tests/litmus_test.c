@@ -0,0 +1,165 @@
+// Message-passing litmus tests for the push/pop protocols, meant to be run
+// under ThreadSanitizer, as litmus_tsan_test. Elements are written and read in
+// place through reservations, with plain stores and loads, so the only thing
+// ordering a producer's writes before a consumer's reads, and a consumer's
+// reads before the next lap's writes, is the protocol's own acquire/release
+// pairs. If one of them is too weak, ThreadSanitizer reports a data race on
+// the slots, and without it, torn elements may fail the checks.
+//
+// Uses pthreads rather than C11 threads, which ThreadSanitizer doesn't
+// intercept on glibc.
+//
+//   litmus_test [elements per producer]
+#include "srb.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+  uint64_t producer;
+  uint64_t seq;
+  uint64_t check[2];
+} elem;
+
+SRB_DECL(static, ring, elem);
+SRB_DEF(static, ring, elem);
+SRB_DECL_MPSC(static, mpsc, elem);
+SRB_DEF_MPSC(static, mpsc, elem);
+SRB_DECL_SPSC(static, spsc, elem);
+SRB_DEF_SPSC(static, spsc, elem);
+
+#define MAX_THREADS 8
+// Small, so every test goes around the buffer many times
+#define CAPACITY 5
+
+static size_t iterations;
+
+static uint64_t check(uint64_t producer, uint64_t seq, int i) {
+  return (producer * 0x9e3779b97f4a7c15u) ^ (seq << (i + 1));
+}
+
+static void fill(elem *e, uint64_t producer, uint64_t seq) {
+  e->producer = producer;
+  e->seq = seq;
+  e->check[0] = check(producer, seq, 0);
+  e->check[1] = check(producer, seq, 1);
+}
+
+/**
+ * @brief One run: `producers` threads push `iterations` elements each, in
+ * reservations of 1 to 3, and `consumers` threads pop them in reservations of
+ * up to 4, checking every element and that each producer's come in order.
+ */
+typedef struct {
+  void *q;
+  size_t producers;
+  atomic_size_t next_id;
+  atomic_size_t popped;
+  atomic_uchar *seen;
+} run;
+
+#define LITMUS(TYPE)                                                           \
+  static void *TYPE##_producer(void *arg) {                                    \
+    run *r = arg;                                                              \
+    uint64_t id = atomic_fetch_add(&r->next_id, 1);                            \
+    for (uint64_t seq = 0; seq < iterations;) {                                \
+      size_t n = 1 + seq % 3;                                                  \
+      if (n > iterations - seq) {                                              \
+        n = iterations - seq;                                                  \
+      }                                                                        \
+      srb_elem_slice first, second;                                            \
+      if (TYPE##_try_reserve_push(r->q, n, &first, &second) != 0) {            \
+        sched_yield();                                                         \
+        continue;                                                              \
+      }                                                                        \
+      for (size_t i = 0; i < first.size; i++) {                                \
+        fill(&first.data[i], id, seq++);                                       \
+      }                                                                        \
+      for (size_t i = 0; i < second.size; i++) {                               \
+        fill(&second.data[i], id, seq++);                                      \
+      }                                                                        \
+      TYPE##_commit_push(r->q, first, second);                                 \
+    }                                                                          \
+    return NULL;                                                               \
+  }                                                                            \
+                                                                               \
+  static void *TYPE##_consumer(void *arg) {                                    \
+    run *r = arg;                                                              \
+    uint64_t last[MAX_THREADS];                                                \
+    for (size_t i = 0; i < MAX_THREADS; i++) {                                 \
+      last[i] = UINT64_MAX;                                                    \
+    }                                                                          \
+    while (atomic_load(&r->popped) < r->producers * iterations) {              \
+      srb_elem_slice first, second;                                            \
+      if (TYPE##_try_reserve_pop_some(r->q, 4, &first, &second) != 0) {        \
+        sched_yield();                                                         \
+        continue;                                                              \
+      }                                                                        \
+      for (size_t i = 0; i < first.size + second.size; i++) {                  \
+        elem *e = i < first.size ? &first.data[i]                              \
+                                 : &second.data[i - first.size];               \
+        assert(e->producer < r->producers && e->seq < iterations);             \
+        assert(e->check[0] == check(e->producer, e->seq, 0));                  \
+        assert(e->check[1] == check(e->producer, e->seq, 1));                  \
+        assert(last[e->producer] == UINT64_MAX ||                              \
+               e->seq > last[e->producer]);                                    \
+        last[e->producer] = e->seq;                                            \
+        assert(atomic_fetch_add(&r->seen[e->producer * iterations + e->seq],   \
+                                1) == 0);                                      \
+      }                                                                        \
+      TYPE##_release_pop(r->q, first, second);                                 \
+      atomic_fetch_add(&r->popped, first.size + second.size);                  \
+    }                                                                          \
+    return NULL;                                                               \
+  }                                                                            \
+                                                                               \
+  static void TYPE##_litmus(TYPE *q, size_t producers, size_t consumers) {     \
+    run r = {.q = q, .producers = producers};                                  \
+    atomic_init(&r.next_id, 0);                                                \
+    atomic_init(&r.popped, 0);                                                 \
+    r.seen = calloc(producers * iterations, sizeof(*r.seen));                  \
+    assert(r.seen != NULL);                                                    \
+    pthread_t ts[2 * MAX_THREADS];                                             \
+    for (size_t i = 0; i < consumers; i++) {                                   \
+      assert(pthread_create(&ts[i], NULL, TYPE##_consumer, &r) == 0);          \
+    }                                                                          \
+    for (size_t i = 0; i < producers; i++) {                                   \
+      assert(pthread_create(&ts[consumers + i], NULL, TYPE##_producer, &r) ==  \
+             0);                                                               \
+    }                                                                          \
+    for (size_t i = 0; i < producers + consumers; i++) {                       \
+      pthread_join(ts[i], NULL);                                               \
+    }                                                                          \
+    for (size_t i = 0; i < producers * iterations; i++) {                      \
+      assert(atomic_load(&r.seen[i]) == 1);                                    \
+    }                                                                          \
+    assert(TYPE##_len(q) == 0);                                                \
+    free(r.seen);                                                              \
+  }
+
+LITMUS(ring)
+LITMUS(mpsc)
+LITMUS(spsc)
+
+int main(int argc, char **argv) {
+  iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+
+  ring r;
+  SRB_INIT(r, CAPACITY);
+  ring_litmus(&r, 4, 4);
+  ring_litmus(&r, 1, 4);
+  ring_litmus(&r, 4, 1);
+  SRB_FREE(r);
+
+  mpsc m;
+  SRB_INIT_MPSC(m, CAPACITY);
+  mpsc_litmus(&m, 4, 1);
+  SRB_FREE(m);
+
+  spsc s;
+  SRB_INIT_SPSC(s, CAPACITY);
+  spsc_litmus(&s, 1, 1);
+  SRB_FREE(s);
+  return 0;
+}
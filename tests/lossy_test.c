@@ -0,0 +1,100 @@
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+
+SRB_DECL_SLICE(uint64_t);
+SRB_DECL_LOSSY(static, lossy, uint64_t);
+SRB_DEF_LOSSY(static, lossy, uint64_t);
+
+#define ITERATIONS 200000
+#define WRITERS 4
+
+static lossy q;
+static atomic_int done;
+
+// Both halves of an element come from the same push, so torn copies show up
+static uint64_t make(uint64_t id, uint64_t i) {
+  uint64_t v = (i << 8) | id;
+  return (v << 32) | (v & 0xffffffff);
+}
+
+int writer(void *arg) {
+  uint64_t id = (uint64_t)(size_t)arg;
+  for (uint64_t i = 0; i < ITERATIONS; i++) {
+    lossy_push_one(&q, make(id, i));
+  }
+  atomic_fetch_add(&done, 1);
+  return 0;
+}
+
+int main() {
+  lossy r;
+  uint64_t out, buf[8];
+  size_t n, dropped;
+  SRB_INIT_LOSSY(r, 3);
+  size_t cap = lossy_capacity(&r);
+  // Always a power of two
+  assert(cap == 4);
+  assert(lossy_try_pop_one(&r, &out, &dropped) == 1 && dropped == 0);
+  // Fills up without losing anything
+  for (uint64_t i = 0; i < cap; i++) {
+    lossy_push_one(&r, i);
+  }
+  assert(lossy_len(&r) == cap);
+  assert(lossy_try_pop_one(&r, &out, &dropped) == 0);
+  assert(out == 0 && dropped == 0);
+  // Pushing past the end overwrites the oldest
+  lossy_push(&r, (srb_uint64_t_slice){(uint64_t[]){100, 101, 102}, 3});
+  assert(lossy_len(&r) == cap);
+  assert(lossy_try_pop_one(&r, &out, &dropped) == 0);
+  assert(dropped == 2 && out == 3);
+  assert(lossy_try_pop_some(&r, (srb_uint64_t_slice){buf, 8}, &n, &dropped) ==
+         0);
+  assert(n == cap - 1 && dropped == 0);
+  for (size_t i = 0; i < n; i++) {
+    assert(buf[i] == 100 + i + 4 - cap);
+  }
+  assert(lossy_try_pop_one(&r, &out, &dropped) == 1 && dropped == 0);
+  // Lapped many times over
+  for (uint64_t i = 0; i < 10 * cap + 1; i++) {
+    lossy_push_one(&r, i);
+  }
+  assert(lossy_try_pop_some(&r, (srb_uint64_t_slice){buf, 8}, &n, &dropped) ==
+         0);
+  assert(n == cap && dropped == 9 * cap + 1 && buf[0] == 9 * cap + 1);
+  SRB_FREE_LOSSY(r);
+
+  // Producers never wait for the consumer; everything is either popped, in
+  // order for each writer, or counted as dropped
+  SRB_INIT_LOSSY(q, 64);
+  thrd_t ws[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], writer, (void *)i) == thrd_success);
+  }
+  uint64_t next[WRITERS] = {0};
+  size_t popped = 0, lost = 0;
+  for (;;) {
+    int finished = atomic_load(&done) == WRITERS;
+    if (lossy_try_pop_one(&q, &out, &dropped)) {
+      lost += dropped;
+      if (finished) {
+        break;
+      }
+      thrd_yield();
+      continue;
+    }
+    lost += dropped;
+    assert(out >> 32 == (out & 0xffffffff));
+    uint64_t id = out & 0xff, i = (out & 0xffffffff) >> 8;
+    assert(id < WRITERS && i >= next[id]);
+    next[id] = i + 1;
+    popped++;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  assert(popped + lost == ITERATIONS * WRITERS);
+  SRB_FREE_LOSSY(q);
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+#define SRB_MIRROR
+#include "srb.h"
+#include "flavours.h"
+
+typedef struct {
+  size_t a, b, c;
+} triple;
+
+SRB_DECL(static, triples, triple);
+SRB_DEF(static, triples, triple);
+
+static void check_mirror(const flavour *f) {
+  any_ring r;
+  f->init_mirror(&r, 10);
+  size_t size = f->buffer(&r).size;
+  size_t *data = f->buffer(&r).data;
+  // Rounded up to fill whole pages
+  assert(size >= 10);
+  assert(size * sizeof(size_t) % (size_t)sysconf(_SC_PAGESIZE) == 0);
+  // Move the head and tail to just before the end
+  size_t junk[8];
+  for (size_t i = 0; i < size - 4; i++) {
+    f->push_one(&r, i);
+    assert(f->pop_one(&r) == i);
+  }
+  // A reservation across the end is one region
+  srb_size_t_slice first, second;
+  assert(f->try_reserve_push(&r, 8, &first, &second) == 0);
+  assert(first.size == 8 && second.size == 0);
+  assert(first.data == &data[size - 4]);
+  for (size_t i = 0; i < 8; i++) {
+    first.data[i] = 100 + i;
+  }
+  f->commit_push(&r, first, second);
+  // Both mappings are the same memory
+  assert(data[size - 1] == 103);
+  assert(data[0] == 104 && data[size] == 104);
+  // And so is a pop across the end
+  assert(f->try_reserve_pop(&r, 8, &first, &second) == 0);
+  assert(first.size == 8 && second.size == 0);
+  for (size_t i = 0; i < 8; i++) {
+    assert(first.data[i] == 100 + i);
+  }
+  f->release_pop(&r, first, second);
+  // Copies across the end
+  size_t in[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  f->push(&r, (srb_size_t_slice){in, 8});
+  f->pop(&r, (srb_size_t_slice){junk, 8});
+  assert(memcmp(in, junk, sizeof(in)) == 0);
+  f->free(&r);
+}
+
+int main() {
+  for (size_t i = 0; i < FLAVOURS; i++) {
+    check_mirror(&flavours[i]);
+  }
+
+  // Element sizes that don't divide the page size still line up
+  triples t;
+  SRB_INIT_MIRROR(t, 1);
+  assert(t.buffer.size * sizeof(triple) % (size_t)sysconf(_SC_PAGESIZE) == 0);
+  for (size_t i = 0; i < t.buffer.size + 10; i++) {
+    triples_push_one(&t, (triple){i, i, i});
+    triple out = triples_pop_one(&t);
+    assert(out.a == i && out.c == i);
+  }
+  SRB_FREE(t);
+
+  // Ringbuffers from plain SRB_INIT still wrap around
+  queue q;
+  SRB_INIT(q, 4);
+  queue_push_one(&q, 0);
+  queue_push_one(&q, 1);
+  assert(queue_pop_one(&q) == 0);
+  assert(queue_pop_one(&q) == 1);
+  srb_size_t_slice first, second;
+  assert(queue_try_reserve_push(&q, 3, &first, &second) == 0);
+  assert(first.size == 2 && second.size == 1);
+  queue_commit_push(&q, first, second);
+  SRB_FREE(q);
+
+  return 0;
+}
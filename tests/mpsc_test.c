@@ -0,0 +1,62 @@
+#include "srb.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <threads.h>
+
+SRB_DECL_SLICE(size_t);
+SRB_DECL_MPSC(static, mpsc, size_t);
+SRB_DEF_MPSC(static, mpsc, size_t);
+
+#define WRITERS 8
+#define ITERATIONS 100000
+
+static mpsc q;
+
+// Each writer pushes (writer id, sequence number) pairs, so the reader can
+// check that every writer's elements arrive in order.
+int writer(void *arg) {
+  size_t w = (size_t)(uintptr_t)arg;
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    size_t vs[] = {w, i};
+    while (mpsc_try_push(&q, (srb_size_t_slice){vs, 2})) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+int main() {
+  SRB_INIT_MPSC(q, 3);
+  assert(mpsc_try_push_one(&q, 1) == 0);
+  assert(mpsc_try_push_one(&q, 2) == 0);
+  assert(mpsc_try_push_one(&q, 3) == 0);
+  assert(mpsc_try_push_one(&q, 4) != 0);
+  assert(mpsc_pop_one(&q) == 1);
+  assert(mpsc_pop_one(&q) == 2);
+  assert(mpsc_pop_one(&q) == 3);
+  size_t x;
+  assert(mpsc_try_pop_one(&q, &x) != 0);
+  SRB_FREE(q);
+
+  SRB_INIT_MPSC(q, 256);
+  thrd_t writers[WRITERS];
+  for (uintptr_t w = 0; w < WRITERS; w++) {
+    assert(thrd_create(&writers[w], writer, (void *)w) == thrd_success);
+  }
+  size_t next[WRITERS] = {0};
+  for (size_t n = 0; n < WRITERS * ITERATIONS; n++) {
+    size_t vs[2];
+    while (mpsc_try_pop(&q, (srb_size_t_slice){vs, 2})) {
+      thrd_yield();
+    }
+    assert(vs[0] < WRITERS);
+    assert(vs[1] == next[vs[0]]);
+    next[vs[0]]++;
+  }
+  for (uintptr_t w = 0; w < WRITERS; w++) {
+    assert(thrd_join(writers[w], NULL) == thrd_success);
+  }
+  SRB_FREE(q);
+
+  return 0;
+}
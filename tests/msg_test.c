@@ -0,0 +1,113 @@
+#include "srb.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <threads.h>
+
+SRB_DECL(static, charq, char);
+SRB_DEF(static, charq, char);
+SRB_DECL_MSG(static, charq);
+SRB_DEF_MSG(static, charq);
+SRB_DECL_MPSC(static, mpsc, char);
+SRB_DEF_MPSC(static, mpsc, char);
+SRB_DECL_MSG(static, mpsc);
+SRB_DEF_MSG(static, mpsc);
+
+#define ITERATIONS 20000
+#define WRITERS 4
+
+static mpsc q;
+
+// Message i from writer id is "id i" followed by i % 50 copies of a letter
+static size_t make_msg(char *buf, size_t id, size_t i) {
+  size_t len = (size_t)sprintf(buf, "%zu %zu", id, i);
+  size_t extra = i % 50;
+  memset(&buf[len], 'a' + (int)(i % 26), extra);
+  return len + extra;
+}
+
+int writer(void *arg) {
+  size_t id = (size_t)arg;
+  char buf[128];
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    size_t len = make_msg(buf, id, i);
+    while (mpsc_try_push_msg(&q, buf, len)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+// Framing doesn't depend on the flavour, so this only checks one
+static void check_framing(void) {
+  charq r;
+  SRB_INIT(r, 256);
+  char buf[256];
+  size_t len;
+  // Nothing there
+  assert(charq_try_pop_msg(&r, buf, sizeof(buf), &len) == 1);
+  assert(charq_peek_msg_len(&r, &len) == 1);
+  // Too big to ever fit
+  assert(charq_try_push_msg(&r, buf, 256) != 0);
+  // Lengths that aren't a multiple of the header size, many times over, so
+  // that messages keep landing across the end of the buffer
+  for (size_t i = 0; i < 1000; i++) {
+    char msg[32];
+    size_t n = i % 30;
+    memset(msg, (char)i, n);
+    assert(charq_try_push_msg(&r, msg, n) == 0);
+    assert(charq_try_push_msg(&r, "!", 1) == 0);
+    assert(charq_peek_msg_len(&r, &len) == 0 && len == n);
+    // Popping into a buffer that's too small leaves it there
+    if (n > 0) {
+      assert(charq_try_pop_msg(&r, buf, n - 1, &len) == 2 && len == n);
+    }
+    assert(charq_try_pop_msg(&r, buf, sizeof(buf), &len) == 0);
+    assert(len == n && memcmp(buf, msg, n) == 0);
+    assert(charq_try_pop_msg(&r, buf, sizeof(buf), &len) == 0);
+    assert(len == 1 && buf[0] == '!');
+  }
+  // Fills up
+  size_t pushed = 0;
+  while (charq_try_push_msg(&r, "0123456", 7) == 0) {
+    pushed++;
+  }
+  assert(pushed > 0 && pushed <= 256 / 12);
+  for (size_t i = 0; i < pushed; i++) {
+    assert(charq_try_pop_msg(&r, buf, sizeof(buf), &len) == 0);
+    assert(len == 7 && memcmp(buf, "0123456", 7) == 0);
+  }
+  assert(charq_try_pop_msg(&r, buf, sizeof(buf), &len) == 1);
+  SRB_FREE(r);
+}
+
+int main() {
+  check_framing();
+
+  // Messages from concurrent producers come out whole
+  SRB_INIT_MPSC(q, 256);
+  thrd_t ws[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], writer, (void *)i) == thrd_success);
+  }
+  size_t expected[WRITERS] = {0};
+  for (size_t total = 0; total < ITERATIONS * WRITERS;) {
+    char buf[128], want[128];
+    size_t len;
+    if (mpsc_try_pop_msg(&q, buf, sizeof(buf), &len)) {
+      thrd_yield();
+      continue;
+    }
+    size_t id = (size_t)(buf[0] - '0');
+    assert(id < WRITERS);
+    size_t want_len = make_msg(want, id, expected[id]);
+    assert(len == want_len && memcmp(buf, want, len) == 0);
+    expected[id]++;
+    total++;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  SRB_FREE(q);
+
+  return 0;
+}
@@ -56,7 +56,7 @@ int main(int argc, char **argv) {
   uintptr_t num_readers = parse_arg(1, argc, argv, 1);
   uintptr_t num_writers = parse_arg(2, argc, argv, 1);
   iterations = parse_arg(3, argc, argv, 100000);
-  size_t buffer_size = parse_arg(3, argc, argv, 256);
+  size_t buffer_size = parse_arg(4, argc, argv, 256);
 
   atomic_init(&counter, 0);
 
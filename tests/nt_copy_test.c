@@ -0,0 +1,76 @@
+#define SRB_NT_COPY
+// Low enough that the rings below take the streaming path
+#define SRB_NT_THRESHOLD 64
+// Counts the pushes that go through the hook
+#define SRB_COPY_PUSH(dst, src, bytes)                                         \
+  (hooked_pushes++, srb_nt_copy_push(dst, src, bytes))
+static int hooked_pushes;
+#include "srb.h"
+#include <stdint.h>
+
+SRB_DECL(static, ring, uint32_t);
+SRB_DEF(static, ring, uint32_t);
+SRB_DECL_SPSC(static, spsc, uint32_t);
+SRB_DEF_SPSC(static, spsc, uint32_t);
+
+#define BYTES 1024
+
+int main() {
+  // Every kernel, every alignment of both ends, across the vector sizes
+  static char src[BYTES + 64], dst[BYTES + 64];
+  for (size_t i = 0; i < sizeof(src); i++) {
+    src[i] = (char)(i * 7 + 1);
+  }
+  srb_copy_kernel kernels[] = {
+      srb_copy_scalar,
+#ifdef SRB_NT_X86
+      srb_copy_sse2,
+      __builtin_cpu_supports("avx2") ? srb_copy_avx2 : srb_copy_sse2,
+#endif // SRB_NT_X86
+  };
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
+    for (size_t d = 0; d < 32; d++) {
+      for (size_t s = 0; s < 4; s++) {
+        for (size_t n = 0; n < BYTES; n += 1 + n / 8) {
+          memset(dst, 0, sizeof(dst));
+          kernels[k](&dst[d], &src[s], n);
+          assert(memcmp(&dst[d], &src[s], n) == 0);
+          // Nothing written outside
+          for (size_t i = 0; i < sizeof(dst); i++) {
+            assert(dst[i] == 0 || (i >= d && i < d + n));
+          }
+        }
+      }
+    }
+  }
+  srb_stream_copy(dst, src, BYTES);
+  assert(memcmp(dst, src, BYTES) == 0);
+  memset(dst, 0, sizeof(dst));
+  srb_prefetch_copy(&dst[3], src, BYTES + 61);
+  assert(memcmp(&dst[3], src, BYTES + 61) == 0);
+
+  // Through the ringbuffers, small and large, wrapping around the end
+  uint32_t in[100], out[100];
+  ring r;
+  spsc q;
+  SRB_INIT(r, 150);
+  SRB_INIT_SPSC(q, 150);
+  for (uint32_t lap = 0; lap < 10; lap++) {
+    for (size_t n = 1; n <= 100; n += 33) {
+      for (size_t i = 0; i < n; i++) {
+        in[i] = lap * 1000 + (uint32_t)i;
+      }
+      srb_uint32_t_slice v = {in, n}, w = {out, n};
+      ring_push(&r, v);
+      ring_pop(&r, w);
+      assert(memcmp(in, out, n * sizeof(*in)) == 0);
+      spsc_push(&q, v);
+      spsc_pop(&q, w);
+      assert(memcmp(in, out, n * sizeof(*in)) == 0);
+    }
+  }
+  assert(hooked_pushes >= 2 * 10 * 4);
+  SRB_FREE(r);
+  SRB_FREE(q);
+  return 0;
+}
@@ -0,0 +1,89 @@
+#define SRB_POW2
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+
+SRB_DECL(static, queue, size_t);
+SRB_DEF(static, queue, size_t);
+SRB_DECL_SPSC(static, spsc, size_t);
+SRB_DEF_SPSC(static, spsc, size_t);
+
+#define ITERATIONS 100000
+#define WRITERS 4
+
+static queue q;
+
+int writer(void *arg) {
+  size_t id = (size_t)arg;
+  for (size_t i = id; i < ITERATIONS; i += WRITERS) {
+    while (queue_try_push_one(&q, i)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+int main() {
+  // Sizes get rounded up to a power of two, and all of it is usable
+  SRB_INIT(q, 5);
+  assert(q.buffer.size == 8);
+  assert(queue_capacity(&q) == 8);
+  for (size_t i = 0; i < 8; i++) {
+    assert(queue_try_push_one(&q, i) == 0);
+  }
+  assert(queue_try_push_one(&q, 8) != 0);
+  assert(queue_len(&q) == 8);
+  for (size_t i = 0; i < 8; i++) {
+    assert(queue_pop_one(&q) == i);
+  }
+  assert(queue_len(&q) == 0);
+  SRB_FREE(q);
+
+  // The counters are free-running, so start them just short of wrapping
+  // around size_t and push through the wrap
+  SRB_INIT(q, 4);
+  size_t start = SIZE_MAX - 5;
+  atomic_store(&q.head_valid, start);
+  atomic_store(&q.head_commit, start);
+  atomic_store(&q.tail_valid, start);
+  atomic_store(&q.tail_commit, start);
+  size_t out[3];
+  for (size_t i = 0; i < 20; i++) {
+    size_t in[3] = {i, i + 1, i + 2};
+    assert(queue_try_push(&q, (srb_size_t_slice){in, 3}) == 0);
+    assert(queue_len(&q) == 3);
+    assert(queue_try_push(&q, (srb_size_t_slice){in, 2}) != 0);
+    assert(queue_try_pop(&q, (srb_size_t_slice){out, 3}) == 0);
+    assert(out[0] == i && out[1] == i + 1 && out[2] == i + 2);
+  }
+  assert(atomic_load(&q.tail_valid) < start);
+  SRB_FREE(q);
+
+  spsc sq;
+  SRB_INIT_SPSC(sq, 3);
+  assert(spsc_capacity(&sq) == 4);
+  SRB_FREE(sq);
+
+  // Multiple producers landing their reservations across the wrap
+  SRB_INIT(q, 16);
+  thrd_t ws[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], writer, (void *)i) == thrd_success);
+  }
+  size_t last[WRITERS] = {0};
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    size_t x;
+    while (queue_try_pop_one(&q, &x)) {
+      thrd_yield();
+    }
+    // Each writer's items come out in the order it pushed them
+    assert(x >= last[x % WRITERS]);
+    last[x % WRITERS] = x;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  SRB_FREE(q);
+
+  return 0;
+}
@@ -0,0 +1,54 @@
+#include "srb.h"
+
+SRB_DECL(static, srb, int);
+SRB_DEF(static, srb, int);
+
+int main() {
+  srb q;
+  SRB_INIT(q, 6);
+  srb_int_slice first, second;
+
+  // Reserve space and write into it in place
+  assert(srb_try_reserve_push(&q, 4, &first, &second) == 0);
+  assert(first.size == 4);
+  assert(second.size == 0);
+  for (int i = 0; i < 4; i++) {
+    first.data[i] = i + 1;
+  }
+  // Nothing is visible until the reservation is committed
+  int x;
+  assert(srb_try_pop_one(&q, &x) != 0);
+  srb_commit_push(&q, first, second);
+
+  // Can't reserve more than the remaining capacity
+  assert(srb_try_reserve_push(&q, 2, &first, &second) != 0);
+
+  // Read in place, then release the slots back to producers
+  assert(srb_try_reserve_pop(&q, 3, &first, &second) == 0);
+  assert(first.size == 3);
+  assert(first.data[0] == 1);
+  assert(first.data[1] == 2);
+  assert(first.data[2] == 3);
+  srb_release_pop(&q, first, second);
+
+  // A reservation that crosses the end of the buffer comes back in two parts
+  assert(srb_try_reserve_push(&q, 4, &first, &second) == 0);
+  assert(first.size == 2);
+  assert(second.size == 2);
+  assert(second.data == q.buffer.data);
+  first.data[0] = 5;
+  first.data[1] = 6;
+  second.data[0] = 7;
+  second.data[1] = 8;
+  srb_commit_push(&q, first, second);
+
+  int vs[5];
+  assert(srb_try_pop(&q, (srb_int_slice){vs, 5}) == 0);
+  for (int i = 0; i < 5; i++) {
+    assert(vs[i] == i + 4);
+  }
+
+  SRB_FREE(q);
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+
+SRB_DECL_SLICE(size_t);
+SRB_DECL_MPSC(static, lane, size_t);
+SRB_DEF_MPSC(static, lane, size_t);
+SRB_DECL_SHARDED(static, sharded, lane, size_t);
+SRB_DEF_SHARDED(static, sharded, lane, size_t);
+
+#define ITERATIONS 50000
+#define WRITERS 8
+#define LANES 4
+
+static sharded q;
+
+int writer(void *arg) {
+  size_t id = (size_t)arg;
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    while (sharded_try_push_one(&q, i * WRITERS + id)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+int main() {
+  sharded s;
+  size_t out[16];
+  size_t n;
+  SRB_INIT_SHARDED(s, 3, 4, SRB_INIT_MPSC);
+  assert(sharded_capacity(&s) == 12);
+  assert(sharded_try_pop_some(&s, (srb_size_t_slice){out, 16}, &n) == 1);
+  assert(n == 0);
+  // Always the same lane for the same thread
+  assert(sharded_lane(&s) == sharded_lane(&s));
+  sharded_push_one(&s, 1);
+  sharded_push(&s, (srb_size_t_slice){(size_t[]){2, 3}, 2});
+  assert(lane_len(sharded_lane(&s)) == 3 && sharded_len(&s) == 3);
+  assert(sharded_pop_one(&s) == 1);
+  assert(sharded_pop_one(&s) == 2);
+  assert(sharded_pop_one(&s) == 3);
+
+  // Round-robin, at most `quantum` from each lane per pop
+  s.quantum = 2;
+  for (size_t l = 0; l < 3; l++) {
+    for (size_t i = 0; i < 4; i++) {
+      lane_push_one(&s.lanes[l], l * 10 + i);
+    }
+  }
+  assert(sharded_try_pop_some(&s, (srb_size_t_slice){out, 16}, &n) == 0);
+  assert(n == 6);
+  size_t first = atomic_load(&s.next) + 2;
+  for (size_t i = 0; i < 3; i++) {
+    size_t l = (first + i) % 3;
+    assert(out[i * 2] == l * 10 && out[i * 2 + 1] == l * 10 + 1);
+  }
+  // The next pop starts one lane further along
+  assert(sharded_pop_one(&s) / 10 == (first + 1) % 3);
+  s.quantum = 0;
+  assert(sharded_try_pop_some(&s, (srb_size_t_slice){out, 16}, &n) == 0);
+  assert(n == 5 && sharded_len(&s) == 0);
+  SRB_FREE_SHARDED(s);
+  assert(s.lanes == NULL);
+
+  // More writers than lanes, every writer's elements in order
+  SRB_INIT_SHARDED(q, LANES, 64, SRB_INIT_MPSC);
+  thrd_t ws[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], writer, (void *)i) == thrd_success);
+  }
+  size_t expected[WRITERS] = {0};
+  for (size_t total = 0; total < ITERATIONS * WRITERS;) {
+    if (sharded_try_pop_some(&q, (srb_size_t_slice){out, 16}, &n)) {
+      thrd_yield();
+      continue;
+    }
+    for (size_t i = 0; i < n; i++) {
+      size_t id = out[i] % WRITERS;
+      assert(out[i] / WRITERS == expected[id]);
+      expected[id]++;
+    }
+    total += n;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  assert(sharded_len(&q) == 0);
+  SRB_FREE_SHARDED(q);
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+#define SRB_SHM
+#define SRB_BLOCKING
+#include "srb.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+
+SRB_DECL(static, queue, size_t);
+SRB_DEF(static, queue, size_t);
+SRB_DECL_MPSC(static, mpsc, size_t);
+SRB_DEF_MPSC(static, mpsc, size_t);
+SRB_DECL_SLICE(uint32_t);
+SRB_DECL_SPSC(static, narrow, uint32_t);
+SRB_DEF_SPSC(static, narrow, uint32_t);
+
+#define ITERATIONS 20000
+#define WRITERS 2
+
+static char name[64];
+
+// Runs in a child process: attach to the segment and push our share
+static void writer(size_t id, size_t writers, int many) {
+  if (many) {
+    mpsc *r;
+    SRB_ATTACH_MPSC_SHM(r, name);
+    assert(r != NULL);
+    for (size_t i = 0; i < ITERATIONS; i++) {
+      mpsc_push_wait_one(r, i * writers + id);
+    }
+    SRB_DETACH_SHM(r);
+  } else {
+    queue *r;
+    SRB_ATTACH_SHM(r, name);
+    assert(r != NULL);
+    for (size_t i = 0; i < ITERATIONS; i++) {
+      queue_push_wait_one(r, i * writers + id);
+    }
+    SRB_DETACH_SHM(r);
+  }
+  _exit(0);
+}
+
+static void spawn(size_t writers, int many, pid_t *pids) {
+  for (size_t i = 0; i < writers; i++) {
+    pids[i] = fork();
+    assert(pids[i] >= 0);
+    if (pids[i] == 0) {
+      writer(i, writers, many);
+    }
+  }
+}
+
+static void reap(size_t writers, pid_t *pids) {
+  for (size_t i = 0; i < writers; i++) {
+    int status;
+    assert(waitpid(pids[i], &status, 0) == pids[i]);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+}
+
+int main() {
+  snprintf(name, sizeof(name), "/srb_shm_test_%ld", (long)getpid());
+  pid_t pids[WRITERS];
+
+  // One writer process, blocking on a small ringbuffer
+  queue *q;
+  SRB_INIT_SHM(q, name, 16);
+  assert(q != NULL);
+  // Names are exclusive
+  queue *again;
+  SRB_INIT_SHM(again, name, 16);
+  assert(again == NULL);
+  // Attaching checks the type
+  narrow *wrong;
+  SRB_ATTACH_SHM(wrong, name);
+  assert(wrong == NULL);
+  // And the flavour, even for the same type
+  queue *other;
+  SRB_ATTACH_MPSC_SHM(other, name);
+  assert(other == NULL);
+  SRB_ATTACH_SPSC_SHM(other, name);
+  assert(other == NULL);
+
+  spawn(1, 0, pids);
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    assert(queue_pop_wait_one(q) == i);
+  }
+  reap(1, pids);
+  assert(queue_len(q) == 0);
+  SRB_DETACH_SHM(q);
+  assert(shm_unlink(name) == 0);
+
+  // Gone once unlinked
+  SRB_ATTACH_SHM(q, name);
+  assert(q == NULL);
+
+  // Several writer processes
+  mpsc *m;
+  SRB_INIT_MPSC_SHM(m, name, 64);
+  assert(m != NULL);
+  spawn(WRITERS, 1, pids);
+  size_t expected[WRITERS] = {0};
+  for (size_t i = 0; i < ITERATIONS * WRITERS; i++) {
+    size_t v = mpsc_pop_wait_one(m);
+    assert(v / WRITERS == expected[v % WRITERS]);
+    expected[v % WRITERS]++;
+  }
+  reap(WRITERS, pids);
+  SRB_DETACH_SHM(m);
+  assert(shm_unlink(name) == 0);
+
+  // Ordinary ringbuffers still work with SRB_SHM
+  narrow n;
+  SRB_INIT_SPSC(n, 4);
+  narrow_push_one(&n, 7);
+  assert(narrow_pop_one(&n) == 7);
+  SRB_FREE(n);
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+
+SRB_DECL_SLOTS(static, slots, size_t);
+SRB_DEF_SLOTS(static, slots, size_t);
+
+#define ITERATIONS 50000
+#define WRITERS 4
+#define READERS 4
+
+static slots q;
+static _Atomic size_t seen[ITERATIONS * WRITERS];
+static atomic_size_t popped;
+
+int writer(void *arg) {
+  size_t id = (size_t)arg;
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    while (slots_try_push_one(&q, i * WRITERS + id)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+int reader(void *arg) {
+  (void)arg;
+  // Each reader sees every writer's elements in the order they were pushed
+  size_t last[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    last[i] = SIZE_MAX;
+  }
+  while (atomic_load(&popped) < ITERATIONS * WRITERS) {
+    size_t v;
+    if (slots_try_pop_one(&q, &v)) {
+      thrd_yield();
+      continue;
+    }
+    size_t id = v % WRITERS;
+    assert(last[id] == SIZE_MAX || v / WRITERS > last[id]);
+    last[id] = v / WRITERS;
+    assert(atomic_fetch_add(&seen[v], 1) == 0);
+    atomic_fetch_add(&popped, 1);
+  }
+  return 0;
+}
+
+int main() {
+  slots r;
+  size_t out;
+  SRB_INIT_SLOTS(r, 5);
+  size_t cap = slots_capacity(&r);
+  // Always a power of two
+  assert(cap == 8);
+  assert(slots_try_pop_one(&r, &out) == 1);
+  // Every slot can be used
+  for (size_t i = 0; i < cap; i++) {
+    assert(slots_try_push_one(&r, i) == 0);
+    assert(slots_len(&r) == i + 1);
+  }
+  assert(slots_try_push_one(&r, 0) == 1);
+  for (size_t i = 0; i < cap; i++) {
+    assert(slots_pop_one(&r) == i);
+  }
+  assert(slots_try_pop_one(&r, &out) == 1);
+  assert(slots_len(&r) == 0);
+  // Many laps around the buffer
+  for (size_t i = 0; i < 100 * cap; i++) {
+    slots_push_one(&r, i);
+    slots_push_one(&r, i + 1);
+    assert(slots_pop_one(&r) == i);
+    assert(slots_pop_one(&r) == i + 1);
+  }
+  SRB_FREE_SLOTS(r);
+  assert(r.buffer.data == NULL);
+
+  // Several producers and consumers: everything comes out exactly once
+  SRB_INIT_SLOTS(q, 64);
+  thrd_t ws[WRITERS], rs[READERS];
+  for (size_t i = 0; i < READERS; i++) {
+    assert(thrd_create(&rs[i], reader, NULL) == thrd_success);
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], writer, (void *)i) == thrd_success);
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  for (size_t i = 0; i < READERS; i++) {
+    assert(thrd_join(rs[i], NULL) == thrd_success);
+  }
+  for (size_t i = 0; i < ITERATIONS * WRITERS; i++) {
+    assert(atomic_load(&seen[i]) == 1);
+  }
+  assert(slots_len(&q) == 0);
+  SRB_FREE_SLOTS(q);
+
+  return 0;
+}
@@ -0,0 +1,54 @@
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+
+SRB_DECL_SLICE(size_t);
+SRB_DECL_SPSC(static, spsc, size_t);
+SRB_DEF_SPSC(static, spsc, size_t);
+
+#define ITERATIONS 1000000
+
+static spsc q;
+
+int writer(void *arg) {
+  (void)arg;
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    while (spsc_try_push_one(&q, i)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+int main() {
+  SRB_INIT_SPSC(q, 4);
+  // All the slots are usable
+  size_t vs[] = {1, 2, 3, 4};
+  assert(spsc_try_push(&q, (srb_size_t_slice){vs, 4}) == 0);
+  assert(spsc_try_push_one(&q, 5) != 0);
+  assert(spsc_pop_one(&q) == 1);
+  assert(spsc_try_push_one(&q, 5) == 0);
+  // Pops wrap around the end of the buffer
+  assert(spsc_try_pop(&q, (srb_size_t_slice){vs, 4}) == 0);
+  assert(vs[0] == 2);
+  assert(vs[1] == 3);
+  assert(vs[2] == 4);
+  assert(vs[3] == 5);
+  size_t x;
+  assert(spsc_try_pop_one(&q, &x) != 0);
+  SRB_FREE(q);
+
+  SRB_INIT_SPSC(q, 64);
+  thrd_t w;
+  assert(thrd_create(&w, writer, NULL) == thrd_success);
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    while (spsc_try_pop_one(&q, &x)) {
+      thrd_yield();
+    }
+    assert(x == i);
+  }
+  assert(thrd_join(w, NULL) == thrd_success);
+  SRB_FREE(q);
+
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include "srb.h"
+#include <stdint.h>
+#include <threads.h>
+
+SRB_DECL_STATIC(static, queue, size_t, 16);
+SRB_DEF_STATIC(static, queue, size_t);
+SRB_DECL_SPSC_STATIC(static, spsc, size_t, 8);
+SRB_DEF_SPSC_STATIC(static, spsc, size_t);
+SRB_DECL_MPSC_STATIC(static, mpsc, size_t, 64);
+SRB_DEF_MPSC_STATIC(static, mpsc, size_t);
+
+#define ITERATIONS 50000
+#define WRITERS 4
+
+// No code runs to set these up
+static queue q = SRB_STATIC_INIT(queue, q);
+static struct {
+  int before;
+  spsc ring;
+  int after;
+} holder = {1, SRB_SPSC_STATIC_INIT(spsc, holder.ring), 2};
+static mpsc m = SRB_MPSC_STATIC_INIT(mpsc, m);
+
+int writer(void *arg) {
+  size_t id = (size_t)arg;
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    while (mpsc_try_push_one(&m, i * WRITERS + id)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+int main() {
+  assert(q.buffer.data == q.storage && queue_capacity(&q) == srb_usable(16));
+  assert(queue_len(&q) == 0);
+  size_t in[16], out[16];
+  for (size_t i = 0; i < 16; i++) {
+    in[i] = i;
+  }
+  // Wraps around like any other ringbuffer
+  for (size_t lap = 0; lap < 20; lap++) {
+    assert(queue_try_push(&q, (srb_size_t_slice){in, 5}) == 0);
+    assert(queue_len(&q) == 5);
+    assert(queue_try_pop(&q, (srb_size_t_slice){out, 5}) == 0);
+    assert(memcmp(in, out, 5 * sizeof(size_t)) == 0);
+  }
+  assert(queue_try_push(&q, (srb_size_t_slice){in, queue_capacity(&q)}) == 0);
+  assert(queue_try_push_one(&q, 0) != 0);
+
+  // Inside another structure
+  assert(holder.before == 1 && holder.after == 2);
+  assert(spsc_capacity(&holder.ring) == 8);
+  for (size_t i = 0; i < 100; i++) {
+    spsc_push_one(&holder.ring, i);
+    assert(spsc_pop_one(&holder.ring) == i);
+  }
+
+  // On the stack
+  spsc local = SRB_SPSC_STATIC_INIT(spsc, local);
+  assert(spsc_try_pop_one(&local, &out[0]) != 0);
+  spsc_push_one(&local, 42);
+  assert(spsc_pop_one(&local) == 42);
+
+  // Several producers
+  thrd_t ws[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], writer, (void *)i) == thrd_success);
+  }
+  size_t expected[WRITERS] = {0};
+  for (size_t total = 0; total < ITERATIONS * WRITERS; total++) {
+    size_t v;
+    while (mpsc_try_pop_one(&m, &v)) {
+      thrd_yield();
+    }
+    assert(v / WRITERS == expected[v % WRITERS]);
+    expected[v % WRITERS]++;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+
+  return 0;
+}
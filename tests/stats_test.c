@@ -0,0 +1,121 @@
+#define SRB_STATS
+#include "srb.h"
+#include "flavours.h"
+#include <threads.h>
+
+SRB_DECL_SLOTS(static, slots, size_t);
+SRB_DEF_SLOTS(static, slots, size_t);
+SRB_DECL_BROADCAST(static, bcast, size_t);
+SRB_DEF_BROADCAST(static, bcast, size_t);
+
+#define ITERATIONS 20000
+#define WRITERS 4
+
+static queue q;
+
+int writer(void *arg) {
+  (void)arg;
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    while (queue_try_push_one(&q, i)) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+#define SIZE 8
+
+static void check_stats(const flavour *f) {
+  any_ring r;
+  size_t in[SIZE] = {0};
+  size_t out;
+  f->init(&r, SIZE);
+  size_t cap = f->capacity(&r);
+  srb_stats st = f->stats_snapshot(&r);
+  assert(st.pushes == 0 && st.pops == 0 && st.high_water == 0);
+  // Empty pushes and pops move nothing, so don't count
+  assert(f->try_push(&r, (srb_size_t_slice){in, 0}) == 0);
+  assert(f->try_pop(&r, (srb_size_t_slice){&out, 0}) == 0);
+  st = f->stats_snapshot(&r);
+  assert(st.pushes == 0 && st.pops == 0);
+  // Fill it up, then fail to push once more
+  assert(f->try_push(&r, (srb_size_t_slice){in, cap}) == 0);
+  assert(f->try_push_one(&r, 0) != 0);
+  // Empty it, then fail to pop once more
+  for (size_t i = 0; i < cap; i++) {
+    assert(f->try_pop_one(&r, &out) == 0);
+  }
+  assert(f->try_pop_one(&r, &out) != 0);
+  st = f->stats_snapshot(&r);
+  assert(st.pushes == 1 && st.pushed == cap);
+  assert(st.pops == cap && st.popped == cap);
+  assert(st.push_full == 1 && st.pop_empty == 1);
+  assert(st.high_water == cap);
+  // Nobody else was around to retry against
+  assert(st.push_claim_retries == 0 && st.push_commit_retries == 0 &&
+         st.push_publish_spins == 0);
+  assert(st.pop_claim_retries == 0 && st.pop_commit_retries == 0 &&
+         st.pop_publish_spins == 0);
+  f->free(&r);
+}
+
+int main() {
+  for (size_t i = 0; i < FLAVOURS; i++) {
+    check_stats(&flavours[i]);
+  }
+
+  // One element at a time
+  slots sl;
+  SRB_INIT_SLOTS(sl, 8);
+  size_t out;
+  for (size_t i = 0; i < 8; i++) {
+    assert(slots_try_push_one(&sl, i) == 0);
+  }
+  assert(slots_try_push_one(&sl, 0) != 0);
+  while (slots_try_pop_one(&sl, &out) == 0) {
+  }
+  srb_stats st = slots_stats_snapshot(&sl);
+  assert(st.pushes == 8 && st.pushed == 8 && st.pops == 8 && st.popped == 8);
+  assert(st.push_full == 1 && st.pop_empty == 1 && st.high_water == 8);
+  assert(st.push_claim_retries == 0 && st.pop_claim_retries == 0);
+  SRB_FREE_SLOTS(sl);
+
+  // Broadcast pushes count the same way, and empty ones don't either
+  bcast b;
+  SRB_INIT_BROADCAST(b, 8, 1);
+  assert(bcast_try_push(&b, (srb_size_t_slice){&out, 0}) == 0);
+  st = bcast_stats_snapshot(&b);
+  assert(st.pushes == 0 && st.pushed == 0);
+  bcast_push_one(&b, 0);
+  st = bcast_stats_snapshot(&b);
+  assert(st.pushes == 1 && st.pushed == 1);
+  SRB_FREE_BROADCAST(b);
+
+  // Writers count in their own shards, but they all get added up
+  SRB_INIT(q, 16);
+  thrd_t ws[WRITERS];
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_create(&ws[i], writer, NULL) == thrd_success);
+  }
+  size_t failed = 0;
+  for (size_t total = 0; total < ITERATIONS * WRITERS;) {
+    size_t i;
+    if (queue_try_pop_one(&q, &i)) {
+      failed++;
+      thrd_yield();
+      continue;
+    }
+    total++;
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    assert(thrd_join(ws[i], NULL) == thrd_success);
+  }
+  st = queue_stats_snapshot(&q);
+  assert(st.pushes == ITERATIONS * WRITERS && st.pushed == st.pushes);
+  assert(st.pops == ITERATIONS * WRITERS && st.popped == st.pops);
+  assert(st.pop_empty == failed);
+  assert(st.high_water > 0 && st.high_water <= queue_capacity(&q));
+  SRB_FREE(q);
+
+  return 0;
+}
@@ -0,0 +1,43 @@
+// Built as strict ISO C (-std=c17 rather than gnu17), where glibc hides
+// everything outside ISO C and POSIX unless asked, to check that the
+// configurations which need more build once the feature macro is defined.
+#define _DEFAULT_SOURCE
+#define SRB_BLOCKING
+#define SRB_MIRROR
+#define SRB_SHM
+#define SRB_MMAP
+#include "srb.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+SRB_DECL(static, queue, size_t);
+SRB_DEF(static, queue, size_t);
+
+int main() {
+  queue q;
+  SRB_INIT(q, 8);
+  queue_push_wait_one(&q, 42);
+  assert(queue_pop_wait_one(&q) == 42);
+  SRB_FREE(q);
+  SRB_INIT_MIRROR(q, 8);
+  queue_push_one(&q, 43);
+  assert(queue_pop_one(&q) == 43);
+  SRB_FREE(q);
+  SRB_INIT_EX(q, 8, ((srb_alloc_opts){.flags = SRB_ALLOC_THP}));
+  queue_push_one(&q, 45);
+  assert(queue_pop_one(&q) == 45);
+  SRB_FREE(q);
+
+  char name[64];
+  snprintf(name, sizeof(name), "/srb_strict_test_%ld", (long)getpid());
+  queue *shared;
+  SRB_INIT_SHM(shared, name, 8);
+  assert(shared != NULL);
+  queue_push_one(shared, 44);
+  assert(queue_pop_one(shared) == 44);
+  SRB_DETACH_SHM(shared);
+  assert(shm_unlink(name) == 0);
+  return 0;
+}
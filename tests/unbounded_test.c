@@ -0,0 +1,99 @@
+#include "srb.h"
+#include <threads.h>
+
+SRB_DECL_SLICE(size_t);
+SRB_DECL_UNBOUNDED(static, unbounded, size_t);
+SRB_DEF_UNBOUNDED(static, unbounded, size_t);
+
+#define ITERATIONS 500000
+#define SEGMENT 64
+#define SPARES 2
+
+static unbounded q;
+
+// Pushes in bursts of up to a few segments, so the queue keeps growing and
+// shrinking under the consumer
+int writer(void *arg) {
+  (void)arg;
+  size_t burst[SEGMENT * 3];
+  for (size_t i = 0; i < ITERATIONS;) {
+    size_t n = (i / 7) % (SEGMENT * 3) + 1;
+    if (n > ITERATIONS - i) {
+      n = ITERATIONS - i;
+    }
+    for (size_t j = 0; j < n; j++) {
+      burst[j] = i + j;
+    }
+    unbounded_push(&q, (srb_size_t_slice){burst, n});
+    i += n;
+    if (i % 5 == 0) {
+      thrd_yield();
+    }
+  }
+  return 0;
+}
+
+int main() {
+  unbounded r;
+  size_t out, buf[16];
+  size_t n;
+  SRB_INIT_UNBOUNDED(r, 4, 1);
+  assert(unbounded_segments(&r) == 1);
+  assert(unbounded_try_pop_one(&r, &out) == 1);
+  // A burst never fails, it takes more segments
+  for (size_t i = 0; i < 100; i++) {
+    unbounded_push_one(&r, i);
+  }
+  assert(unbounded_segments(&r) >= 100 / 4);
+  for (size_t i = 0; i < 100; i++) {
+    assert(unbounded_pop_one(&r) == i);
+  }
+  assert(unbounded_try_pop_one(&r, &out) == 1);
+  // Emptied segments are freed, but for the one in use and one spare
+  assert(unbounded_segments(&r) <= 2);
+  // In steady state, the spare keeps getting reused
+  for (size_t i = 0; i < 1000; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      unbounded_push_one(&r, i * 3 + j);
+    }
+    for (size_t j = 0; j < 3; j++) {
+      assert(unbounded_pop_one(&r) == i * 3 + j);
+    }
+    assert(unbounded_segments(&r) <= 2);
+  }
+  // Batches across segments come out in order, a segment at a time at most
+  size_t in[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  unbounded_push(&r, (srb_size_t_slice){in, 10});
+  size_t got = 0;
+  while (unbounded_try_pop_some(&r, (srb_size_t_slice){buf, 16}, &n) == 0) {
+    assert(n > 0 && n <= 4);
+    for (size_t i = 0; i < n; i++) {
+      assert(buf[i] == got + i);
+    }
+    got += n;
+  }
+  assert(got == 10);
+  assert(unbounded_try_pop_some(&r, (srb_size_t_slice){buf, 0}, &n) == 1);
+  // Freed with elements still in it
+  unbounded_push(&r, (srb_size_t_slice){in, 10});
+  SRB_FREE_UNBOUNDED(r);
+
+  // One producer, one consumer
+  SRB_INIT_UNBOUNDED(q, SEGMENT, SPARES);
+  thrd_t t;
+  assert(thrd_create(&t, writer, NULL) == thrd_success);
+  for (size_t i = 0; i < ITERATIONS;) {
+    if (unbounded_try_pop_some(&q, (srb_size_t_slice){buf, 16}, &n) != 0) {
+      thrd_yield();
+      continue;
+    }
+    for (size_t j = 0; j < n; j++, i++) {
+      assert(buf[j] == i);
+    }
+  }
+  thrd_join(t, NULL);
+  assert(unbounded_try_pop_one(&q, &out) == 1);
+  assert(unbounded_segments(&q) <= 1 + SPARES);
+  SRB_FREE_UNBOUNDED(q);
+  return 0;
+}